@@ -0,0 +1,68 @@
+#include "bench/generated_program.hpp"
+#include "clox/parser/parallel_parser.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+// Measure how scanning and parsing a file scales with the threads of the
+// parallel front end, on a generated program of the given size or on a
+// script: front_end_scaling [size_in_mb | script] [max_thread_num]
+
+// Return the best time of a few runs in seconds
+double best_seconds(const std::function<void()> &run) {
+    const int RUN_NUM = 5;
+    double best = 0;
+    for (int i = 0; i < RUN_NUM; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> seconds =
+            std::chrono::steady_clock::now() - start;
+        if (i == 0 || seconds.count() < best) {
+            best = seconds.count();
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    std::string arg = argc > 1 ? argv[1] : "32";
+    size_t max_thread_num =
+        argc > 2 ? std::stoul(argv[2])
+                 : std::max(1u, std::thread::hardware_concurrency());
+
+    SourceBuffer source;
+    if (!arg.empty() && std::isdigit(arg[0])) {
+        source.load_text(generate_program(std::stoul(arg) * 1024 * 1024));
+    } else if (!source.load_file(arg)) {
+        std::cerr << "Unable to open file" << std::endl;
+        return 1;
+    }
+
+    double serial = best_seconds([&source] {
+        Scanner scanner{source.view()};
+        std::vector<Token> tokens = scanner.scan_tokens();
+        AstArena arena;
+        Parser parser{tokens, arena};
+        parser.parse_program();
+    });
+    double mb = source.view().size() / (1024.0 * 1024.0);
+    std::cout << "Front end of " << mb << " MB, serial: " << serial << "s"
+              << std::endl;
+
+    for (size_t thread_num = 1; thread_num <= max_thread_num;
+         thread_num *= 2) {
+        ThreadPool pool(thread_num);
+        double parallel = best_seconds([&source, &pool] {
+            ParallelParser parser;
+            parser.parse_program(source.view(), pool);
+        });
+        std::cout << thread_num << " threads: " << parallel << "s, speedup "
+                  << serial / parallel << "x" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+
+// Program used by the front end benchmarks: blocks of classes and functions
+// with comments, strings, identifiers, numbers and operators
+
+const std::string PROGRAM_BLOCK = R"(
+/*
+    Generated block: comments, strings, identifiers, numbers and operators
+*/
+class Point_ID : Base {
+    fun init(x, y) {
+        this.x = x; // horizontal coordinate
+        this.y = y;
+    }
+
+    fun distance_squared(other) {
+        var dx = this.x - other.x;
+        var dy = this.y - other.y;
+        return dx * dx + dy * dy;
+    }
+}
+
+fun describe_ID(point, label) {
+    if point.x >= 100.25 and point.y != 42 {
+        print("The point " + label + " is far away from the origin");
+    } elif point.x <= -3 or !(point.y == 0) {
+        print("The point is somewhere else, with a rather long message");
+    }
+    for var i = 0; i < 1000; i = i + 1; {
+        point.x = point.x + i % 7;
+    }
+}
+)";
+
+inline std::string generate_program(size_t size) {
+    std::string program;
+    program.reserve(size + PROGRAM_BLOCK.size());
+    for (size_t i = 0; program.size() < size; ++i) {
+        std::string block = PROGRAM_BLOCK;
+        for (size_t pos = block.find("ID"); pos != std::string::npos;
+             pos = block.find("ID", pos)) {
+            block.replace(pos, 2, std::to_string(i));
+        }
+        program += block;
+    }
+    return program;
+}
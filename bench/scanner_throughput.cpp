@@ -0,0 +1,41 @@
+#include "bench/generated_program.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include <cctype>
+#include <chrono>
+#include <iostream>
+
+// Measure the scanner throughput in MB/s on a generated program of the given
+// size, or on a script: scanner_throughput [size_in_mb | script]
+
+int main(int argc, char *argv[]) {
+    const int RUN_NUM = 5;
+    std::string arg = argc > 1 ? argv[1] : "64";
+
+    SourceBuffer source;
+    if (!arg.empty() && std::isdigit(arg[0])) {
+        source.load_text(generate_program(std::stoul(arg) * 1024 * 1024));
+    } else if (!source.load_file(arg)) {
+        std::cerr << "Unable to open file" << std::endl;
+        return 1;
+    }
+
+    double best_seconds = 0;
+    size_t token_num = 0;
+    for (int i = 0; i < RUN_NUM; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        Scanner scanner{source.view()};
+        token_num = scanner.scan_tokens().size();
+        std::chrono::duration<double> seconds =
+            std::chrono::steady_clock::now() - start;
+        if (i == 0 || seconds.count() < best_seconds) {
+            best_seconds = seconds.count();
+        }
+    }
+
+    double mb = source.view().size() / (1024.0 * 1024.0);
+    std::cout << "Scanned " << mb << " MB into " << token_num << " tokens in "
+              << best_seconds << "s: " << mb / best_seconds << " MB/s"
+              << std::endl;
+    return 0;
+}
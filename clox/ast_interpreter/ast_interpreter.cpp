@@ -7,35 +7,68 @@
 #include "clox/ast_interpreter/helper.hpp"
 #include "clox/common/constants.hpp"
 #include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
 #include "clox/common/token.hpp"
+#include "clox/middleware/module_loader.hpp"
 #include "clox/parser/expr.hpp"
 #include "clox/parser/stmt.hpp"
 #include "clox/utils/helper.hpp"
 
 #include <iostream>
 #include <memory>
-#include <variant>
+#include <utility>
 
 AstInterpreter::AstInterpreter(const bool is_interactive_mode)
-    : global_env(std::make_shared<Environment>()),
+    : global_env(Heap::alloc<Environment>()),
       is_interactive_mode(is_interactive_mode) {
+    Heap::add_roots(this);
     env = global_env;
-    global_env->add_identifier("clock", std::make_shared<ClockNativeFunc>());
-    global_env->add_identifier("print", std::make_shared<PrintNativeFunc>());
-    global_env->add_identifier("read", std::make_shared<ReadNativeFunc>());
-    global_env->add_identifier("readline",
-                               std::make_shared<ReadlineNativeFunc>());
-    global_env->add_identifier("bool", std::make_shared<BoolCastNativeFunc>());
-    global_env->add_identifier("str", std::make_shared<StringCastNativeFunc>());
-    global_env->add_identifier("num", std::make_shared<DoubleCastNativeFunc>());
-    global_env->add_identifier("int", std::make_shared<IntCastNativeFunc>());
-
-    // List is a special builtin class that is defined in the global env
-    auto list_env = std::make_shared<Environment>(global_env);
-    // List method requires "this", which will refer a ListInstance (contains
-    // data vector) in the interpreter process
-    list_env->add_identifier("this", NIL);
-    global_env->add_identifier("List", std::make_shared<List>(list_env));
+    top_level_env = global_env;
+    define_global("clock", Heap::alloc<ClockNativeFunc>());
+    define_global("print", Heap::alloc<PrintNativeFunc>());
+    define_global("read", Heap::alloc<ReadNativeFunc>());
+    define_global("readline", Heap::alloc<ReadlineNativeFunc>());
+    define_global("bool", Heap::alloc<BoolCastNativeFunc>());
+    define_global("str", Heap::alloc<StringCastNativeFunc>());
+    define_global("num", Heap::alloc<DoubleCastNativeFunc>());
+    define_global("int", Heap::alloc<IntCastNativeFunc>());
+
+    // List is a special builtin class that is defined in the global env, its
+    // methods are called with a ListInstance (contains data vector) receiver
+    define_global("List", Heap::alloc<List>());
+    builtin_num = global_slots.size();
+}
+
+AstInterpreter::~AstInterpreter() { Heap::remove_roots(this); }
+
+void AstInterpreter::mark_roots() {
+    Heap::mark_object(env);
+    Heap::mark_object(global_env);
+    Heap::mark_object(top_level_env);
+    Heap::mark_object(closure);
+    for (auto saved_env : env_stack) {
+        Heap::mark_object(saved_env);
+    }
+    for (const auto &value : value_stack) {
+        Heap::mark_value(value);
+    }
+    Heap::mark_value(return_val);
+    for (const auto &[module, module_env] : module_envs) {
+        Heap::mark_object(module_env);
+    }
+    Heap::mark_object(tail_function);
+    Heap::mark_object(tail_env);
+    // Recycled envs are cleared, they hold no value
+    for (auto frame : frame_pool) {
+        Heap::mark_object(frame);
+    }
+}
+
+void AstInterpreter::define_global(const std::string &name,
+                                   const ExprVal &value) {
+    uint slot = global_slots.size();
+    global_slots[name] = slot;
+    global_env->define_identifier(slot, value);
 }
 
 // func to test if the interpreter can exec a single expression
@@ -45,19 +78,36 @@ ExprVal AstInterpreter::interpret_single_expr(Expr &expression) {
         return result;
     } catch (RuntimeException &err) {
         ErrorManager::handle_runtime_err(err);
+        env = global_env;
+        top_level_env = global_env;
+        closure = nullptr;
+        env_stack.clear();
+        value_stack.clear();
         return NIL;
     }
 }
 
 void AstInterpreter::interpret_program(
-    const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    const std::vector<Stmt *> &stmts) {
+    // Allocate the slots of the globals declared by the resolver, they are
+    // undefined until their declaration is executed
+    global_env->resize(global_slots.size(), UNDEFINED);
     try {
         for (const auto &stmt : stmts) {
+            Heap::collect_if_needed();
             // exec stmt
             stmt->accept(*this);
         }
     } catch (RuntimeException &err) {
         ErrorManager::handle_runtime_err(err);
+        // Error may be thrown inside a block or func, restore the global state
+        // for the next line in interactive mode
+        env = global_env;
+        top_level_env = global_env;
+        closure = nullptr;
+        env_stack.clear();
+        value_stack.clear();
+        completion = Completion::NORMAL;
     }
 }
 
@@ -73,10 +123,14 @@ void AstInterpreter::visit_expr_stmt(const ExprStmt &expr_stmt) {
 void AstInterpreter::visit_assign_stmt(const AssignStmt &assign_stmt) {
     ExprVal new_value = evaluate_expr(*assign_stmt.value);
 
-    const IdentifierExpr *ptr = assign_stmt.var.get();
-    int depth = identifier_scope_depth_map[ptr];
-    move_up_env(depth)->update_identifier(assign_stmt.var->token->lexeme,
-                                          new_value, assign_stmt.var->token);
+    const IdentifierExpr &var = *assign_stmt.var;
+    ExprVal *value = find_identifier(var.depth, var.slot, var.is_cell);
+    if (value == nullptr) {
+        throw RuntimeException(var.token,
+                               "Cannot update undefined identifier '" +
+                                   std::string(var.token->lexeme) + "'");
+    }
+    *value = new_value;
 }
 
 void AstInterpreter::visit_var_decl(const VarDecl &var_decl) {
@@ -84,15 +138,19 @@ void AstInterpreter::visit_var_decl(const VarDecl &var_decl) {
     if (var_decl.initializer != nullptr) {
         var_value = evaluate_expr(*var_decl.initializer);
     }
-    env->add_identifier(var_decl.var_name->lexeme, var_value);
+    if (var_decl.is_captured) {
+        var_value = Heap::alloc<Cell>(var_value);
+    }
+    env->define_identifier(var_decl.slot, var_value);
 }
 
 void AstInterpreter::visit_if_stmt(const IfStmt &if_stmt) {
     bool exec_else_block = true;
 
-    for (int j = 0; j < if_stmt.conditions.size(); ++j) {
+    for (size_t j = 0; j < if_stmt.conditions.size(); ++j) {
         ExprVal expr_val = evaluate_expr(*if_stmt.conditions[j]);
         if (cast_expr_val_to_bool(expr_val)) {
+            // break/continue/return in the block is propagated by completion
             if_stmt.if_blocks[j]->accept(*this);
             exec_else_block = false;
             break;
@@ -105,45 +163,76 @@ void AstInterpreter::visit_if_stmt(const IfStmt &if_stmt) {
 }
 
 void AstInterpreter::visit_while_stmt(const WhileStmt &while_stmt) {
-    while (cast_expr_val_to_bool(evaluate_expr(*while_stmt.condition))) {
-        try {
-            while_stmt.body->accept(*this);
-        } catch (ContinueKwException &) {
-            continue;
-        } catch (BreakKwException &) {
+    // A while without condition, left by the AstOptimizer, runs until a break
+    while (while_stmt.condition == nullptr ||
+           cast_expr_val_to_bool(evaluate_expr(*while_stmt.condition))) {
+        while_stmt.body->accept(*this);
+        if (completion == Completion::BREAK) {
+            completion = Completion::NORMAL;
             return; // Break out of the loop
         }
+        if (completion == Completion::CONTINUE) {
+            completion = Completion::NORMAL;
+        } else if (completion == Completion::RETURN ||
+                   completion == Completion::TAIL_CALL) {
+            return;
+        }
     }
 }
 
 void AstInterpreter::visit_break_stmt(const BreakStmt &) {
-    throw BreakKwException();
+    completion = Completion::BREAK;
 }
 
 void AstInterpreter::visit_continue_stmt(const ContinueStmt &) {
-    throw ContinueKwException();
+    completion = Completion::CONTINUE;
 }
 
-void AstInterpreter::visit_function_decl(FunctionDecl &func_decl) {
-    auto func_decl_sp =
-        std::shared_ptr<FunctionDecl>(&func_decl, smart_pointer_no_op_deleter);
-    auto func = std::make_shared<LoxFunction>(func_decl_sp, env);
-    env->add_identifier(func_decl.name->lexeme, func);
+template <typename T>
+T *AstInterpreter::make_closure(FunctionDecl &func_decl,
+                                Environment *decl_env) {
+    auto function = Heap::alloc<T>(&func_decl, top_level_env, ast_owner);
+    function->upvalues.reserve(func_decl.captures.size());
+    for (const Capture &capture : func_decl.captures) {
+        if (!capture.is_local) {
+            function->upvalues.push_back(closure->upvalues[capture.slot]);
+            continue;
+        }
+        Environment *scope_env = decl_env;
+        for (uint i = 0; i < capture.depth; ++i) {
+            scope_env = scope_env->parent_scope_env;
+        }
+        function->upvalues.push_back(scope_env->get_identifier(capture.slot));
+    }
+    return function;
 }
 
-void AstInterpreter::visit_class_decl(const ClassDecl &class_decl) {
-    std::unordered_map<std::string, std::shared_ptr<LoxMethod>> methods = {};
+void AstInterpreter::visit_function_decl(FunctionDecl &func_decl) {
+    // A recursive closure captures the cell of its own name
+    Cell *cell = nullptr;
+    if (func_decl.is_captured) {
+        cell = Heap::alloc<Cell>(NIL);
+        env->define_identifier(func_decl.slot, cell);
+    }
 
-    auto class_env = std::make_shared<Environment>(env);
-    class_env->add_identifier("this", NIL);
+    auto func = make_closure<LoxFunction>(func_decl, env);
+    if (cell != nullptr) {
+        cell->value = func;
+    } else {
+        env->define_identifier(func_decl.slot, func);
+    }
+}
 
-    for (auto method : class_decl.methods) {
-        auto lox_method = std::make_shared<LoxMethod>(method, class_env);
-        methods[method->name->lexeme] = lox_method;
+void AstInterpreter::visit_class_decl(const ClassDecl &class_decl) {
+    // The methods may capture the cell of the class name
+    Cell *cell = nullptr;
+    if (class_decl.is_captured) {
+        cell = Heap::alloc<Cell>(NIL);
+        env->define_identifier(class_decl.slot, cell);
     }
 
     // Check if super class is defined and is a valid LoxClass
-    std::shared_ptr<LoxClass> superclass = nullptr;
+    LoxClass *superclass = nullptr;
     if (class_decl.superclass != nullptr) {
         ExprVal superclass_expr_val =
             class_decl.superclass->accept(*this); // evaluate super class expr
@@ -153,126 +242,174 @@ void AstInterpreter::visit_class_decl(const ClassDecl &class_decl) {
                                    "Superclass must be a defined class.");
         }
 
-        class_env->add_identifier("super", superclass);
     }
 
-    auto lox_class = std::make_shared<LoxClass>(class_decl.name->lexeme,
-                                                superclass, methods);
+    // The methods capture "super" from the class env, which is not used once
+    // they are created
+    auto class_env = Heap::alloc<Environment>(env, CLASS_ENV_SLOT_NUM);
+    if (superclass != nullptr) {
+        class_env->define_identifier(SUPER_SLOT, superclass);
+    }
+
+    std::unordered_map<LoxString *, LoxMethod *, LoxStringHash> methods = {};
+    for (auto method : class_decl.methods) {
+        methods[method->name->literal.as<LoxString>()] =
+            make_closure<LoxMethod>(*method, class_env);
+    }
 
-    env->add_identifier(class_decl.name->lexeme, lox_class);
+    auto lox_class =
+        Heap::alloc<LoxClass>(std::string(class_decl.name->lexeme),
+                              superclass, methods);
+    if (cell != nullptr) {
+        cell->value = lox_class;
+    } else {
+        env->define_identifier(class_decl.slot, lox_class);
+    }
 }
 
-std::shared_ptr<LoxClass>
-AstInterpreter::cast_expr_val_to_lox_class(ExprVal &expr_val) {
-    try {
-        auto lox_callable = std::get<std::shared_ptr<LoxCallable>>(expr_val);
-        auto superclass = std::dynamic_pointer_cast<LoxClass>(lox_callable);
-        if (superclass) {
-            return superclass;
-        }
-    } catch (std::bad_variant_access &) {
+LoxClass *AstInterpreter::cast_expr_val_to_lox_class(const ExprVal &expr_val) {
+    if (!expr_val.is_callable()) {
         return nullptr;
     }
-
-    return nullptr;
+    return dynamic_cast<LoxClass *>(expr_val.as<LoxCallable>());
 }
 
 void AstInterpreter::visit_block_stmt(const BlockStmt &block_stmt,
-                                      std::shared_ptr<Environment> block_env) {
-    auto enclosing_env = env;
-    if (block_env == nullptr) {
-        block_env = std::make_shared<Environment>(enclosing_env);
+                                      Environment *block_env) {
+    // The env of a function body is released by LoxFunction::run_body, a
+    // block declaring nothing runs in the current env
+    bool is_block_env = block_env == nullptr && block_stmt.slot_num != 0;
+    if (is_block_env) {
+        block_env = acquire_frame(env, block_stmt.slot_num);
     }
 
-    env = block_env;
-    try {
-        for (auto stmt : block_stmt.stmts) {
-            stmt->accept(*this);
-        }
-        // The most convenient way to jump out from a stack of function call is
-        // throwing exception.
-    } catch (BreakKwException &b) {
-        env = enclosing_env;
-        throw b;
-    } catch (ContinueKwException &c) {
-        if (block_stmt.for_loop_increment) {
-            block_stmt.for_loop_increment->accept(*this);
+    if (block_env != nullptr) {
+        env_stack.push_back(env);
+        env = block_env;
+    }
+    for (const auto &stmt : block_stmt.stmts) {
+        // Every live value is reachable from the roots between 2 stmts
+        Heap::collect_if_needed();
+        stmt->accept(*this);
+        // Skip the rest of the block, the enclosing loop or func handles it
+        if (completion != Completion::NORMAL) {
+            break;
         }
-        env = enclosing_env;
-        throw c;
-    } catch (ReturnKwException &r) {
-        env = enclosing_env;
-        throw r;
     }
-    env = enclosing_env;
+    // continue skips the rest of the for loop body but not its increment
+    if (completion == Completion::CONTINUE && block_stmt.for_loop_increment) {
+        block_stmt.for_loop_increment->accept(*this);
+    }
+    if (block_env != nullptr) {
+        env = env_stack.back();
+        env_stack.pop_back();
+    }
+    if (is_block_env) {
+        release_frame(block_env);
+    }
+}
+
+void AstInterpreter::visit_import_stmt(const ImportStmt &import_stmt) {
+    const Module &module = *import_stmt.module;
+    Environment *module_env = run_module(module);
+    for (size_t i = 0; i < import_stmt.slots.size(); ++i) {
+        env->define_identifier(
+            import_stmt.slots[i],
+            module_env->get_identifier(module.exports[i].slot));
+    }
+}
+
+// Run the module on its first import, its env is nested in the global env
+// which holds the builtins
+Environment *AstInterpreter::run_module(const Module &module) {
+    auto it = module_envs.find(&module);
+    if (it != module_envs.end()) {
+        return it->second;
+    }
+    auto module_env =
+        Heap::alloc<Environment>(global_env, module.slot_num, UNDEFINED);
+    module_envs[&module] = module_env;
+
+    // The AST of a module is owned by the ModuleLoader
+    std::shared_ptr<const void> importer_ast_owner = std::move(ast_owner);
+    ast_owner = nullptr;
+    env_stack.push_back(env);
+    env = module_env;
+    Environment *importer_top_level_env =
+        std::exchange(top_level_env, module_env);
+    for (const auto &stmt : module.stmts) {
+        Heap::collect_if_needed();
+        stmt->accept(*this);
+    }
+    top_level_env = importer_top_level_env;
+    env = env_stack.back();
+    env_stack.pop_back();
+    ast_owner = std::move(importer_ast_owner);
+    return module_env;
 }
 
 void AstInterpreter::visit_return_stmt(const ReturnStmt &return_stmt) {
-    ExprVal return_val = NIL;
+    return_val = NIL;
     if (return_stmt.expr != nullptr) {
+        is_tail_call = return_stmt.is_tail_call;
         return_val = evaluate_expr(*return_stmt.expr);
     }
 
-    throw ReturnKwException(return_val);
+    completion = tail_function != nullptr ? Completion::TAIL_CALL
+                                          : Completion::RETURN;
 }
 
 void AstInterpreter::visit_set_class_field(
     const SetClassFieldStmt &set_class_field_stmt) {
-    std::shared_ptr<LoxInstance> lox_instance = nullptr;
-    try {
-        lox_instance = std::get<std::shared_ptr<LoxInstance>>(
-            set_class_field_stmt.lox_instance->accept(*this));
-    } catch (std::bad_variant_access) {
+    ExprVal lox_instance = set_class_field_stmt.lox_instance->accept(*this);
+    if (!lox_instance.is_instance()) {
         throw RuntimeException(set_class_field_stmt.field_token,
                                "Can only call property of a lox instance.");
     }
 
+    value_stack.push_back(lox_instance);
     ExprVal value = evaluate_expr(*set_class_field_stmt.value);
-    lox_instance->props[set_class_field_stmt.field_token->lexeme] = value;
+    value_stack.pop_back();
+    lox_instance.as<LoxInstance>()->set_prop(
+        set_class_field_stmt.field_token->literal.as<LoxString>(), value,
+        set_class_field_stmt.cache);
 }
 
 ExprVal
 AstInterpreter::visit_identifier(const IdentifierExpr &identifier_expr) {
-    int depth = get_identifier_depth(identifier_expr);
-    return move_up_env(depth)->get_identifier(identifier_expr.token->lexeme,
-                                              identifier_expr.token);
+    return lookup_identifier(identifier_expr);
 }
 
 ExprVal AstInterpreter::visit_this(const ThisExpr &this_expr) {
-    int depth = get_identifier_depth(this_expr);
-    return move_up_env(depth)->get_identifier("this", this_expr.token);
+    return lookup_identifier(this_expr);
 }
 
 ExprVal AstInterpreter::visit_super(const SuperExpr &super_expr) {
-    int depth = get_identifier_depth(super_expr);
-
-    // Find super class of current class
-    ExprVal superclass_expr_val =
-        move_up_env(depth)->get_identifier("super", super_expr.token);
-    std::shared_ptr<LoxClass> superclass =
-        cast_expr_val_to_lox_class(superclass_expr_val);
+    // "super" is captured by the methods of the class, "this" is in the env
+    // of the method call or captured by a closure nested in the method
+    ExprVal superclass_expr_val = lookup_identifier(super_expr);
+    LoxClass *superclass = cast_expr_val_to_lox_class(superclass_expr_val);
     if (!superclass) {
         throw RuntimeException(super_expr.token,
                                "Super can only be used in a subclass.");
     }
 
-    // Find LoxInstance super refer to. "this" and "super" both stored in the
-    // class_env.
-    ExprVal lox_instance_expr_val =
-        move_up_env(depth)->get_identifier("this", super_expr.token);
-    auto lox_instance =
-        std::get<std::shared_ptr<LoxInstance>>(lox_instance_expr_val);
+    // Find LoxInstance super refer to.
+    ExprVal lox_instance_expr_val = *find_identifier(
+        super_expr.this_depth, super_expr.this_slot, false);
+    auto lox_instance = lox_instance_expr_val.as<LoxInstance>();
 
     // Find method invoked by super
-    auto method = superclass->get_method(super_expr.method->token->lexeme);
+    auto method = superclass->get_method(
+        super_expr.method->token->literal.as<LoxString>());
     if (!method) {
-        throw RuntimeException(super_expr.method->token,
-                               "Superclass does not have method " +
-                                   super_expr.method->token->lexeme);
+        throw RuntimeException(
+            super_expr.method->token,
+            "Superclass does not have method " +
+                std::string(super_expr.method->token->lexeme));
     }
-    method->bind_this_kw_to_class_method(*lox_instance);
 
-    return method;
+    return Heap::alloc<LoxBoundMethod>(lox_instance, method);
 }
 
 ExprVal AstInterpreter::visit_literal(const LiteralExpr &literal_expr) {
@@ -284,14 +421,53 @@ ExprVal AstInterpreter::visit_grouping(const GroupExpr &group_expr) {
 }
 
 ExprVal AstInterpreter::visit_func_call(const FuncCallExpr &func_call_expr) {
+    // Only the call of the tail return is a tail call, not the calls
+    // evaluating its callee and args
+    bool is_tail_call = std::exchange(this->is_tail_call, false);
+    if (func_call_expr.method_callee != nullptr) {
+        return invoke_method(func_call_expr, *func_call_expr.method_callee,
+                             is_tail_call);
+    }
+
     ExprVal callee = evaluate_expr(*func_call_expr.callee);
+    return call_value(func_call_expr, callee, is_tail_call);
+}
+
+ExprVal AstInterpreter::invoke_method(const FuncCallExpr &func_call_expr,
+                                      const GetClassFieldExpr &callee,
+                                      bool is_tail_call) {
+    ExprVal receiver = evaluate_expr(*callee.lox_instance);
+    if (!receiver.is_instance()) {
+        throw RuntimeException(callee.field_token,
+                               "Can only call property of a lox instance.");
+    }
+
+    // A prop may hold a callable
+    auto lox_instance = receiver.as<LoxInstance>();
+    int slot = lox_instance->find_prop_slot(
+        callee.field_token->literal.as<LoxString>(), callee.cache);
+    if (slot != -1) {
+        return call_value(func_call_expr, lox_instance->fields[slot],
+                          is_tail_call);
+    }
+
+    return call(func_call_expr, lox_instance->get_method(callee.field_token),
+                lox_instance, is_tail_call);
+}
 
-    if (!std::holds_alternative<std::shared_ptr<LoxCallable>>(callee)) {
+ExprVal AstInterpreter::call_value(const FuncCallExpr &func_call_expr,
+                                   const ExprVal &callee, bool is_tail_call) {
+    if (!callee.is_callable()) {
         throw RuntimeException(func_call_expr.func_token,
                                "Can only call functions and class's method.");
     }
+    return call(func_call_expr, callee.as<LoxCallable>(), nullptr,
+                is_tail_call);
+}
 
-    auto func = std::get<std::shared_ptr<LoxCallable>>(callee);
+ExprVal AstInterpreter::call(const FuncCallExpr &func_call_expr,
+                             LoxCallable *func, LoxInstance *receiver,
+                             bool is_tail_call) {
     uint param_num = func->get_param_num();
     // Check func number of params = number of args passed to it.
     if (param_num != func_call_expr.args.size() &&
@@ -303,13 +479,55 @@ ExprVal AstInterpreter::visit_func_call(const FuncCallExpr &func_call_expr) {
                 std::to_string(func_call_expr.args.size()));
     }
 
+    // The callee and the evaluated args stay on the value stack until the
+    // call returns
+    size_t stack_base = value_stack.size();
+    value_stack.push_back(func);
+    if (receiver != nullptr) {
+        value_stack.push_back(receiver);
+    }
+
+    // A Lox function takes its args straight in the param slots of the env
+    // of the call, the other callables in a vector
+    LoxFunction *function = func->as_lox_function();
+    Environment *func_env = nullptr;
     std::vector<ExprVal> arg_vals{};
-    for (auto arg : func_call_expr.args) {
-        arg_vals.push_back(evaluate_expr(*arg));
+    if (function != nullptr) {
+        func_env = function->make_func_env(*this);
+        value_stack.push_back(func_env);
+        if (receiver != nullptr) {
+            func_env->define_identifier(THIS_SLOT, receiver);
+        }
+        for (uint i = 0; i < func_call_expr.args.size(); ++i) {
+            function->bind_arg(func_env, i,
+                               evaluate_expr(*func_call_expr.args[i]));
+        }
+    } else {
+        for (auto arg : func_call_expr.args) {
+            arg_vals.push_back(evaluate_expr(*arg));
+            value_stack.push_back(arg_vals.back());
+        }
+    }
+
+    if (is_tail_call && function != nullptr) {
+        tail_function = function;
+        tail_env = func_env;
+        value_stack.resize(stack_base);
+        return NIL;
     }
 
     try {
-        return func->invoke(*this, arg_vals);
+        ExprVal result;
+        if (function != nullptr) {
+            result = function->run_body(*this, func_env);
+        } else if (receiver != nullptr) {
+            result = static_cast<LoxMethod *>(func)->call(*this, *receiver,
+                                                          arg_vals);
+        } else {
+            result = func->invoke(*this, arg_vals);
+        }
+        value_stack.resize(stack_base);
+        return result;
     } catch (RuntimeException &runtime_err) {
         throw RuntimeException(func_call_expr.func_token,
                                runtime_err.get_message());
@@ -317,16 +535,14 @@ ExprVal AstInterpreter::visit_func_call(const FuncCallExpr &func_call_expr) {
 }
 
 ExprVal AstInterpreter::visit_get_class_field(const GetClassFieldExpr &expr) {
-    std::shared_ptr<LoxInstance> lox_instance = nullptr;
-    try {
-        lox_instance = std::get<std::shared_ptr<LoxInstance>>(
-            expr.lox_instance->accept(*this));
-    } catch (std::bad_variant_access) {
+    ExprVal lox_instance = expr.lox_instance->accept(*this);
+    if (!lox_instance.is_instance()) {
         throw RuntimeException(expr.field_token,
                                "Can only call property of a lox instance.");
     }
 
-    return lox_instance->get_field(expr.field_token);
+    return lox_instance.as<LoxInstance>()->get_field(expr.field_token,
+                                                     expr.cache);
 }
 
 ExprVal AstInterpreter::visit_unary(const UnaryExpr &unary_expr) {
@@ -337,7 +553,7 @@ ExprVal AstInterpreter::visit_unary(const UnaryExpr &unary_expr) {
         return !cast_expr_val_to_bool(right);
     case TokenType::MINUS:
         assert_expr_val_number(unary_expr.operation, right);
-        return -std::get<double>(right);
+        return -right.as_number();
     default:
         throw RuntimeException(unary_expr.operation,
                                "Invalid unary expression");
@@ -345,80 +561,196 @@ ExprVal AstInterpreter::visit_unary(const UnaryExpr &unary_expr) {
     }
 }
 
+/*
+A site which has only seen numbers (or strings) skips the type dispatch of the
+generic path, the types are guarded once. When the guard fails, the site is
+deoptimized: it runs the generic path from then on.
+*/
 ExprVal AstInterpreter::visit_binary(const BinaryExpr &binary_expr) {
     ExprVal left = evaluate_expr(*binary_expr.left_operand);
+    value_stack.push_back(left);
     ExprVal right = evaluate_expr(*binary_expr.right_operand);
+    value_stack.pop_back();
 
-    auto left_double_ptr = std::get_if<double>(&left);
-    auto right_double_ptr = std::get_if<double>(&right);
-    auto left_string_ptr = std::get_if<std::string>(&left);
-    auto right_string_ptr = std::get_if<std::string>(&right);
+    switch (binary_expr.specialization) {
+    case BinarySpecialization::NUMBERS:
+        if (left.is_number() && right.is_number()) {
+            return binary_numbers(binary_expr, left.as_number(),
+                                  right.as_number());
+        }
+        break;
+    case BinarySpecialization::STRINGS:
+        if (left.is_string() && right.is_string()) {
+            return binary_strings(binary_expr, left, right);
+        }
+        break;
+    case BinarySpecialization::UNINITIALIZED:
+        specialize(binary_expr, left, right);
+        return binary_generic(binary_expr, left, right);
+    case BinarySpecialization::GENERIC:
+        return binary_generic(binary_expr, left, right);
+    }
+    binary_expr.specialization = BinarySpecialization::GENERIC;
+    return binary_generic(binary_expr, left, right);
+}
+
+// Only the operations whose generic path depends on the operand types are
+// specialized
+void AstInterpreter::specialize(const BinaryExpr &binary_expr,
+                                const ExprVal &left, const ExprVal &right) {
+    binary_expr.specialization = BinarySpecialization::GENERIC;
+    switch (binary_expr.operation->type) {
+    case TokenType::AND:
+    case TokenType::OR:
+        return;
+    case TokenType::MINUS:
+    case TokenType::STAR:
+    case TokenType::SLASH:
+    case TokenType::MOD:
+        if (left.is_number() && right.is_number()) {
+            binary_expr.specialization = BinarySpecialization::NUMBERS;
+        }
+        return;
+    default:
+        if (left.is_number() && right.is_number()) {
+            binary_expr.specialization = BinarySpecialization::NUMBERS;
+        } else if (left.is_string() && right.is_string()) {
+            binary_expr.specialization = BinarySpecialization::STRINGS;
+        }
+    }
+}
+
+ExprVal AstInterpreter::binary_numbers(const BinaryExpr &binary_expr,
+                                       double left, double right) {
+    switch (binary_expr.operation->type) {
+    case TokenType::PLUS:
+        return left + right;
+    case TokenType::MINUS:
+        return left - right;
+    case TokenType::STAR:
+        return left * right;
+    case TokenType::SLASH:
+        if (right == 0) {
+            throw RuntimeException(binary_expr.operation, "Devide by 0");
+        }
+        return left / right;
+    case TokenType::GREATER:
+        return left > right;
+    case TokenType::LESS:
+        return left < right;
+    case TokenType::GREATER_EQUAL:
+        return left >= right;
+    case TokenType::LESS_EQUAL:
+        return left <= right;
+    case TokenType::BANG_EQUAL:
+        return left != right;
+    case TokenType::EQUAL_EQUAL:
+        return left == right;
+    default:
+        // MOD checks its operands are ints
+        return binary_generic(binary_expr, left, right);
+    }
+}
+
+ExprVal AstInterpreter::binary_strings(const BinaryExpr &binary_expr,
+                                       const ExprVal &left,
+                                       const ExprVal &right) {
+    switch (binary_expr.operation->type) {
+    case TokenType::PLUS:
+        return Heap::make_string(left.as_string() + right.as_string());
+    case TokenType::GREATER:
+        return left.as_string() > right.as_string();
+    case TokenType::LESS:
+        return left.as_string() < right.as_string();
+    case TokenType::GREATER_EQUAL:
+        return left.as_string() >= right.as_string();
+    case TokenType::LESS_EQUAL:
+        return left.as_string() <= right.as_string();
+    // Strings are interned
+    case TokenType::BANG_EQUAL:
+        return left != right;
+    case TokenType::EQUAL_EQUAL:
+        return left == right;
+    default:
+        return binary_generic(binary_expr, left, right);
+    }
+}
+
+ExprVal AstInterpreter::binary_generic(const BinaryExpr &binary_expr,
+                                       const ExprVal &left,
+                                       const ExprVal &right) {
+    bool is_left_number = left.is_number();
+    bool is_right_number = right.is_number();
+    bool is_left_string = left.is_string();
+    bool is_right_string = right.is_string();
 
     switch (binary_expr.operation->type) {
     // Special case: + op can be used to concate 2 strings
     case TokenType::PLUS:
-        if (left_double_ptr && right_double_ptr) {
-            return *left_double_ptr + *right_double_ptr;
+        if (is_left_number && is_right_number) {
+            return left.as_number() + right.as_number();
         }
-        if (left_string_ptr && right_string_ptr) {
-            return *left_string_ptr + *right_string_ptr;
+        if (is_left_string && is_right_string) {
+            return Heap::make_string(left.as_string() + right.as_string());
         }
-        if (left_double_ptr && right_string_ptr) {
-            return double_to_string(*left_double_ptr) + *right_string_ptr;
+        if (is_left_number && is_right_string) {
+            return Heap::make_string(double_to_string(left.as_number()) +
+                                     right.as_string());
         }
-        if (left_string_ptr && right_double_ptr) {
-            return *left_string_ptr + double_to_string(*right_double_ptr);
+        if (is_left_string && is_right_number) {
+            return Heap::make_string(left.as_string() +
+                                     double_to_string(right.as_number()));
         }
         throw RuntimeException(binary_expr.operation,
                                "Operands must be number or string");
     case TokenType::MINUS:
         assert_expr_vals_number(binary_expr.operation, left, right);
-        return *left_double_ptr - *right_double_ptr;
+        return left.as_number() - right.as_number();
     case TokenType::STAR:
         assert_expr_vals_number(binary_expr.operation, left, right);
-        return *left_double_ptr * *right_double_ptr;
+        return left.as_number() * right.as_number();
     case TokenType::MOD:
         assert_expr_vals_int(binary_expr.operation, left, right);
-        return double(int(*left_double_ptr) % int(*right_double_ptr));
+        return double(int(left.as_number()) % int(right.as_number()));
     case TokenType::SLASH:
         assert_expr_vals_number(binary_expr.operation, left, right);
-        if (*right_double_ptr == 0) {
+        if (right.as_number() == 0) {
             throw RuntimeException(binary_expr.operation, "Devide by 0");
         }
-        return *left_double_ptr / *right_double_ptr;
+        return left.as_number() / right.as_number();
     case TokenType::GREATER:
-        if (left_double_ptr && right_double_ptr) {
-            return *left_double_ptr > *right_double_ptr;
+        if (is_left_number && is_right_number) {
+            return left.as_number() > right.as_number();
         }
-        if (left_string_ptr && right_string_ptr) {
-            return *left_string_ptr > *right_string_ptr;
+        if (is_left_string && is_right_string) {
+            return left.as_string() > right.as_string();
         }
         throw RuntimeException(binary_expr.operation,
                                "Expected compare 2 numbers or 2 strings");
     case TokenType::LESS:
-        if (left_double_ptr && right_double_ptr) {
-            return *left_double_ptr < *right_double_ptr;
+        if (is_left_number && is_right_number) {
+            return left.as_number() < right.as_number();
         }
-        if (left_string_ptr && right_string_ptr) {
-            return *left_string_ptr < *right_string_ptr;
+        if (is_left_string && is_right_string) {
+            return left.as_string() < right.as_string();
         }
         throw RuntimeException(binary_expr.operation,
                                "Expected compare 2 numbers or 2 strings");
     case TokenType::GREATER_EQUAL:
-        if (left_double_ptr && right_double_ptr) {
-            return *left_double_ptr >= *right_double_ptr;
+        if (is_left_number && is_right_number) {
+            return left.as_number() >= right.as_number();
         }
-        if (left_string_ptr && right_string_ptr) {
-            return *left_string_ptr >= *right_string_ptr;
+        if (is_left_string && is_right_string) {
+            return left.as_string() >= right.as_string();
         }
         throw RuntimeException(binary_expr.operation,
                                "Expected compare 2 numbers or 2 strings");
     case TokenType::LESS_EQUAL:
-        if (left_double_ptr && right_double_ptr) {
-            return *left_double_ptr <= *right_double_ptr;
+        if (is_left_number && is_right_number) {
+            return left.as_number() <= right.as_number();
         }
-        if (left_string_ptr && right_string_ptr) {
-            return *left_string_ptr <= *right_string_ptr;
+        if (is_left_string && is_right_string) {
+            return left.as_string() <= right.as_string();
         }
         throw RuntimeException(binary_expr.operation,
                                "Expected compare 2 numbers or 2 strings");
@@ -445,25 +777,58 @@ ExprVal AstInterpreter::visit_binary(const BinaryExpr &binary_expr) {
     }
 }
 
-void AstInterpreter::update_identifier_scope_depth_map(
-    const IdentifierExpr &identifier_expr, int depth) {
-    identifier_scope_depth_map[&identifier_expr] = depth;
+ExprVal &
+AstInterpreter::lookup_identifier(const IdentifierExpr &identifier_expr) {
+    ExprVal *value = find_identifier(
+        identifier_expr.depth, identifier_expr.slot, identifier_expr.is_cell);
+    if (value == nullptr) {
+        throw RuntimeException(identifier_expr.token,
+                               "Reference to non-exist identifier: " +
+                                   std::string(identifier_expr.token->lexeme));
+    }
+    return *value;
 }
 
-uint AstInterpreter::get_identifier_depth(
-    const IdentifierExpr &identifier_expr) {
-    const IdentifierExpr *ptr = &identifier_expr;
-    if (identifier_scope_depth_map.count(ptr) == 0) {
-        throw RuntimeException(ptr->token,
-                               "Reference to non-exist identifier: " +
-                                   ptr->token->lexeme);
+ExprVal *AstInterpreter::find_identifier(int depth, uint slot,
+                                         bool is_cell) {
+    ExprVal *value = nullptr;
+    if (depth == GLOBAL_DEPTH) {
+        value = &global_env->get_identifier(slot);
+    } else if (depth == UPVALUE_DEPTH) {
+        value = &closure->upvalues[slot];
+    } else if (depth != UNRESOLVED_DEPTH) {
+        value = &move_up_env(depth)->get_identifier(slot);
     }
+    if (value != nullptr && is_cell) {
+        value = &value->as<Cell>()->value;
+    }
+    if (value == nullptr || value->is_undefined()) {
+        return nullptr;
+    }
+    return value;
+}
 
-    return identifier_scope_depth_map[ptr];
+Environment *AstInterpreter::acquire_frame(Environment *parent_env,
+                                           uint slot_num) {
+    if (frame_pool.empty()) {
+        return Heap::alloc<Environment>(parent_env, slot_num);
+    }
+    Environment *frame = frame_pool.back();
+    frame_pool.pop_back();
+    frame->reset(parent_env, slot_num);
+    return frame;
+}
+
+void AstInterpreter::release_frame(Environment *frame) {
+    if (frame_pool.size() == FRAME_POOL_MAX) {
+        return;
+    }
+    frame->clear();
+    frame_pool.push_back(frame);
 }
 
-std::shared_ptr<Environment> AstInterpreter::move_up_env(int depth) {
-    auto env = this->env;
+Environment *AstInterpreter::move_up_env(int depth) {
+    Environment *env = this->env;
     for (int i = 0; i < depth; ++i) {
         env = env->parent_scope_env;
     }
@@ -1,16 +1,65 @@
 #pragma once
 #include "clox/ast_interpreter/environment.hpp"
+#include "clox/common/heap.hpp"
 #include "clox/parser/expr.hpp"
 #include "clox/parser/stmt.hpp"
 #include <memory>
 #include <unordered_map>
 
-class AstInterpreter : public IExprVisitor, public IStmtVisitor {
+class LoxCallable;
+class LoxFunction;
+class LoxClass;
+class LoxInstance;
+
+// How the last executed stmt completed. break/continue/return stop the
+// enclosing blocks until the loop or function handling them is reached.
+enum class Completion {
+    NORMAL,
+    BREAK,
+    CONTINUE,
+    RETURN,
+    // A return whose call is left to the returning function, see tail_call
+    TAIL_CALL,
+};
+
+class AstInterpreter : public IExprVisitor,
+                       public IStmtVisitor,
+                       public IGcRoots {
   private:
-    std::shared_ptr<Environment> env = nullptr;
-    std::unordered_map<const IdentifierExpr *, int> identifier_scope_depth_map =
-        {};
-    const std::shared_ptr<Environment> global_env = nullptr;
+    Environment *env = nullptr;
+    Environment *const global_env = nullptr;
+    // Env of the program or module being run, the env of a call is nested
+    // in the top level env of the function
+    Environment *top_level_env = nullptr;
+    // Function whose body is being run, its upvalues are read by the
+    // identifiers resolved to UPVALUE_DEPTH
+    LoxFunction *closure = nullptr;
+    // Envs of the enclosing blocks and callers, saved while a nested block or
+    // a function body is executed.
+    std::vector<Environment *> env_stack = {};
+    // Intermediate values held by the visitors while a sub expression or a
+    // call is evaluated (left operand, callee and args...), they are GC roots.
+    std::vector<ExprVal> value_stack = {};
+    // Slot of each global identifier in global_env, shared with the resolver
+    std::unordered_map<std::string, uint> global_slots = {};
+    // Env of each module run by the interpreter, a module runs once
+    std::unordered_map<const Module *, Environment *> module_envs = {};
+
+    // Envs of the exited calls and blocks, reused by the next ones instead of
+    // allocating new envs
+    std::vector<Environment *> frame_pool = {};
+
+    Completion completion = Completion::NORMAL;
+    // Value of the last executed return stmt
+    ExprVal return_val = NIL;
+    // Set by a tail return for the call it evaluates. The callee and the env
+    // of the call are then run by LoxFunction::run_body in place of the
+    // returning function instead of in a nested call.
+    bool is_tail_call = false;
+    LoxFunction *tail_function = nullptr;
+    Environment *tail_env = nullptr;
+
+    void define_global(const std::string &name, const ExprVal &value);
 
     ExprVal evaluate_expr(Expr &expr);
 
@@ -22,7 +71,7 @@ class AstInterpreter : public IExprVisitor, public IStmtVisitor {
 
     void
     visit_block_stmt(const BlockStmt &,
-                     std::shared_ptr<Environment> block_env = nullptr) override;
+                     Environment *block_env = nullptr) override;
 
     void visit_if_stmt(const IfStmt &) override;
 
@@ -33,6 +82,10 @@ class AstInterpreter : public IExprVisitor, public IStmtVisitor {
     void visit_continue_stmt(const ContinueStmt &) override;
 
     void visit_function_decl(FunctionDecl &) override;
+    // Create the closure of a function declared in decl_env, capturing its
+    // upvalues
+    template <typename T>
+    T *make_closure(FunctionDecl &func_decl, Environment *decl_env);
 
     void visit_class_decl(const ClassDecl &) override;
 
@@ -40,13 +93,17 @@ class AstInterpreter : public IExprVisitor, public IStmtVisitor {
 
     void visit_set_class_field(const SetClassFieldStmt &) override;
 
+    void visit_import_stmt(const ImportStmt &) override;
+
+    Environment *run_module(const Module &module);
+
     ExprVal visit_identifier(const IdentifierExpr &) override;
 
     ExprVal visit_this(const ThisExpr &) override;
 
     ExprVal visit_super(const SuperExpr &) override;
 
-    std::shared_ptr<LoxClass> cast_expr_val_to_lox_class(ExprVal &);
+    LoxClass *cast_expr_val_to_lox_class(const ExprVal &);
 
     ExprVal visit_literal(const LiteralExpr &) override;
 
@@ -54,27 +111,63 @@ class AstInterpreter : public IExprVisitor, public IStmtVisitor {
 
     ExprVal visit_func_call(const FuncCallExpr &) override;
 
+    // obj.method(args) calls the method with obj as receiver without creating
+    // a bound method.
+    ExprVal invoke_method(const FuncCallExpr &, const GetClassFieldExpr &,
+                          bool is_tail_call);
+    ExprVal call_value(const FuncCallExpr &, const ExprVal &callee,
+                       bool is_tail_call);
+    // Check the arity, evaluate the args then call func, which must be a
+    // LoxMethod when a receiver is given. A tail call of a Lox function only
+    // sets tail_function and tail_env.
+    ExprVal call(const FuncCallExpr &, LoxCallable *func,
+                 LoxInstance *receiver, bool is_tail_call);
+
     ExprVal visit_get_class_field(const GetClassFieldExpr &) override;
 
     ExprVal visit_unary(const UnaryExpr &) override;
 
     ExprVal visit_binary(const BinaryExpr &) override;
-
-    // Use with Resolver class to resolve in which scope an identifier (var or
-    // func) is defined
-    void update_identifier_scope_depth_map(const IdentifierExpr &, int depth);
-    uint get_identifier_depth(const IdentifierExpr &);
-    std::shared_ptr<Environment> move_up_env(int depth);
+    // Specialized paths of visit_binary, they assume the operand types
+    ExprVal binary_numbers(const BinaryExpr &, double left, double right);
+    ExprVal binary_strings(const BinaryExpr &, const ExprVal &left,
+                           const ExprVal &right);
+    ExprVal binary_generic(const BinaryExpr &, const ExprVal &left,
+                           const ExprVal &right);
+    void specialize(const BinaryExpr &, const ExprVal &left,
+                    const ExprVal &right);
+
+    Environment *acquire_frame(Environment *parent_env, uint slot_num);
+    // Recycle the env of an exited call or block
+    void release_frame(Environment *frame);
+
+    // Use the scope depth and slot resolved by the Resolver class to find the
+    // value of an identifier (var or func)
+    ExprVal &lookup_identifier(const IdentifierExpr &);
+    // Return the value at depth and slot, nullptr when it is undefined
+    ExprVal *find_identifier(int depth, uint slot, bool is_cell);
+    Environment *move_up_env(int depth);
 
   public:
     const bool is_interactive_mode;
+    // The natives, defined in the first global slots
+    uint builtin_num = 0;
+    // Owner of the AST being interpreted, the functions it declares keep it
+    // alive so that it can be released once they are collected
+    std::shared_ptr<const void> ast_owner = nullptr;
 
     AstInterpreter(const bool is_interactive_mode);
+    ~AstInterpreter();
 
     ExprVal interpret_single_expr(Expr &expression);
 
-    void interpret_program(const std::vector<std::shared_ptr<Stmt>> &stmts);
+    void interpret_program(const std::vector<Stmt *> &stmts);
+
+    void mark_roots() override;
 
     friend class LoxFunction;
+    friend class LoxClass;
     friend class IdentifierResolver;
+    friend class AstCache;
+    friend class AstOptimizer;
 };
\ No newline at end of file
@@ -2,57 +2,129 @@
 #include "clox/ast_interpreter/ast_interpreter.hpp"
 #include "clox/ast_interpreter/environment.hpp"
 #include "clox/common/constants.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/common/lox_object.hpp"
 #include "clox/parser/stmt.hpp"
 
 #include <memory>
 #include <string>
 #include <sys/types.h>
+#include <utility>
 #include <vector>
 
-class LoxCallable {
+class LoxCallable : public LoxObject {
   public:
+    LoxCallable() : LoxObject(ObjectType::CALLABLE) {}
+
     virtual uint get_param_num() { return 0; }
 
     virtual ExprVal invoke(AstInterpreter &interpreter,
                            std::vector<ExprVal> &args) = 0;
 
-    virtual std::string to_string() const = 0;
+    // Lox functions can be called without an args vector, see
+    // AstInterpreter::call
+    virtual LoxFunction *as_lox_function() { return nullptr; }
 };
 
 class LoxFunction : public LoxCallable {
   protected:
-    std::shared_ptr<FunctionDecl> func_stmt;
-    // Can be global env or the env of the outer func defined this func
-    std::shared_ptr<Environment> enclosing_env;
+    FunctionDecl *func_stmt;
+    // Global env or the env of the module declaring the func, the env of a
+    // call is nested in it
+    Environment *top_level_env;
+    // Keep the AST of func_stmt alive, see AstInterpreter::ast_owner
+    std::shared_ptr<const void> ast_owner;
+
+    Environment *make_func_env(AstInterpreter &interpreter,
+                               std::vector<ExprVal> &args) {
+        auto func_env = make_func_env(interpreter);
+        for (size_t i = 0; i < func_stmt->params.size(); ++i) {
+            bind_arg(func_env, i, args[i]);
+        }
+        return func_env;
+    }
 
   public:
-    LoxFunction(std::shared_ptr<FunctionDecl> func_stmt,
-                std::shared_ptr<Environment> enclosing_env)
-        : func_stmt(func_stmt), enclosing_env(enclosing_env) {}
+    // Variables captured by the closure, see FunctionDecl::captures. A
+    // captured variable is a Cell, "this" and "super" are captured by value.
+    std::vector<ExprVal> upvalues = {};
+
+    LoxFunction(FunctionDecl *func_stmt, Environment *top_level_env,
+                std::shared_ptr<const void> ast_owner = nullptr)
+        : func_stmt(func_stmt), top_level_env(top_level_env),
+          ast_owner(std::move(ast_owner)) {}
 
     uint get_param_num() override { return func_stmt->params.size(); }
 
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        // Each time a func is invoked an env should be created to save var
-        // defined in the func scope
-        auto func_env = std::make_shared<Environment>(enclosing_env);
-        for (int i = 0; i < func_stmt->params.size(); ++i) {
-            func_env->add_identifier(func_stmt->params[i]->token->lexeme,
-                                     args[i]);
+    // Bind the arg of the i-th param in the env of a call
+    void bind_arg(Environment *func_env, uint i, const ExprVal &arg) {
+        IdentifierExpr *param = func_stmt->params[i];
+        if (param->is_cell) {
+            func_env->define_identifier(param->slot, Heap::alloc<Cell>(arg));
+        } else {
+            func_env->define_identifier(param->slot, arg);
+        }
+    }
+
+    // Each time a func is invoked an env should be created to save var
+    // defined in the func scope
+    Environment *make_func_env(AstInterpreter &interpreter) {
+        return interpreter.acquire_frame(top_level_env,
+                                         func_stmt->body->slot_num);
+    }
+
+    // Run the body in the env of the call, which is recycled when the call
+    // returns. The tail calls of the body run in this loop, so a chain of
+    // tail calls uses a constant C++ stack.
+    ExprVal run_body(AstInterpreter &interpreter, Environment *func_env) {
+        // Keep the tail called functions alive while they run
+        size_t stack_base = interpreter.value_stack.size();
+        interpreter.value_stack.push_back(this);
+        LoxFunction *caller_closure = interpreter.closure;
+        // The closures created by the body read the top level env of the
+        // function, which may be a module run before
+        Environment *caller_top_level_env = interpreter.top_level_env;
+        LoxFunction *function = this;
+        while (true) {
+            interpreter.closure = function;
+            interpreter.top_level_env = function->top_level_env;
+            interpreter.visit_block_stmt(*function->func_stmt->body, func_env);
+            interpreter.release_frame(func_env);
+            if (interpreter.completion != Completion::TAIL_CALL) {
+                break;
+            }
+            function = std::exchange(interpreter.tail_function, nullptr);
+            func_env = std::exchange(interpreter.tail_env, nullptr);
+            interpreter.value_stack[stack_base] = function;
+            interpreter.completion = Completion::NORMAL;
         }
+        interpreter.value_stack.resize(stack_base);
+        interpreter.closure = caller_closure;
+        interpreter.top_level_env = caller_top_level_env;
 
-        auto block = std::dynamic_pointer_cast<BlockStmt>(func_stmt->body);
-        try {
-            interpreter.visit_block_stmt(*block, func_env);
-        } catch (ReturnKwException r) {
-            return r.return_val;
+        if (interpreter.completion == Completion::RETURN) {
+            interpreter.completion = Completion::NORMAL;
+            return std::move(interpreter.return_val);
         }
 
         return NIL;
     }
 
+    ExprVal invoke(AstInterpreter &interpreter,
+                   std::vector<ExprVal> &args) override {
+        return run_body(interpreter, make_func_env(interpreter, args));
+    }
+
+    LoxFunction *as_lox_function() override { return this; }
+
     std::string to_string() const override {
-        return "<function " + func_stmt->name->lexeme + ">";
+        return "<function " + std::string(func_stmt->name->lexeme) + ">";
+    }
+
+    void trace() override {
+        Heap::mark_object(top_level_env);
+        for (const auto &upvalue : upvalues) {
+            Heap::mark_value(upvalue);
+        }
     }
 };
@@ -2,73 +2,70 @@
 #include "clox/ast_interpreter/callable/callable.hpp"
 #include "clox/common/constants.hpp"
 #include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/common/shape.hpp"
 #include "clox/utils/helper.hpp"
 
 #include <memory>
 #include <sys/types.h>
 
+class LoxInstance;
+
 class LoxMethod : public LoxFunction {
   public:
     using LoxFunction::LoxFunction;
     std::string to_string() const override {
-        return "<method " + func_stmt->name->lexeme + ">";
+        return "<method " + std::string(func_stmt->name->lexeme) + ">";
     }
 
-    void bind_this_kw_to_class_method(LoxInstance &instance) {
-        // Use no-op deleter to make sure that "this" is not deallocate
-        // after shared_ptr run out of scope.
-        this->enclosing_env->update_identifier(
-            "this",
-            std::shared_ptr<LoxInstance>(&instance,
-                                         smart_pointer_no_op_deleter),
-            nullptr);
+    // "this" is stored in the env of each call, so the method is shared by
+    // every instance and can be called re-entrantly.
+    virtual ExprVal call(AstInterpreter &interpreter, LoxInstance &receiver,
+                         std::vector<ExprVal> &args);
+
+    // A method is always called with a receiver, through a LoxBoundMethod or
+    // an obj.method(args) call.
+    ExprVal invoke(AstInterpreter &, std::vector<ExprVal> &) override {
+        throw RuntimeException(nullptr, "Method called without a receiver.");
     }
 };
 
 class LoxClass : public LoxCallable {
   protected:
     std::string name = "";
-    std::shared_ptr<LoxClass> superclass = nullptr;
-    std::unordered_map<std::string, std::shared_ptr<LoxMethod>> methods = {};
+    LoxClass *superclass = nullptr;
+    std::unordered_map<LoxString *, LoxMethod *, LoxStringHash> methods = {};
+    // Cached "init" method, may be inherited
+    LoxMethod *init_method = nullptr;
 
     friend class LoxInstance;
     friend class AstInterpreter;
+    friend class VM;
 
   public:
     LoxClass() {}
     LoxClass(
-        std::string name, std::shared_ptr<LoxClass> superclass,
-        std::unordered_map<std::string, std::shared_ptr<LoxMethod>> &methods)
-        : name(name), superclass(superclass), methods(methods) {}
+        std::string name, LoxClass *superclass,
+        std::unordered_map<LoxString *, LoxMethod *, LoxStringHash> &methods)
+        : name(name), superclass(superclass), methods(methods) {
+        init_method = get_method(Heap::make_string(INIT_METHOD));
+    }
 
     uint get_param_num() override {
-        auto initializer = get_method(INIT_METHOD);
-        if (initializer == nullptr) {
+        if (init_method == nullptr) {
             return 0;
         }
-        return initializer->get_param_num();
+        return init_method->get_param_num();
     }
 
     // Class constructor
     ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        // Allocate memory for new instance
-        auto lox_class_sp =
-            std::shared_ptr<LoxClass>(this, smart_pointer_no_op_deleter);
-        auto lox_instance = std::make_shared<LoxInstance>(lox_class_sp);
-
-        // Run the user-defined initializer if it exists
-        auto initializer = get_method(INIT_METHOD);
-        if (initializer != nullptr) {
-            initializer->bind_this_kw_to_class_method(*lox_instance);
-            initializer->invoke(interpreter, args);
-        }
-        return lox_instance;
-    }
+                   std::vector<ExprVal> &args) override;
 
-    std::shared_ptr<LoxMethod> get_method(std::string name) {
-        if (methods.count(name) > 0) {
-            return methods[name];
+    LoxMethod *get_method(LoxString *name) {
+        auto method = methods.find(name);
+        if (method != methods.end()) {
+            return method->second;
         }
 
         if (superclass != nullptr) {
@@ -79,36 +76,141 @@ class LoxClass : public LoxCallable {
     }
 
     std::string to_string() const override { return "<Class " + name + ">"; }
+
+    void trace() override {
+        Heap::mark_object(superclass);
+        for (const auto &method : methods) {
+            Heap::mark_object(method.first);
+            Heap::mark_object(method.second);
+        }
+    }
 };
 
-class LoxInstance {
+class LoxInstance : public LoxObject {
   private:
-    std::shared_ptr<LoxClass> lox_class;
-    std::unordered_map<std::string, ExprVal> props;
+    LoxClass *lox_class;
+    // Prop values, indexed by the slots of the shape
+    Shape *shape = Shape::root();
+    std::vector<ExprVal> fields = {};
     friend class AstInterpreter;
+    friend class VM;
 
   public:
-    LoxInstance(std::shared_ptr<LoxClass> lox_class) : lox_class(lox_class) {}
+    LoxInstance(LoxClass *lox_class)
+        : LoxObject(ObjectType::INSTANCE), lox_class(lox_class) {}
+
+    // Return the slot of the prop or -1 if the instance doesn't have it
+    int find_prop_slot(LoxString *name, PropertyCache &cache) {
+        auto entry = cache.find(shape);
+        if (entry == nullptr) {
+            entry = cache.add({shape, shape->find_slot(name), shape});
+        }
+        return entry->slot;
+    }
 
-    ExprVal get_field(std::shared_ptr<Token> field_token) {
-        std::string field_name = field_token->lexeme;
-        // Find prop
-        if (props.count(field_name) > 0) {
-            return props[field_name];
+    void set_prop(LoxString *name, const ExprVal &value,
+                  PropertyCache &cache) {
+        auto entry = cache.find(shape);
+        if (entry == nullptr) {
+            int slot = shape->find_slot(name);
+            if (slot != -1) {
+                entry = cache.add({shape, slot, shape});
+            } else {
+                entry = cache.add(
+                    {shape, int(fields.size()), shape->add_prop(name)});
+            }
         }
 
-        // Find method
-        std::shared_ptr<LoxMethod> method = lox_class->get_method(field_name);
-        if (method != nullptr) {
-            method->bind_this_kw_to_class_method(*this);
-            return method;
+        if (entry->next_shape != shape) {
+            shape = entry->next_shape;
+            fields.push_back(value);
+            return;
         }
+        fields[entry->slot] = value;
+    }
 
-        throw RuntimeException(field_token, "Instance field " + field_name +
-                                                " does not exists.");
+    LoxMethod *get_method(const Token *field_token) {
+        LoxMethod *method =
+            lox_class->get_method(field_token->literal.as<LoxString>());
+        if (method == nullptr) {
+            throw RuntimeException(field_token,
+                                   "Instance field " +
+                                       std::string(field_token->lexeme) +
+                                       " does not exists.");
+        }
+        return method;
     }
 
-    virtual std::string to_string() const {
+    // Return the prop or the method bound to this instance
+    ExprVal get_field(const Token *field_token, PropertyCache &cache);
+
+    std::string to_string() const override {
         return "<Instance " + lox_class->name + ">";
     }
+
+    void trace() override {
+        Heap::mark_object(lox_class);
+        for (const auto &field : fields) {
+            Heap::mark_value(field);
+        }
+    }
 };
+
+// Method value created when a method is accessed without being called
+// immediately (var m = obj.method;).
+class LoxBoundMethod : public LoxCallable {
+  public:
+    LoxInstance *receiver;
+    LoxMethod *method;
+
+    LoxBoundMethod(LoxInstance *receiver, LoxMethod *method)
+        : receiver(receiver), method(method) {}
+
+    uint get_param_num() override { return method->get_param_num(); }
+
+    ExprVal invoke(AstInterpreter &interpreter,
+                   std::vector<ExprVal> &args) override {
+        return method->call(interpreter, *receiver, args);
+    }
+
+    std::string to_string() const override { return method->to_string(); }
+
+    void trace() override {
+        Heap::mark_object(receiver);
+        Heap::mark_object(method);
+    }
+};
+
+inline ExprVal LoxMethod::call(AstInterpreter &interpreter,
+                               LoxInstance &receiver,
+                               std::vector<ExprVal> &args) {
+    auto func_env = make_func_env(interpreter, args);
+    func_env->define_identifier(THIS_SLOT, &receiver);
+    return run_body(interpreter, func_env);
+}
+
+inline ExprVal LoxInstance::get_field(const Token *field_token,
+                                      PropertyCache &cache) {
+    // Find prop
+    int slot = find_prop_slot(field_token->literal.as<LoxString>(), cache);
+    if (slot != -1) {
+        return fields[slot];
+    }
+
+    // Find method
+    return Heap::alloc<LoxBoundMethod>(this, get_method(field_token));
+}
+
+inline ExprVal LoxClass::invoke(AstInterpreter &interpreter,
+                                std::vector<ExprVal> &args) {
+    // Allocate memory for new instance
+    auto lox_instance = Heap::alloc<LoxInstance>(this);
+
+    // Run the user-defined initializer if it exists
+    if (init_method != nullptr) {
+        interpreter.value_stack.push_back(lox_instance);
+        init_method->call(interpreter, *lox_instance, args);
+        interpreter.value_stack.pop_back();
+    }
+    return lox_instance;
+}
@@ -3,6 +3,7 @@
 #include "clox/ast_interpreter/environment.hpp"
 #include "clox/ast_interpreter/helper.hpp"
 #include "clox/common/expr_val.hpp"
+#include "clox/common/heap.hpp"
 #include "clox/utils/helper.hpp"
 #include <memory>
 
@@ -24,6 +25,13 @@ class ListInstance : public LoxInstance {
         return res + "]";
     }
 
+    void trace() override {
+        LoxInstance::trace();
+        for (const auto &element : elements) {
+            Heap::mark_value(element);
+        }
+    }
+
     friend class List;
     friend class ListPush;
     friend class ListPop;
@@ -35,34 +43,33 @@ class ListMethod : public LoxMethod {
   public:
     using LoxMethod::LoxMethod;
 
-    std::shared_ptr<ListInstance> get_list_instance() {
-        ExprVal _this = this->enclosing_env->get_identifier("this", nullptr);
-        auto lox_instance = std::get<std::shared_ptr<LoxInstance>>(_this);
-        if (!lox_instance) {
-            throw RuntimeException(nullptr,
-                                   "Can only call List methods on a List "
-                                   "instance.");
-        }
+    // List methods only need the receiver and the args, the VM uses this entry
+    // directly.
+    virtual ExprVal call_on(ListInstance &list_instance,
+                            std::vector<ExprVal> &args) = 0;
 
-        auto list_instance =
-            std::dynamic_pointer_cast<ListInstance>(lox_instance);
+    ExprVal call(AstInterpreter &, LoxInstance &receiver,
+                 std::vector<ExprVal> &args) override {
+        auto list_instance = dynamic_cast<ListInstance *>(&receiver);
         if (!list_instance) {
             throw RuntimeException(nullptr,
                                    "Can only call List methods on a List "
                                    "instance.");
         }
-        return list_instance;
+        return call_on(*list_instance, args);
     }
+
+    // List methods are native, they have no env
+    LoxFunction *as_lox_function() override { return nullptr; }
 };
 
 class ListPush : public ListMethod {
   public:
     using ListMethod::ListMethod;
 
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        std::shared_ptr<ListInstance> list_instance = get_list_instance();
-        list_instance->elements.push_back(args[0]);
+    ExprVal call_on(ListInstance &list_instance,
+                    std::vector<ExprVal> &args) override {
+        list_instance.elements.push_back(args[0]);
         return NIL;
     }
 
@@ -73,14 +80,12 @@ class ListPop : public ListMethod {
   public:
     using ListMethod::ListMethod;
 
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        std::shared_ptr<ListInstance> list_instance = get_list_instance();
-
-        if (list_instance->elements.empty()) {
+    ExprVal call_on(ListInstance &list_instance,
+                    std::vector<ExprVal> &) override {
+        if (list_instance.elements.empty()) {
             throw RuntimeException(nullptr, "Cannot pop from an empty list.");
         }
-        list_instance->elements.pop_back();
+        list_instance.elements.pop_back();
         return NIL;
     }
 
@@ -91,21 +96,19 @@ class ListAt : public ListMethod {
   public:
     using ListMethod::ListMethod;
 
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        std::shared_ptr<ListInstance> list_instance = get_list_instance();
-
-        double index = std::get<double>(args[0]);
-        if (!is_double_int(index)) {
+    ExprVal call_on(ListInstance &list_instance,
+                    std::vector<ExprVal> &args) override {
+        if (!args[0].is_number() || !is_double_int(args[0].as_number())) {
             throw RuntimeException(nullptr,
                                    "Index must be an integer for List access.");
         }
-        if (index < 0 || index >= list_instance->elements.size()) {
+        double index = args[0].as_number();
+        if (index < 0 || index >= list_instance.elements.size()) {
             throw RuntimeException(nullptr,
                                    "Index out of bounds for List access.");
         }
 
-        return list_instance->elements[index];
+        return list_instance.elements[index];
     }
 
     uint get_param_num() override { return 1; }
@@ -115,11 +118,9 @@ class ListSize : public ListMethod {
   public:
     using ListMethod::ListMethod;
 
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        std::shared_ptr<ListInstance> list_instance = get_list_instance();
-
-        return double(list_instance->elements.size());
+    ExprVal call_on(ListInstance &list_instance,
+                    std::vector<ExprVal> &) override {
+        return double(list_instance.elements.size());
     }
 
     uint get_param_num() override { return 0; }
@@ -127,20 +128,25 @@ class ListSize : public ListMethod {
 
 class List : public LoxClass {
   public:
-    List(std::shared_ptr<Environment> class_env) {
+    List() {
         name = "List";
-        methods["push"] = std::make_shared<ListPush>(nullptr, class_env);
-        methods["pop"] = std::make_shared<ListPop>(nullptr, class_env);
-        methods["at"] = std::make_shared<ListAt>(nullptr, class_env);
-        methods["size"] = std::make_shared<ListSize>(nullptr, class_env);
+        add_method("push", Heap::alloc<ListPush>(nullptr, nullptr));
+        add_method("pop", Heap::alloc<ListPop>(nullptr, nullptr));
+        add_method("at", Heap::alloc<ListAt>(nullptr, nullptr));
+        add_method("size", Heap::alloc<ListSize>(nullptr, nullptr));
+    }
+
+    void add_method(const std::string &name, ListMethod *method) {
+        methods[Heap::pin(Heap::make_string(name))] = method;
     }
 
     // Class constructor
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        auto lox_class_sp =
-            std::shared_ptr<LoxClass>(this, smart_pointer_no_op_deleter);
-        auto list_instance = std::make_shared<ListInstance>(lox_class_sp);
+    ExprVal invoke(AstInterpreter &, std::vector<ExprVal> &args) override {
+        return construct(args);
+    }
+
+    ListInstance *construct(std::vector<ExprVal> &args) {
+        auto list_instance = Heap::alloc<ListInstance>(this);
 
         for (auto &arg : args) {
             list_instance->elements.push_back(arg);
@@ -1,13 +1,26 @@
 
+#pragma once
 #include "clox/ast_interpreter/callable/callable.hpp"
 #include "clox/ast_interpreter/helper.hpp"
 #include "clox/common/constants.hpp"
+#include "clox/common/heap.hpp"
+#include <chrono>
 #include <iostream>
 
-class ClockNativeFunc : public LoxCallable {
+// Native functions do not depend on the engine executing them, so they expose
+// call() which can be used by both the AstInterpreter and the VM.
+class NativeFunction : public LoxCallable {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
+    virtual ExprVal call(std::vector<ExprVal> &args) = 0;
+
+    ExprVal invoke(AstInterpreter &, std::vector<ExprVal> &args) override {
+        return call(args);
+    }
+};
+
+class ClockNativeFunc : public NativeFunction {
+  public:
+    ExprVal call(std::vector<ExprVal> &) override {
         auto now = std::chrono::system_clock::now();
         std::chrono::duration<double> unix_time = now.time_since_epoch();
 
@@ -17,11 +30,10 @@ class ClockNativeFunc : public LoxCallable {
     std::string to_string() const override { return "<native-fn clock>"; }
 };
 
-class PrintNativeFunc : public LoxCallable {
+class PrintNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        for (int i = 0; i < args.size(); ++i) {
+    ExprVal call(std::vector<ExprVal> &args) override {
+        for (size_t i = 0; i < args.size(); ++i) {
             std::cout << cast_expr_val_to_string(args[i]);
             if (i < args.size() - 1) {
                 std::cout << " ";
@@ -36,34 +48,31 @@ class PrintNativeFunc : public LoxCallable {
     uint get_param_num() override { return UNLIMITED_ARGS_NUM; }
 };
 
-class ReadNativeFunc : public LoxCallable {
+class ReadNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
+    ExprVal call(std::vector<ExprVal> &) override {
         std::string input;
         std::cin >> input;
-        return input;
+        return Heap::make_string(input);
     }
 
     std::string to_string() const override { return "<native-fn read>"; }
 };
 
-class ReadlineNativeFunc : public LoxCallable {
+class ReadlineNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
+    ExprVal call(std::vector<ExprVal> &) override {
         std::string input;
         std::getline(std::cin, input);
-        return input;
+        return Heap::make_string(input);
     }
 
     std::string to_string() const override { return "<native-fn readline>"; }
 };
 
-class BoolCastNativeFunc : public LoxCallable {
+class BoolCastNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
+    ExprVal call(std::vector<ExprVal> &args) override {
         return cast_expr_val_to_bool(args[0]);
     }
 
@@ -72,11 +81,10 @@ class BoolCastNativeFunc : public LoxCallable {
     uint get_param_num() override { return 1; }
 };
 
-class StringCastNativeFunc : public LoxCallable {
+class StringCastNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
-        return cast_expr_val_to_string(args[0]);
+    ExprVal call(std::vector<ExprVal> &args) override {
+        return Heap::make_string(cast_expr_val_to_string(args[0]));
     }
 
     std::string to_string() const override { return "<native-fn str>"; }
@@ -84,10 +92,9 @@ class StringCastNativeFunc : public LoxCallable {
     uint get_param_num() override { return 1; }
 };
 
-class DoubleCastNativeFunc : public LoxCallable {
+class DoubleCastNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
+    ExprVal call(std::vector<ExprVal> &args) override {
         return cast_expr_val_to_double(args[0]);
     }
 
@@ -96,10 +103,9 @@ class DoubleCastNativeFunc : public LoxCallable {
     uint get_param_num() override { return 1; }
 };
 
-class IntCastNativeFunc : public LoxCallable {
+class IntCastNativeFunc : public NativeFunction {
   public:
-    ExprVal invoke(AstInterpreter &interpreter,
-                   std::vector<ExprVal> &args) override {
+    ExprVal call(std::vector<ExprVal> &args) override {
         return cast_expr_val_to_int(args[0]);
     }
 
@@ -1,31 +1,44 @@
 #include "clox/ast_interpreter/environment.hpp"
-#include "clox/common/error_manager.hpp"
-#include <memory>
+#include "clox/common/constants.hpp"
+#include "clox/common/heap.hpp"
 
-Environment::Environment() {}
+Environment::Environment() : LoxObject(ObjectType::ENVIRONMENT) {}
 
-Environment::Environment(std::shared_ptr<Environment> parent_scope_env)
-    : parent_scope_env(parent_scope_env) {}
+Environment::Environment(Environment *parent_scope_env, uint slot_num,
+                         const ExprVal &value)
+    : LoxObject(ObjectType::ENVIRONMENT), values(slot_num, value),
+      parent_scope_env(parent_scope_env) {}
 
-void Environment::add_identifier(std::string name, const ExprVal &value) {
-    identifier_table[name] = value;
+void Environment::define_identifier(uint slot, const ExprVal &value) {
+    // Only the global env grows after creation: new globals are declared by
+    // every program run in interactive mode.
+    if (slot >= values.size()) {
+        resize(slot + 1);
+    }
+    values[slot] = value;
 }
 
-void Environment::update_identifier(std::string name, const ExprVal &value,
-                                    std::shared_ptr<Token> token) {
-    try {
-        identifier_table.at(name) = value;
-    } catch (const std::out_of_range &e) {
-        throw RuntimeException(token, "Cannot update undefined identifier '" +
-                                          name + "'");
+void Environment::resize(uint slot_num, const ExprVal &value) {
+    if (slot_num > values.size()) {
+        values.resize(slot_num, value);
     }
 }
 
-ExprVal Environment::get_identifier(std::string name,
-                                    std::shared_ptr<Token> token) {
-    try {
-        return identifier_table.at(name);
-    } catch (const std::out_of_range &e) {
-        throw RuntimeException(token, "Undefined indentifier '" + name + "'");
+void Environment::reset(Environment *parent_scope_env, uint slot_num) {
+    this->parent_scope_env = parent_scope_env;
+    values.assign(slot_num, NIL);
+}
+
+void Environment::clear() {
+    parent_scope_env = nullptr;
+    values.clear();
+}
+
+void Environment::trace() {
+    Heap::mark_object(parent_scope_env);
+    for (const auto &value : values) {
+        Heap::mark_value(value);
     }
-}
\ No newline at end of file
+}
+
+void Cell::trace() { Heap::mark_value(value); }
@@ -1,23 +1,47 @@
 #pragma once
 #include "clox/common/expr_val.hpp"
+#include "clox/common/lox_object.hpp"
 #include "clox/common/token.hpp"
-#include <memory>
-#include <unordered_map>
+#include <vector>
 
-class Environment {
+// Values of the identifiers declared in a scope. IdentifierResolver assigns
+// each declaration a slot index, so the interpreter accesses identifiers by
+// index instead of by name. Closures do not reference envs, they capture the
+// variables they use in cells, so the env of a scope is unused once the scope
+// is exited.
+class Environment : public LoxObject {
   private:
-    std::unordered_map<std::string, ExprVal> identifier_table = {};
+    std::vector<ExprVal> values = {};
 
   public:
-    std::shared_ptr<Environment> parent_scope_env = nullptr;
+    Environment *parent_scope_env = nullptr;
 
     Environment();
-    Environment(std::shared_ptr<Environment> parent_scope_env);
+    Environment(Environment *parent_scope_env, uint slot_num,
+                const ExprVal &value = NIL);
 
-    void add_identifier(std::string name, const ExprVal &value);
-    void update_identifier(std::string name, const ExprVal &value,
-                           std::shared_ptr<Token> token);
-    ExprVal get_identifier(std::string name, std::shared_ptr<Token> token);
+    void define_identifier(uint slot, const ExprVal &value);
+    ExprVal &get_identifier(uint slot) { return values[slot]; }
+    // Add slots holding value
+    void resize(uint slot_num, const ExprVal &value = NIL);
 
-    friend class IdentifierResolver;
-};
\ No newline at end of file
+    // Reuse a recycled env for a new scope, keeping the memory of its values
+    void reset(Environment *parent_scope_env, uint slot_num);
+    // Drop the values of a recycled env
+    void clear();
+
+    std::string to_string() const override { return "<env>"; }
+    void trace() override;
+};
+
+// Variable captured by a closure. Its slot in the env of its scope holds the
+// cell, which is shared by the closures capturing it and outlives the env.
+class Cell : public LoxObject {
+  public:
+    ExprVal value;
+
+    Cell(const ExprVal &value) : LoxObject(ObjectType::CELL), value(value) {}
+
+    std::string to_string() const override { return "<cell>"; }
+    void trace() override;
+};
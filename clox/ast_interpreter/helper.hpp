@@ -6,42 +6,33 @@
 #include <string>
 
 inline std::string cast_expr_val_to_string(const ExprVal &value) {
-    return std::visit(
-        [](auto &&arg) -> std::string {
-            using T = std::decay_t<decltype(arg)>;
-
-            if constexpr (std::is_same_v<T, bool>) {
-                return arg ? "true" : "false";
-            } else if constexpr (std::is_same_v<T, double>) {
-                return double_to_string(arg);
-            } else if constexpr (std::is_same_v<T, std::string>) {
-                return arg;
-            } else if constexpr (std::is_same_v<T,
-                                                std::shared_ptr<LoxCallable>> ||
-                                 std::is_same_v<T,
-                                                std::shared_ptr<LoxInstance>>) {
-                return arg ? arg->to_string() : "nil";
-            } else {
-                return "nil";
-            }
-        },
-        value);
+    if (value.is_bool()) {
+        return value.as_bool() ? "true" : "false";
+    }
+    if (value.is_number()) {
+        return double_to_string(value.as_number());
+    }
+    if (value.is_object()) {
+        return value.as_object()->to_string();
+    }
+    return "nil";
 }
 
 inline bool cast_expr_val_to_bool(const ExprVal &val) {
-    if (const auto boolPtr(std::get_if<bool>(&val)); boolPtr) {
-        return *boolPtr;
+    if (val.is_bool()) {
+        return val.as_bool();
     }
-    if (const auto doublePtr(std::get_if<double>(&val)); doublePtr) {
-        return *doublePtr != 0;
+    if (val.is_number()) {
+        return val.as_number() != 0;
     }
-    if (const auto strPtr(std::get_if<std::string>(&val)); strPtr) {
-        if (*strPtr == "false") {
+    if (val.is_string()) {
+        const std::string &str = val.as_string();
+        if (str == "false") {
             return false;
         }
-        return strPtr->length() != 0;
+        return str.length() != 0;
     }
-    if (std::holds_alternative<std::monostate>(val)) {
+    if (val.is_nil()) {
         return false;
     }
 
@@ -49,15 +40,15 @@ inline bool cast_expr_val_to_bool(const ExprVal &val) {
 }
 
 inline double cast_expr_val_to_double(const ExprVal &val) {
-    if (const auto doublePtr(std::get_if<double>(&val)); doublePtr) {
-        return *doublePtr;
+    if (val.is_number()) {
+        return val.as_number();
     }
-    if (const auto boolPtr(std::get_if<bool>(&val)); boolPtr) {
-        return *boolPtr ? 1.0 : 0.0;
+    if (val.is_bool()) {
+        return val.as_bool() ? 1.0 : 0.0;
     }
-    if (const auto strPtr(std::get_if<std::string>(&val)); strPtr) {
+    if (val.is_string()) {
         try {
-            return std::stod(*strPtr);
+            return std::stod(val.as_string());
         } catch (std::invalid_argument &) {
             throw RuntimeException(nullptr, "Cannot cast string to double");
         }
@@ -71,41 +62,39 @@ inline double cast_expr_val_to_int(const ExprVal &val) {
 }
 
 inline bool is_expr_vals_equal(const ExprVal &left, const ExprVal &right) {
-    if (std::holds_alternative<bool>(left) ||
-        std::holds_alternative<bool>(right)) {
+    if (left.is_bool() || right.is_bool()) {
         return cast_expr_val_to_bool(left) == cast_expr_val_to_bool(right);
     }
 
-    // Compare variant: Type check then value check.
+    // Type check then value check.
     return left == right;
 }
 
-inline void assert_expr_val_number(std::shared_ptr<Token> tok,
-                                   const ExprVal &right) {
-    if (!std::holds_alternative<double>(right)) {
+inline void assert_expr_val_number(const Token *tok, const ExprVal &right) {
+    if (!right.is_number()) {
         throw RuntimeException(tok, "Right operand must be a number");
     }
 }
 
-inline void assert_expr_vals_number(std::shared_ptr<Token> tok,
-                                    const ExprVal &left, const ExprVal &right) {
-    if (!std::holds_alternative<double>(right)) {
+inline void assert_expr_vals_number(const Token *tok, const ExprVal &left,
+                                    const ExprVal &right) {
+    if (!right.is_number()) {
         throw RuntimeException(tok, "Right operand must be a number");
     }
-    if (!std::holds_alternative<double>(left)) {
+    if (!left.is_number()) {
         throw RuntimeException(tok, "Left operand must be a number");
     }
 }
 
-inline void assert_expr_vals_int(std::shared_ptr<Token> tok,
-                                 const ExprVal &left, const ExprVal &right) {
+inline void assert_expr_vals_int(const Token *tok, const ExprVal &left,
+                                 const ExprVal &right) {
     assert_expr_vals_number(tok, left, right);
 
-    double left_double = std::get<double>(left);
+    double left_double = left.as_number();
     if (static_cast<int>(left_double) != left_double) {
         throw RuntimeException(tok, "Left operand must be an int");
     }
-    double right_double = std::get<double>(right);
+    double right_double = right.as_number();
     if (static_cast<int>(right_double) != right_double) {
         throw RuntimeException(tok, "Right operand must be an int");
     }
@@ -1,12 +1,29 @@
 
 #pragma once
+#include "clox/common/expr_val.hpp"
 #include <string>
 #include <sys/types.h>
-#include <variant>
 
 const uint MAX_ARGS_NUM = 255;
 const int UNLIMITED_ARGS_NUM = MAX_ARGS_NUM + 1;
-// std::monostate to present nil in Lox
-constexpr std::monostate NIL{};
+// Default ExprVal presents nil in Lox
+constexpr ExprVal NIL{};
+constexpr ExprVal UNDEFINED = ExprVal::undefined();
 
-const std::string INIT_METHOD = "init";
\ No newline at end of file
+const std::string INIT_METHOD = "init";
+
+// Depth of an identifier not found in any scope by the resolver
+const int UNRESOLVED_DEPTH = -1;
+// Depth of a global identifier, read from the global env without walking up
+// the envs
+const int GLOBAL_DEPTH = -2;
+// Depth of a variable captured from an enclosing function, read from the
+// upvalues of the running closure
+const int UPVALUE_DEPTH = -3;
+// Slot of "this" in the env of a method call
+const uint THIS_SLOT = 0;
+// Slot of "super" in the env shared by the methods of a class
+const uint SUPER_SLOT = 0;
+const uint CLASS_ENV_SLOT_NUM = 1;
+// Max number of recycled call envs kept by the AstInterpreter
+const uint FRAME_POOL_MAX = 64;
@@ -1,43 +1,53 @@
 #include "clox/common/error_manager.hpp"
 #include <iostream>
 
-inline bool ErrorManager::had_static_err = false;
+thread_local bool ErrorManager::had_static_err = false;
+thread_local std::ostream *ErrorManager::out = &std::cout;
 inline bool ErrorManager::had_runtime_err = false;
 
-StaticException::StaticException(std::shared_ptr<Token> tok,
-                                 std::string message)
+StaticException::StaticException(const Token *tok, std::string message)
     : message(message), tok(tok) {}
 
-RuntimeException::RuntimeException(std::shared_ptr<Token> tok,
-                                   std::string message)
+RuntimeException::RuntimeException(const Token *tok, std::string message)
     : message(message), tok(tok) {}
 
 std::string RuntimeException::get_message() const { return message; }
 
 void ErrorManager::handle_scanner_err(uint line, std::string msg) {
-    std::cout << "[line " << line << "] Error: " + msg << std::endl;
+    *out << "[line " << line << "] Error: " + msg << std::endl;
 }
 
 void ErrorManager::handle_runtime_err(const RuntimeException &err) {
     had_runtime_err = true;
     if (err.tok == nullptr) {
-        std::cout << "Runtime error: " + err.message << std::endl;
+        *out << "Runtime error: " + err.message << std::endl;
         return;
     }
-    report_err(*err.tok, err.message);
+    report_err(err.tok->line, err.tok->lexeme, err.message);
+}
+
+void ErrorManager::handle_runtime_err(const RuntimeException &err,
+                                      uint line, std::string_view lexeme) {
+    had_runtime_err = true;
+    if (lexeme.empty()) {
+        *out << "[line " << line << "] Error: " + err.message << std::endl;
+        return;
+    }
+    report_err(line, lexeme, err.message);
 }
 
 void ErrorManager::handle_static_err(const StaticException &err) {
     had_static_err = true;
     if (err.tok == nullptr) {
-        std::cout << "Static error: " + err.message << std::endl;
+        *out << "Static error: " + err.message << std::endl;
         return;
     }
-    report_err(*err.tok, err.message);
+    report_err(err.tok->line, err.tok->lexeme, err.message);
 }
 
-void ErrorManager::report_err(const Token &tok, std::string msg) {
-    std::string where = " at '" + tok.lexeme + "'";
-    std::cout << "[line " << tok.line << "] Error" + where + ": " + msg
+void ErrorManager::report_err(uint line, std::string_view lexeme,
+                              std::string msg) {
+    std::string where = " at '" + std::string(lexeme) + "'";
+    *out << "[line " << line << "] Error" + where + ": " + msg
               << std::endl;
 }
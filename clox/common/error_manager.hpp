@@ -2,14 +2,18 @@
 #pragma once
 #include "clox/common/token.hpp"
 #include <exception>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
 
 class RuntimeException : public std::exception {
   private:
     std::string message;
-    std::shared_ptr<Token> tok;
+    const Token *tok;
 
   public:
-    RuntimeException(std::shared_ptr<Token> tok, std::string message);
+    RuntimeException(const Token *tok, std::string message);
     std::string get_message() const;
     friend class ErrorManager;
 };
@@ -17,22 +21,30 @@ class RuntimeException : public std::exception {
 class StaticException : std::exception {
   private:
     std::string message;
-    std::shared_ptr<Token> tok;
+    const Token *tok;
 
   public:
-    StaticException(std::shared_ptr<Token> tok, std::string message);
+    StaticException(const Token *tok, std::string message);
     friend class ErrorManager;
 };
 
 class ErrorManager {
   private:
-    static void report_err(const Token &tok, std::string msg);
+    static void report_err(uint line, std::string_view lexeme,
+                           std::string msg);
 
   public:
-    static bool had_static_err;
+    // Per thread: the threads of the parallel front end report the errors of
+    // their chunk to a buffer, printed once all chunks are parsed.
+    static thread_local bool had_static_err;
+    static thread_local std::ostream *out;
     static bool had_runtime_err;
 
     static void handle_scanner_err(uint line, std::string msg);
     static void handle_runtime_err(const RuntimeException &err);
+    // Used by the VM which only keeps the line and lexeme of the token of
+    // each instruction
+    static void handle_runtime_err(const RuntimeException &err, uint line,
+                                   std::string_view lexeme);
     static void handle_static_err(const StaticException &e);
 };
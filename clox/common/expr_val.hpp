@@ -1,11 +1,84 @@
 #pragma once
-#include <memory>
-#include <string>
-#include <variant>
-
-class LoxCallable;
-class LoxClass;
-class LoxInstance;
-using ExprVal =
-    std::variant<double, bool, std::string, std::shared_ptr<LoxCallable>,
-                 std::shared_ptr<LoxInstance>, std::monostate>;
+#include "clox/common/lox_object.hpp"
+#include <cstdint>
+#include <cstring>
+
+// Lox value packed in 8 bytes using NaN boxing. A number is stored as a plain
+// double, other values are encoded in the unused bits of a quiet NaN:
+// - nil, false, true, undefined: QNAN | tag
+// - heap object:      SIGN_BIT | QNAN | pointer (pointers only use 48 bits)
+// Copying an ExprVal never allocates, heap objects are owned by the Heap.
+class ExprVal {
+  private:
+    static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+    static constexpr uint64_t QNAN = 0x7ffc000000000000;
+    static constexpr uint64_t TAG_NIL = 1;
+    static constexpr uint64_t TAG_FALSE = 2;
+    static constexpr uint64_t TAG_TRUE = 3;
+    static constexpr uint64_t TAG_UNDEFINED = 4;
+
+    uint64_t bits;
+
+    bool is_object_type(ObjectType type) const {
+        return is_object() && as_object()->obj_type == type;
+    }
+
+  public:
+    constexpr ExprVal() : bits(QNAN | TAG_NIL) {}
+    constexpr ExprVal(bool boolean)
+        : bits(QNAN | (boolean ? TAG_TRUE : TAG_FALSE)) {}
+    ExprVal(double num) { std::memcpy(&bits, &num, sizeof(double)); }
+    // Template so that a pointer to an incomplete type (or a char*) is a
+    // compile error instead of being silently converted to bool.
+    template <typename T>
+    ExprVal(T *object)
+        : bits(SIGN_BIT | QNAN |
+               reinterpret_cast<uintptr_t>(static_cast<LoxObject *>(object))) {
+    }
+
+    // Value of a variable declared but not defined yet, reading it is a
+    // runtime error so it is never seen by Lox code
+    static constexpr ExprVal undefined() {
+        ExprVal value;
+        value.bits = QNAN | TAG_UNDEFINED;
+        return value;
+    }
+
+    bool is_nil() const { return bits == (QNAN | TAG_NIL); }
+    bool is_undefined() const { return bits == (QNAN | TAG_UNDEFINED); }
+    bool is_bool() const { return (bits | 1) == (QNAN | TAG_TRUE); }
+    bool is_number() const { return (bits & QNAN) != QNAN; }
+    bool is_object() const {
+        return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+    }
+    bool is_string() const { return is_object_type(ObjectType::STRING); }
+    bool is_callable() const { return is_object_type(ObjectType::CALLABLE); }
+    bool is_instance() const { return is_object_type(ObjectType::INSTANCE); }
+
+    bool as_bool() const { return bits == (QNAN | TAG_TRUE); }
+    double as_number() const {
+        double num;
+        std::memcpy(&num, &bits, sizeof(double));
+        return num;
+    }
+    LoxObject *as_object() const {
+        return reinterpret_cast<LoxObject *>(bits & ~(SIGN_BIT | QNAN));
+    }
+    const std::string &as_string() const {
+        return static_cast<LoxString *>(as_object())->str;
+    }
+    // Cast the heap object to a derived class, the caller checks its type
+    template <typename T> T *as() const {
+        return static_cast<T *>(as_object());
+    }
+
+    // Numbers are compared by value, objects by identity (strings are
+    // interned)
+    bool operator==(const ExprVal &other) const {
+        if (is_number() && other.is_number()) {
+            return as_number() == other.as_number();
+        }
+        return bits == other.bits;
+    }
+    bool operator!=(const ExprVal &other) const { return !(*this == other); }
+};
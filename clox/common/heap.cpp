@@ -0,0 +1,133 @@
+#include "clox/common/heap.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string_view>
+
+// Heap size below which no collection is triggered
+const size_t MIN_NEXT_GC = 1024 * 1024;
+
+LoxObject *Heap::objects = nullptr;
+std::unordered_multimap<size_t, LoxString *> Heap::strings = {};
+std::vector<LoxObject *> Heap::gray_objects = {};
+std::mutex Heap::strings_mutex;
+size_t Heap::bytes_allocated = 0;
+size_t Heap::next_gc = MIN_NEXT_GC;
+double Heap::growth_factor = 2;
+GcStats Heap::stats = {};
+std::vector<LoxObject *> *Heap::ast_pins = nullptr;
+
+void Heap::account(LoxObject *object, size_t size) {
+    object->heap_size += size;
+    bytes_allocated += size;
+    stats.peak_bytes = std::max(stats.peak_bytes, bytes_allocated);
+}
+
+LoxString *Heap::make_string(std::string_view str) {
+    size_t hash = std::hash<std::string_view>{}(str);
+    auto range = strings.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->str == str) {
+            return it->second;
+        }
+    }
+
+    size_t length = str.size();
+    auto interned = alloc<LoxString>(std::string(str), hash);
+    account(interned, length);
+    strings.emplace(hash, interned);
+    return interned;
+}
+
+LoxString *Heap::make_pinned_string(std::string_view str) {
+    std::lock_guard<std::mutex> lock(strings_mutex);
+    return pin_for_ast(make_string(str));
+}
+
+void Heap::remove_string(LoxString *string) {
+    auto range = strings.equal_range(string->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == string) {
+            strings.erase(it);
+            return;
+        }
+    }
+}
+
+std::vector<IGcRoots *> &Heap::roots() {
+    static auto engines = new std::vector<IGcRoots *>();
+    return *engines;
+}
+
+void Heap::add_roots(IGcRoots *engine) { roots().push_back(engine); }
+
+void Heap::remove_roots(IGcRoots *engine) {
+    auto &engines = roots();
+    engines.erase(std::remove(engines.begin(), engines.end(), engine),
+                  engines.end());
+}
+
+void Heap::mark_object(LoxObject *object) {
+    if (object == nullptr || object->is_marked) {
+        return;
+    }
+    object->is_marked = true;
+    gray_objects.push_back(object);
+}
+
+void Heap::trace_references() {
+    while (!gray_objects.empty()) {
+        LoxObject *object = gray_objects.back();
+        gray_objects.pop_back();
+        object->trace();
+    }
+}
+
+// Freeing an object may release a program or a chunk, which unpins their
+// objects in the middle of the sweep: a string is only removed from the
+// table when it is freed.
+void Heap::sweep() {
+    LoxObject **link = &objects;
+    while (*link != nullptr) {
+        LoxObject *object = *link;
+        if (object->is_marked || object->pin_count > 0) {
+            object->is_marked = false;
+            link = &object->next_object;
+            continue;
+        }
+
+        *link = object->next_object;
+        if (object->obj_type == ObjectType::STRING) {
+            remove_string(static_cast<LoxString *>(object));
+        }
+        bytes_allocated -= object->heap_size;
+        stats.freed_bytes += object->heap_size;
+        stats.freed_objects++;
+        delete object;
+    }
+}
+
+void Heap::collect() {
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto engine : roots()) {
+        engine->mark_roots();
+    }
+    trace_references();
+    sweep();
+
+    next_gc = std::max(size_t(bytes_allocated * growth_factor), MIN_NEXT_GC);
+    stats.collections++;
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    stats.gc_seconds += elapsed.count();
+}
+
+void Heap::print_stats(std::ostream &os) {
+    os << "[gc] collections: " << stats.collections << std::endl;
+    os << "[gc] freed objects: " << stats.freed_objects << std::endl;
+    os << "[gc] freed bytes: " << stats.freed_bytes << std::endl;
+    os << "[gc] live bytes: " << bytes_allocated << std::endl;
+    os << "[gc] peak bytes: " << stats.peak_bytes << std::endl;
+    os << "[gc] time: " << stats.gc_seconds << "s" << std::endl;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "clox/common/expr_val.hpp"
+#include "clox/common/lox_object.hpp"
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Implemented by the execution engines to mark the objects they reference
+// directly (envs, value stacks, globals...).
+class IGcRoots {
+  public:
+    virtual void mark_roots() = 0;
+};
+
+struct GcStats {
+    uint collections = 0;
+    size_t freed_objects = 0;
+    size_t freed_bytes = 0;
+    size_t peak_bytes = 0;
+    double gc_seconds = 0;
+};
+
+// Allocate and own every LoxObject created by the scanner, the AstInterpreter
+// and the VM. Unreachable objects are reclaimed by a mark-sweep collector once
+// the allocated bytes exceed a threshold, which then grows by growth_factor.
+class Heap {
+  private:
+    static LoxObject *objects;
+    // Interned strings keyed by their hash, they are weak references: a
+    // string is removed from the table when the sweep frees it.
+    static std::unordered_multimap<size_t, LoxString *> strings;
+    // Never destroyed: engines held by static objects unregister themselves
+    // during static destruction.
+    static std::vector<IGcRoots *> &roots();
+    static std::vector<LoxObject *> gray_objects;
+    // Taken by make_pinned_string, which is called concurrently by the
+    // scanners of the parallel front end
+    static std::mutex strings_mutex;
+    static size_t bytes_allocated;
+    static size_t next_gc;
+
+    static void account(LoxObject *object, size_t size);
+    static void remove_string(LoxString *string);
+    static void trace_references();
+    static void sweep();
+
+  public:
+    static double growth_factor;
+    static GcStats stats;
+    // Set by the owner of the AST being built to record the pins taken for
+    // it, the owner unpins them when it releases the AST
+    static std::vector<LoxObject *> *ast_pins;
+
+    template <typename T, typename... Args> static T *alloc(Args &&...args) {
+        T *object = new T(std::forward<Args>(args)...);
+        object->next_object = objects;
+        objects = object;
+        account(object, sizeof(T));
+        return object;
+    }
+
+    // Return the interned string with this content, create it on first use
+    static LoxString *make_string(std::string_view str);
+
+    // Same as make_string for the literals and names referenced by the AST,
+    // the string is pinned with pin_for_ast. Safe to call from several
+    // threads while nothing else uses the heap.
+    static LoxString *make_pinned_string(std::string_view str);
+
+    template <typename T> static T *pin(T *object) {
+        object->pin_count++;
+        return object;
+    }
+    static void unpin(LoxObject *object) { object->pin_count--; }
+
+    // Pin an object referenced by the AST being built
+    template <typename T> static T *pin_for_ast(T *object) {
+        if (ast_pins != nullptr) {
+            ast_pins->push_back(object);
+        }
+        return pin(object);
+    }
+
+    static void add_roots(IGcRoots *engine);
+    static void remove_roots(IGcRoots *engine);
+
+    static void mark_object(LoxObject *object);
+    static void mark_value(const ExprVal &value) {
+        if (value.is_object()) {
+            mark_object(value.as_object());
+        }
+    }
+
+    // The engines call this at safe points, where every live value is
+    // reachable from their roots.
+    static void collect_if_needed() {
+        if (bytes_allocated > next_gc) {
+            collect();
+        }
+    }
+    static void collect();
+
+    static size_t get_bytes_allocated() { return bytes_allocated; }
+    static void print_stats(std::ostream &os);
+};
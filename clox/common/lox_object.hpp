@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class ObjectType : uint8_t {
+    STRING,
+    CALLABLE,
+    INSTANCE,
+    ENVIRONMENT,
+    CELL,
+};
+
+// Base class of the objects allocated on the Heap, an ExprVal only stores a
+// pointer to them.
+class LoxObject {
+  public:
+    const ObjectType obj_type;
+    // Next object in the list of all objects allocated by the Heap
+    LoxObject *next_object = nullptr;
+    // Bytes accounted to this object by the Heap
+    size_t heap_size = 0;
+    bool is_marked = false;
+    // Pinned objects are referenced by the AST or by compiled chunks, which
+    // the garbage collector does not trace, and are not freed while pinned.
+    // Each holder takes and releases its own pin.
+    uint32_t pin_count = 0;
+
+    LoxObject(ObjectType obj_type) : obj_type(obj_type) {}
+    virtual ~LoxObject() = default;
+
+    virtual std::string to_string() const = 0;
+
+    // Mark the objects referenced by this object
+    virtual void trace() {}
+};
+
+// Immutable string value. Strings are interned by the Heap: two LoxString
+// with the same content are the same object, so they are compared by pointer.
+class LoxString : public LoxObject {
+  private:
+    LoxString(std::string str, size_t hash)
+        : LoxObject(ObjectType::STRING), str(std::move(str)), hash(hash) {}
+
+    friend class Heap;
+
+  public:
+    const std::string str;
+    const size_t hash;
+
+    std::string to_string() const override { return str; }
+};
+
+// Hash an interned string key with its cached hash
+struct LoxStringHash {
+    size_t operator()(const LoxString *str) const { return str->hash; }
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "clox/common/heap.hpp"
+#include "clox/common/lox_object.hpp"
+#include <array>
+#include <memory>
+#include <sys/types.h>
+#include <unordered_map>
+
+// Hidden class of a LoxInstance: map each property name to a slot of the
+// instance field vector. Instances whose props were added in the same order
+// share a Shape, shapes form a tree rooted at the empty shape where each edge
+// adds one prop. Shapes are never freed, they are owned by their parent.
+class Shape {
+  private:
+    std::unordered_map<LoxString *, uint, LoxStringHash> slots = {};
+    std::unordered_map<LoxString *, std::unique_ptr<Shape>, LoxStringHash>
+        transitions = {};
+
+    Shape() = default;
+
+  public:
+    // Shape of an instance without any prop
+    static Shape *root() {
+        static Shape *empty_shape = new Shape();
+        return empty_shape;
+    }
+
+    uint get_prop_num() const { return slots.size(); }
+
+    // Return the slot of the prop or -1 if the shape doesn't have it
+    int find_slot(LoxString *name) const {
+        auto slot = slots.find(name);
+        return slot != slots.end() ? int(slot->second) : -1;
+    }
+
+    // Return the shape with a new prop appended after the current ones
+    Shape *add_prop(LoxString *name) {
+        auto &next_shape = transitions[name];
+        if (next_shape == nullptr) {
+            // The name is kept by the shape tree, which is not traced by GC
+            Heap::pin(name);
+            next_shape.reset(new Shape());
+            next_shape->slots = slots;
+            next_shape->slots.emplace(name, slots.size());
+        }
+        return next_shape.get();
+    }
+};
+
+const uint PROPERTY_CACHE_SIZE = 4;
+
+// Polymorphic inline cache of a property access site (an AST node or a VM
+// instruction), remember the result of the prop lookup for the last shapes
+// seen at the site. Once full, the last entry is replaced on each miss.
+struct PropertyCache {
+    struct Entry {
+        Shape *shape;
+        // -1 when the prop doesn't exist (the field may be a method)
+        int slot;
+        // Shape of the instance after a prop assignment
+        Shape *next_shape;
+    };
+
+    std::array<Entry, PROPERTY_CACHE_SIZE> entries = {};
+    uint entry_num = 0;
+
+    const Entry *find(Shape *shape) const {
+        for (uint i = 0; i < entry_num; ++i) {
+            if (entries[i].shape == shape) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const Entry *add(const Entry &entry) {
+        if (entry_num < PROPERTY_CACHE_SIZE) {
+            entry_num++;
+        }
+        entries[entry_num - 1] = entry;
+        return &entries[entry_num - 1];
+    }
+};
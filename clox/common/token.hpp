@@ -2,11 +2,14 @@
 
 #include <sys/types.h>
 
+#include "clox/common/constants.hpp"
 #include "clox/common/expr_val.hpp"
 #include "clox/utils/magic_enum.hpp"
+#include <array>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 enum class TokenType {
     // Single-character tokens.
@@ -58,11 +61,17 @@ enum class TokenType {
     VAR,
     WHILE,
     CONTINUE,
+    IMPORT,
 
     EOS, // end of source code
 };
 
-const std::unordered_map<std::string, TokenType> reserved_kws = {
+struct Keyword {
+    std::string_view name = "";
+    TokenType type = TokenType::IDENTIFIER;
+};
+
+constexpr Keyword KEYWORDS[] = {
     {"and", TokenType::AND},       {"class", TokenType::CLASS},
     {"else", TokenType::ELSE},     {"elif", TokenType::ELIF},
     {"false", TokenType::FALSE},   {"for", TokenType::FOR},
@@ -72,20 +81,49 @@ const std::unordered_map<std::string, TokenType> reserved_kws = {
     {"this", TokenType::THIS},     {"true", TokenType::TRUE},
     {"var", TokenType::VAR},       {"while", TokenType::WHILE},
     {"break", TokenType::BREAK},   {"continue", TokenType::CONTINUE},
+    {"import", TokenType::IMPORT},
 };
 
-class Token {
-  public:
-    TokenType type = TokenType::EOS;
-    std::string lexeme = "";
-    ExprVal literal = "";
-    uint line = 0;
+const uint KEYWORD_TABLE_SIZE = 64;
+
+// Perfect hash of the keywords: no two keywords share a slot of the table,
+// which is checked when the table is built at compile time.
+constexpr uint keyword_hash(std::string_view word) {
+    return (5 * uint(word.front()) + uint(word.back()) + word.size()) %
+           KEYWORD_TABLE_SIZE;
+}
 
-    Token() {}
-    Token(TokenType type, std::string lexeme, ExprVal literal, uint line)
-        : type(type), lexeme(lexeme), literal(literal), line(line) {}
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> make_keyword_table() {
+    std::array<Keyword, KEYWORD_TABLE_SIZE> table = {};
+    for (const Keyword &keyword : KEYWORDS) {
+        Keyword &slot = table[keyword_hash(keyword.name)];
+        if (!slot.name.empty()) {
+            throw "Keyword hash collision, change keyword_hash";
+        }
+        slot = keyword;
+    }
+    return table;
+}
+
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> KEYWORD_TABLE =
+    make_keyword_table();
+
+// Return the keyword token type of the word or IDENTIFIER, the word must not
+// be empty
+constexpr TokenType find_keyword(std::string_view word) {
+    const Keyword &keyword = KEYWORD_TABLE[keyword_hash(word)];
+    return keyword.name == word ? keyword.type : TokenType::IDENTIFIER;
+}
+
+// Lexeme views the source buffer, which must outlive the tokens. Tokens are
+// stored by value in one flat vector and the AST points into it.
+struct Token {
+    std::string_view lexeme = "";
+    ExprVal literal = NIL;
+    uint line = 0;
+    TokenType type = TokenType::EOS;
 
-    std::string toString() {
+    std::string toString() const {
         std::ostringstream oss;
         oss << "Token: " << std::setw(15) << std::left
             << magic_enum::enum_name(this->type) << " | Line: " << std::setw(3)
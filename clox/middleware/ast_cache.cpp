@@ -0,0 +1,945 @@
+#include "clox/middleware/ast_cache.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/middleware/module_loader.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+enum class NodeTag : uint8_t {
+    NONE,
+    BINARY,
+    GROUP,
+    LITERAL,
+    UNARY,
+    IDENTIFIER,
+    THIS,
+    SUPER,
+    GET_CLASS_FIELD,
+    FUNC_CALL,
+    EXPR_STMT,
+    VAR_DECL,
+    ASSIGN,
+    BLOCK,
+    IF,
+    WHILE,
+    BREAK,
+    CONTINUE,
+    FUNCTION_DECL,
+    RETURN,
+    CLASS_DECL,
+    SET_CLASS_FIELD,
+};
+
+// LEXEME is a string equal to the lexeme of its token, like identifier names
+enum class ValueTag : uint8_t { NIL, FALSE, TRUE, NUMBER, STRING, LEXEME };
+
+// Id of a null token
+const uint32_t NO_TOKEN = UINT32_MAX;
+
+// Append the program in pre-order: each node is its tag then its fields. A
+// token is written in full where it is first referenced, then by its id.
+class CacheWriter : public IExprVisitor, public IStmtVisitor {
+  private:
+    std::string_view src;
+    std::unordered_map<const Token *, uint32_t> token_ids = {};
+    uint32_t prev_line = 0;
+    uint32_t prev_offset = 0;
+
+  public:
+    std::string out = "";
+    // False when the program holds something which can't be written: a
+    // token outside the source or a literal which isn't a plain value
+    bool is_writable = true;
+
+    CacheWriter(std::string_view src) : src(src) {}
+
+    uint32_t token_num() const { return token_ids.size(); }
+
+    template <typename T> void put(T value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    // LEB128: 7 bits per byte, small numbers take a single byte
+    void put_uint(uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(char(value));
+    }
+
+    // Zigzag encoded so that small negative numbers take a single byte too
+    void put_int(int32_t value) {
+        put_uint((uint32_t(value) << 1) ^ uint32_t(value >> 31));
+    }
+
+    void put_tag(NodeTag tag) { put(tag); }
+
+    void put_string(std::string_view str) {
+        put_uint(str.size());
+        out.append(str);
+    }
+
+    void put_value(const ExprVal &value) {
+        if (value.is_nil()) {
+            put(ValueTag::NIL);
+        } else if (value.is_bool()) {
+            put(value.as_bool() ? ValueTag::TRUE : ValueTag::FALSE);
+        } else if (value.is_number()) {
+            put(ValueTag::NUMBER);
+            put(value.as_number());
+        } else if (value.is_string()) {
+            put(ValueTag::STRING);
+            put_string(value.as_string());
+        } else {
+            is_writable = false;
+            put(ValueTag::NIL);
+        }
+    }
+
+    void put_token(const Token *token) {
+        if (token == nullptr) {
+            put_uint(NO_TOKEN);
+            return;
+        }
+        auto it = token_ids.find(token);
+        if (it != token_ids.end()) {
+            put_uint(it->second);
+            return;
+        }
+
+        uint32_t id = token_ids.size();
+        token_ids[token] = id;
+        put_uint(id);
+        const char *lexeme = token->lexeme.data();
+        if (lexeme < src.data() ||
+            lexeme + token->lexeme.size() > src.data() + src.size()) {
+            is_writable = false;
+            lexeme = src.data();
+        }
+        put(token->type);
+        // Tokens are mostly met in source order, their line and offset are
+        // written as a difference with the previous token
+        uint32_t offset = lexeme - src.data();
+        put_int(token->line - prev_line);
+        put_int(offset - prev_offset);
+        put_uint(token->lexeme.size());
+        prev_line = token->line;
+        prev_offset = offset;
+        if (token->literal.is_string() &&
+            token->literal.as_string() == token->lexeme) {
+            put(ValueTag::LEXEME);
+        } else {
+            put_value(token->literal);
+        }
+    }
+
+    void put_expr(Expr *expr) {
+        if (expr == nullptr) {
+            put_tag(NodeTag::NONE);
+            return;
+        }
+        expr->accept(*this);
+    }
+
+    void put_stmt(Stmt *stmt) {
+        if (stmt == nullptr) {
+            put_tag(NodeTag::NONE);
+            return;
+        }
+        stmt->accept(*this);
+    }
+
+    template <typename T> void put_stmts(const std::vector<T *> &stmts) {
+        put_uint(stmts.size());
+        for (T *stmt : stmts) {
+            put_stmt(stmt);
+        }
+    }
+
+    void put_identifier(const IdentifierExpr &identifier, NodeTag tag) {
+        put_tag(tag);
+        put_token(identifier.token);
+        put_int(identifier.depth);
+        put_uint(identifier.slot);
+        put<uint8_t>(identifier.is_cell);
+    }
+
+    ExprVal visit_literal(const LiteralExpr &literal) override {
+        put_tag(NodeTag::LITERAL);
+        put_value(literal.value);
+        return NIL;
+    }
+
+    ExprVal visit_grouping(const GroupExpr &group) override {
+        put_tag(NodeTag::GROUP);
+        put_expr(group.expr);
+        return NIL;
+    }
+
+    ExprVal visit_unary(const UnaryExpr &unary) override {
+        put_tag(NodeTag::UNARY);
+        put_token(unary.operation);
+        put_expr(unary.operand);
+        return NIL;
+    }
+
+    ExprVal visit_binary(const BinaryExpr &binary) override {
+        put_tag(NodeTag::BINARY);
+        put_expr(binary.left_operand);
+        put_token(binary.operation);
+        put_expr(binary.right_operand);
+        return NIL;
+    }
+
+    ExprVal visit_identifier(const IdentifierExpr &identifier) override {
+        put_identifier(identifier, NodeTag::IDENTIFIER);
+        return NIL;
+    }
+
+    ExprVal visit_this(const ThisExpr &this_expr) override {
+        put_identifier(this_expr, NodeTag::THIS);
+        return NIL;
+    }
+
+    ExprVal visit_super(const SuperExpr &super_expr) override {
+        put_identifier(super_expr, NodeTag::SUPER);
+        put_int(super_expr.this_depth);
+        put_uint(super_expr.this_slot);
+        put_expr(super_expr.method);
+        return NIL;
+    }
+
+    ExprVal visit_get_class_field(const GetClassFieldExpr &get) override {
+        put_tag(NodeTag::GET_CLASS_FIELD);
+        put_expr(get.lox_instance);
+        put_token(get.field_token);
+        return NIL;
+    }
+
+    ExprVal visit_func_call(const FuncCallExpr &call) override {
+        put_tag(NodeTag::FUNC_CALL);
+        put_expr(call.callee);
+        put_token(call.func_token);
+        put_uint(call.args.size());
+        for (Expr *arg : call.args) {
+            put_expr(arg);
+        }
+        return NIL;
+    }
+
+    void visit_expr_stmt(const ExprStmt &expr_stmt) override {
+        put_tag(NodeTag::EXPR_STMT);
+        put_expr(expr_stmt.expr);
+    }
+
+    void visit_var_decl(const VarDecl &var_decl) override {
+        put_tag(NodeTag::VAR_DECL);
+        put_token(var_decl.var_name);
+        put_expr(var_decl.initializer);
+        put_uint(var_decl.slot);
+        put<uint8_t>(var_decl.is_captured);
+    }
+
+    void visit_assign_stmt(const AssignStmt &assign) override {
+        put_tag(NodeTag::ASSIGN);
+        put_expr(assign.var);
+        put_expr(assign.value);
+    }
+
+    // The slot numbers and captures are written before the nodes using
+    // them, so that the reader can check them
+    void visit_block_stmt(const BlockStmt &block, Environment *) override {
+        put_tag(NodeTag::BLOCK);
+        put_uint(block.slot_num);
+        put_stmts(block.stmts);
+        // The increment of a for loop is the last stmt of its body
+        put<uint8_t>(block.for_loop_increment != nullptr);
+    }
+
+    void visit_if_stmt(const IfStmt &if_stmt) override {
+        put_tag(NodeTag::IF);
+        put_uint(if_stmt.conditions.size());
+        for (Expr *condition : if_stmt.conditions) {
+            put_expr(condition);
+        }
+        put_stmts(if_stmt.if_blocks);
+        put_stmt(if_stmt.else_block);
+    }
+
+    void visit_while_stmt(const WhileStmt &while_stmt) override {
+        put_tag(NodeTag::WHILE);
+        put_expr(while_stmt.condition);
+        put_stmt(while_stmt.body);
+    }
+
+    void visit_break_stmt(const BreakStmt &break_stmt) override {
+        put_tag(NodeTag::BREAK);
+        put_token(break_stmt.break_kw);
+    }
+
+    void visit_continue_stmt(const ContinueStmt &continue_stmt) override {
+        put_tag(NodeTag::CONTINUE);
+        put_token(continue_stmt.continue_kw);
+    }
+
+    void visit_function_decl(FunctionDecl &function) override {
+        put_tag(NodeTag::FUNCTION_DECL);
+        put_token(function.name);
+        put_uint(function.slot);
+        put<uint8_t>(function.is_captured);
+        put_uint(function.captures.size());
+        for (const Capture &capture : function.captures) {
+            put<uint8_t>(capture.is_local);
+            put_uint(capture.depth);
+            put_uint(capture.slot);
+        }
+        put_uint(function.params.size());
+        for (IdentifierExpr *param : function.params) {
+            put_expr(param);
+        }
+        put_stmt(function.body);
+    }
+
+    void visit_return_stmt(const ReturnStmt &return_stmt) override {
+        put_tag(NodeTag::RETURN);
+        put_token(return_stmt.return_kw);
+        put_expr(return_stmt.expr);
+        put<uint8_t>(return_stmt.is_tail_call);
+    }
+
+    void visit_class_decl(const ClassDecl &class_decl) override {
+        put_tag(NodeTag::CLASS_DECL);
+        put_token(class_decl.name);
+        put_expr(class_decl.superclass);
+        put_stmts(class_decl.methods);
+        put_uint(class_decl.slot);
+        put<uint8_t>(class_decl.is_captured);
+    }
+
+    void visit_set_class_field(const SetClassFieldStmt &set) override {
+        put_tag(NodeTag::SET_CLASS_FIELD);
+        put_expr(set.lox_instance);
+        put_token(set.field_token);
+        put_expr(set.value);
+    }
+
+    // The modules are loaded when the program is resolved, a program
+    // importing modules is not cached
+    void visit_import_stmt(const ImportStmt &) override {
+        is_writable = false;
+    }
+};
+
+// Scope with an env at runtime, opened while its nodes are read
+struct ReadScope {
+    uint32_t slot_num;
+    // The env of a call, whose parent is the top level env
+    bool is_function = false;
+    uint32_t capture_num = 0;
+    // The slot number of the module scope is the one of its declarations,
+    // only known once they are all read
+    bool is_growing = false;
+    uint32_t used_slot_num = 0;
+};
+
+// Rebuild the nodes written by CacheWriter, throw std::runtime_error when
+// the data is not a valid program. The depths and slots are checked against
+// the envs the nodes run in, as the resolver computed them.
+class CacheReader {
+  private:
+    std::string_view data;
+    size_t pos = 0;
+    std::string_view src;
+    // Reserved for all the tokens of the program, so they never move
+    std::vector<Token> &tokens;
+    AstArena &arena;
+    uint32_t prev_line = 0;
+    uint32_t prev_offset = 0;
+    // The global scope first
+    std::vector<ReadScope> scopes = {};
+    size_t top_level_scope = 0;
+
+    [[noreturn]] static void fail() {
+        throw std::runtime_error("Corrupted AST cache");
+    }
+
+    // Index of the scope of the env depth levels above the env of the scope
+    // at index
+    size_t scope_above(size_t index, uint32_t depth) const {
+        for (; depth > 0; --depth) {
+            if (scopes[index].is_function) {
+                index = top_level_scope;
+            } else if (index == 0) {
+                fail();
+            } else {
+                --index;
+            }
+        }
+        return index;
+    }
+
+    // Innermost function of the scope at index, or nullptr
+    const ReadScope *function_of(size_t index) const {
+        for (size_t i = index + 1; i > top_level_scope; --i) {
+            if (scopes[i - 1].is_function) {
+                return &scopes[i - 1];
+            }
+        }
+        return nullptr;
+    }
+
+    void use_slot(size_t index, uint32_t slot) {
+        ReadScope &scope = scopes[index];
+        if (scope.is_growing) {
+            scope.used_slot_num = std::max(scope.used_slot_num, slot + 1);
+        } else if (slot >= scope.slot_num) {
+            fail();
+        }
+    }
+
+    // Slot of a declaration in the current scope
+    void declare_slot(uint32_t slot) {
+        ReadScope &scope = scopes.back();
+        if (scope.is_growing) {
+            scope.slot_num = std::max(scope.slot_num, slot + 1);
+        } else if (slot >= scope.slot_num) {
+            fail();
+        }
+    }
+
+    void check_identifier(int32_t depth, uint32_t slot) {
+        if (depth == UNRESOLVED_DEPTH) {
+            return;
+        }
+        if (depth == GLOBAL_DEPTH) {
+            use_slot(0, slot);
+        } else if (depth == UPVALUE_DEPTH) {
+            const ReadScope *function = function_of(scopes.size() - 1);
+            if (function == nullptr || slot >= function->capture_num) {
+                fail();
+            }
+        } else if (depth >= 0) {
+            use_slot(scope_above(scopes.size() - 1, depth), slot);
+        } else {
+            fail();
+        }
+    }
+
+    // A closure captures the variables of the env it is created in
+    void check_capture(const Capture &capture) {
+        if (capture.is_local) {
+            use_slot(scope_above(scopes.size() - 1, capture.depth),
+                     capture.slot);
+            return;
+        }
+        const ReadScope *function = function_of(scopes.size() - 1);
+        if (function == nullptr || capture.slot >= function->capture_num) {
+            fail();
+        }
+    }
+
+  public:
+    CacheReader(std::string_view data, std::string_view src,
+                std::vector<Token> &tokens, AstArena &arena)
+        : data(data), src(src), tokens(tokens), arena(arena) {}
+
+    bool at_end() const { return pos == data.size(); }
+
+    // Data not read yet
+    std::string_view rest() const { return data.substr(pos); }
+
+    // The program runs in the global env of global_num slots, a module in
+    // its own env nested in it
+    void open_top_level(uint32_t global_num, bool is_module) {
+        scopes.push_back({global_num});
+        if (is_module) {
+            scopes.push_back({0});
+            scopes.back().is_growing = true;
+            top_level_scope = 1;
+        }
+    }
+
+    // Check the references to the module scope once all its declarations
+    // are read
+    void close_top_level() {
+        const ReadScope &top_level = scopes[top_level_scope];
+        if (top_level.used_slot_num > top_level.slot_num) {
+            fail();
+        }
+    }
+
+    template <typename T> T get() {
+        if (data.size() - pos < sizeof(T)) {
+            fail();
+        }
+        T value;
+        std::memcpy(&value, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    uint32_t get_uint() {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t byte = get<uint8_t>();
+            value |= uint32_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        fail();
+    }
+
+    // Number of items following, each of them takes at least a byte
+    uint32_t get_count() {
+        uint32_t count = get_uint();
+        if (count > data.size() - pos) {
+            fail();
+        }
+        return count;
+    }
+
+    int32_t get_int() {
+        uint32_t value = get_uint();
+        return int32_t(value >> 1) ^ -int32_t(value & 1);
+    }
+
+    std::string_view get_string() {
+        uint32_t size = get_uint();
+        if (data.size() - pos < size) {
+            fail();
+        }
+        std::string_view str = data.substr(pos, size);
+        pos += size;
+        return str;
+    }
+
+    ExprVal get_value() {
+        switch (get<ValueTag>()) {
+        case ValueTag::NIL:
+            return NIL;
+        case ValueTag::FALSE:
+            return false;
+        case ValueTag::TRUE:
+            return true;
+        case ValueTag::NUMBER:
+            return get<double>();
+        case ValueTag::STRING:
+            return Heap::make_pinned_string(get_string());
+        default:
+            fail();
+        }
+    }
+
+    const Token *get_token() {
+        uint32_t id = get_uint();
+        if (id == NO_TOKEN) {
+            return nullptr;
+        }
+        if (id < tokens.size()) {
+            return &tokens[id];
+        }
+        if (id != tokens.size() || tokens.size() == tokens.capacity()) {
+            fail();
+        }
+
+        Token token;
+        token.type = get<TokenType>();
+        token.line = prev_line += get_int();
+        uint32_t offset = prev_offset += get_int();
+        uint32_t size = get_uint();
+        if (offset > src.size() || src.size() - offset < size) {
+            fail();
+        }
+        token.lexeme = src.substr(offset, size);
+        if (pos < data.size() && data[pos] == char(ValueTag::LEXEME)) {
+            pos++;
+            token.literal = Heap::make_pinned_string(token.lexeme);
+        } else {
+            token.literal = get_value();
+        }
+        tokens.push_back(token);
+        return &tokens.back();
+    }
+
+    // Read a node of type T, or nullptr
+    template <typename T> T *get_node(bool is_nullable = true) {
+        NodeTag tag = get<NodeTag>();
+        if (tag == NodeTag::NONE) {
+            if (!is_nullable) {
+                fail();
+            }
+            return nullptr;
+        }
+        T *node;
+        if constexpr (std::is_base_of_v<Expr, T>) {
+            node = dynamic_cast<T *>(get_expr(tag));
+        } else {
+            node = dynamic_cast<T *>(get_stmt(tag));
+        }
+        if (node == nullptr) {
+            fail();
+        }
+        return node;
+    }
+
+    template <typename T> std::vector<T *> get_nodes() {
+        uint32_t size = get_count();
+        std::vector<T *> nodes;
+        for (uint32_t i = 0; i < size; ++i) {
+            nodes.push_back(get_node<T>());
+        }
+        return nodes;
+    }
+
+    template <typename T> T *get_identifier() {
+        const Token *token = get_token();
+        int32_t depth = get_int();
+        uint32_t slot = get_uint();
+        bool is_cell = get<uint8_t>() != 0;
+        check_identifier(depth, slot);
+        T *identifier;
+        if constexpr (std::is_same_v<T, SuperExpr>) {
+            int32_t this_depth = get_int();
+            uint32_t this_slot = get_uint();
+            check_identifier(this_depth, this_slot);
+            identifier =
+                arena.make<SuperExpr>(token, get_node<IdentifierExpr>(false));
+            identifier->this_depth = this_depth;
+            identifier->this_slot = this_slot;
+        } else {
+            identifier = arena.make<T>(token);
+        }
+        identifier->depth = depth;
+        identifier->slot = slot;
+        identifier->is_cell = is_cell;
+        return identifier;
+    }
+
+    Expr *get_expr(NodeTag tag) {
+        switch (tag) {
+        case NodeTag::LITERAL:
+            return arena.make<LiteralExpr>(get_value());
+        case NodeTag::GROUP:
+            return arena.make<GroupExpr>(get_node<Expr>(false));
+        case NodeTag::UNARY: {
+            const Token *operation = get_token();
+            return arena.make<UnaryExpr>(operation, get_node<Expr>(false));
+        }
+        case NodeTag::BINARY: {
+            Expr *left = get_node<Expr>(false);
+            const Token *operation = get_token();
+            return arena.make<BinaryExpr>(left, operation,
+                                          get_node<Expr>(false));
+        }
+        case NodeTag::IDENTIFIER:
+            return get_identifier<IdentifierExpr>();
+        case NodeTag::THIS:
+            return get_identifier<ThisExpr>();
+        case NodeTag::SUPER:
+            return get_identifier<SuperExpr>();
+        case NodeTag::GET_CLASS_FIELD: {
+            Expr *instance = get_node<Expr>(false);
+            return arena.make<GetClassFieldExpr>(instance, get_token());
+        }
+        case NodeTag::FUNC_CALL: {
+            Expr *callee = get_node<Expr>(false);
+            const Token *func_token = get_token();
+            std::vector<Expr *> args = get_nodes<Expr>();
+            return arena.make<FuncCallExpr>(callee, func_token, args);
+        }
+        default:
+            fail();
+        }
+    }
+
+    // The body of a function is the scope of its call env, which also holds
+    // its params
+    BlockStmt *get_block(bool is_function = false,
+                         uint32_t capture_num = 0) {
+        uint32_t slot_num = get_uint();
+        // A slot is taken by a declaration of the source
+        if (slot_num > src.size()) {
+            fail();
+        }
+        bool is_scope = is_function || slot_num != 0;
+        if (is_scope) {
+            scopes.push_back({slot_num, is_function, capture_num});
+        }
+        auto block = arena.make<BlockStmt>(get_nodes<Stmt>());
+        if (is_scope) {
+            scopes.pop_back();
+        }
+        if (get<uint8_t>() != 0) {
+            if (block->stmts.empty()) {
+                fail();
+            }
+            block->for_loop_increment = block->stmts.back();
+        }
+        block->slot_num = slot_num;
+        return block;
+    }
+
+    Stmt *get_stmt(NodeTag tag) {
+        switch (tag) {
+        case NodeTag::EXPR_STMT:
+            return arena.make<ExprStmt>(get_node<Expr>(false));
+        case NodeTag::VAR_DECL: {
+            const Token *var_name = get_token();
+            Expr *initializer = get_node<Expr>();
+            auto var_decl = arena.make<VarDecl>(var_name, initializer);
+            var_decl->slot = get_uint();
+            var_decl->is_captured = get<uint8_t>() != 0;
+            declare_slot(var_decl->slot);
+            return var_decl;
+        }
+        case NodeTag::ASSIGN: {
+            auto var = get_node<IdentifierExpr>(false);
+            return arena.make<AssignStmt>(var, get_node<Expr>(false));
+        }
+        case NodeTag::BLOCK:
+            return get_block();
+        case NodeTag::IF: {
+            std::vector<Expr *> conditions = get_nodes<Expr>();
+            std::vector<Stmt *> if_blocks = get_nodes<Stmt>();
+            Stmt *else_block = get_node<Stmt>();
+            return arena.make<IfStmt>(conditions, if_blocks, else_block);
+        }
+        case NodeTag::WHILE: {
+            Expr *condition = get_node<Expr>(false);
+            return arena.make<WhileStmt>(condition,
+                                         get_node<BlockStmt>(false));
+        }
+        case NodeTag::BREAK:
+            return arena.make<BreakStmt>(get_token());
+        case NodeTag::CONTINUE:
+            return arena.make<ContinueStmt>(get_token());
+        case NodeTag::FUNCTION_DECL: {
+            const Token *name = get_token();
+            // The slot of a method is unused, its class scope has one slot
+            uint32_t slot = get_uint();
+            bool is_captured = get<uint8_t>() != 0;
+            declare_slot(slot);
+            std::vector<Capture> captures;
+            uint32_t capture_num = get_count();
+            for (uint32_t i = 0; i < capture_num; ++i) {
+                bool is_local = get<uint8_t>() != 0;
+                uint32_t depth = get_uint();
+                captures.push_back({is_local, depth, get_uint()});
+                check_capture(captures.back());
+            }
+            std::vector<IdentifierExpr *> params = get_nodes<IdentifierExpr>();
+            if (get<NodeTag>() != NodeTag::BLOCK) {
+                fail();
+            }
+            BlockStmt *body = get_block(true, captures.size());
+            for (IdentifierExpr *param : params) {
+                if (param->slot >= body->slot_num) {
+                    fail();
+                }
+            }
+            auto function = arena.make<FunctionDecl>(name, params, body);
+            function->slot = slot;
+            function->is_captured = is_captured;
+            function->captures = std::move(captures);
+            return function;
+        }
+        case NodeTag::RETURN: {
+            const Token *return_kw = get_token();
+            auto return_stmt =
+                arena.make<ReturnStmt>(return_kw, get_node<Expr>());
+            return_stmt->is_tail_call = get<uint8_t>() != 0;
+            return return_stmt;
+        }
+        case NodeTag::CLASS_DECL: {
+            const Token *name = get_token();
+            IdentifierExpr *superclass = get_node<IdentifierExpr>();
+            // The methods are created in the class env which holds "super"
+            scopes.push_back({CLASS_ENV_SLOT_NUM});
+            std::vector<FunctionDecl *> methods = get_nodes<FunctionDecl>();
+            scopes.pop_back();
+            auto class_decl = arena.make<ClassDecl>(name, superclass, methods);
+            class_decl->slot = get_uint();
+            class_decl->is_captured = get<uint8_t>() != 0;
+            declare_slot(class_decl->slot);
+            return class_decl;
+        }
+        case NodeTag::SET_CLASS_FIELD: {
+            Expr *instance = get_node<Expr>(false);
+            const Token *field_token = get_token();
+            return arena.make<SetClassFieldStmt>(instance, field_token,
+                                                 get_node<Expr>(false));
+        }
+        default:
+            fail();
+        }
+    }
+};
+
+std::string AstCache::path_of(const std::string &script_path) {
+    return script_path + ".cache";
+}
+
+// FNV-1a, stable across runs and builds unlike std::hash
+uint64_t AstCache::hash_source(std::string_view src) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : src) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint AstCache::global_num(const AstInterpreter &interpreter) {
+    return interpreter.global_slots.size();
+}
+
+bool AstCache::save(const std::string &path, std::string_view src,
+                    const std::vector<Stmt *> &stmts,
+                    const AstInterpreter &interpreter, uint base_global_num) {
+    std::vector<std::pair<std::string_view, uint>> globals;
+    for (const auto &[name, slot] : interpreter.global_slots) {
+        if (slot >= base_global_num) {
+            globals.emplace_back(name, slot);
+        }
+    }
+    return write(path, src, stmts, globals, base_global_num);
+}
+
+bool AstCache::save_module(const std::string &path, const Module &module,
+                           const AstInterpreter &interpreter) {
+    return write(path, module.source.view(), module.stmts, {},
+                 interpreter.builtin_num);
+}
+
+bool AstCache::write(
+    const std::string &path, std::string_view src,
+    const std::vector<Stmt *> &stmts,
+    const std::vector<std::pair<std::string_view, uint>> &globals,
+    uint base_global_num) {
+    CacheWriter body{src};
+    body.put_uint(globals.size());
+    for (const auto &[name, slot] : globals) {
+        body.put_string(name);
+        body.put_uint(slot);
+    }
+    body.put_stmts(stmts);
+    if (!body.is_writable) {
+        return false;
+    }
+
+    CacheWriter header{src};
+    header.out.append(MAGIC, sizeof(MAGIC));
+    header.put(VERSION);
+    header.put<uint64_t>(src.size());
+    header.put(hash_source(src));
+    header.put<uint32_t>(base_global_num);
+    header.put<uint32_t>(body.token_num());
+    header.put(hash_source(body.out));
+
+    // Concurrent runs of the same script each write their own file, the
+    // rename replaces the cache atomically
+    std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+    std::ofstream file(tmp_path, std::ios::binary);
+    file << header.out << body.out;
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool AstCache::load(const std::string &path, std::string_view src,
+                    std::vector<Token> &tokens, AstArena &arena,
+                    std::vector<Stmt *> &stmts, AstInterpreter &interpreter) {
+    auto &global_slots = interpreter.global_slots;
+    std::vector<std::pair<std::string_view, uint>> globals;
+    SourceBuffer cache;
+    if (!read(path, cache, src, tokens, arena, stmts, global_slots.size(),
+              global_slots, globals, false)) {
+        return false;
+    }
+    for (const auto &[name, slot] : globals) {
+        global_slots[std::string(name)] = slot;
+    }
+    return true;
+}
+
+bool AstCache::load_module(const std::string &path, Module &module,
+                           const AstInterpreter &interpreter) {
+    std::vector<std::pair<std::string_view, uint>> globals;
+    SourceBuffer cache;
+    // A module declares no global
+    return read(path, cache, module.source.view(), module.tokens,
+                module.arena, module.stmts, interpreter.builtin_num,
+                interpreter.global_slots, globals, true) &&
+           globals.empty();
+}
+
+bool AstCache::read(
+    const std::string &path, SourceBuffer &cache, std::string_view src,
+    std::vector<Token> &tokens, AstArena &arena, std::vector<Stmt *> &stmts,
+    uint base_global_num,
+    const std::unordered_map<std::string, uint> &global_slots,
+    std::vector<std::pair<std::string_view, uint>> &globals, bool is_module) {
+    if (!cache.load_file(path)) {
+        return false;
+    }
+
+    CacheReader reader{cache.view(), src, tokens, arena};
+    try {
+        char magic[sizeof(MAGIC)];
+        for (char &c : magic) {
+            c = reader.get<char>();
+        }
+        if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            reader.get<uint32_t>() != VERSION ||
+            reader.get<uint64_t>() != src.size() ||
+            reader.get<uint64_t>() != hash_source(src) ||
+            reader.get<uint32_t>() != base_global_num) {
+            return false;
+        }
+        uint32_t token_num = reader.get<uint32_t>();
+        // Check the body is the one written before decoding it
+        uint64_t body_hash = reader.get<uint64_t>();
+        if (hash_source(reader.rest()) != body_hash ||
+            token_num > reader.rest().size()) {
+            return false;
+        }
+        tokens.clear();
+        tokens.reserve(token_num);
+
+        uint32_t global_num = reader.get_count();
+        for (uint32_t i = 0; i < global_num; ++i) {
+            std::string_view name = reader.get_string();
+            uint32_t slot = reader.get_uint();
+            if (slot < base_global_num ||
+                slot >= base_global_num + global_num ||
+                global_slots.count(std::string(name)) != 0) {
+                throw std::runtime_error("Invalid global in AST cache");
+            }
+            globals.emplace_back(name, slot);
+        }
+        reader.open_top_level(base_global_num + global_num, is_module);
+        stmts = reader.get_nodes<Stmt>();
+        reader.close_top_level();
+        if (!reader.at_end()) {
+            throw std::runtime_error("Trailing data in AST cache");
+        }
+    } catch (std::exception &) {
+        // Including std::bad_alloc, the cache is then missed
+        tokens.clear();
+        arena.clear();
+        stmts.clear();
+        globals.clear();
+        return false;
+    }
+    return true;
+}
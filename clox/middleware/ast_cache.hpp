@@ -0,0 +1,73 @@
+#pragma once
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/token.hpp"
+#include "clox/parser/ast_arena.hpp"
+#include "clox/parser/expr.hpp"
+#include "clox/parser/stmt.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Binary image of a resolved program, written next to the script so that the
+// next runs of the same source skip the scanner, the parser and the resolver.
+// The image holds the AST with the resolver annotations (depths, slots, slot
+// numbers), the tokens it points to and the globals the resolver declared.
+// It is only loaded for the exact source and interpreter version it was
+// written for, when the checksum of the image matches.
+class AstCache {
+  private:
+    static constexpr char MAGIC[8] = {'C', 'L', 'O', 'X', 'A', 'S', 'T', '\0'};
+    // Bump when the AST, the tokens or the resolver annotations change
+    static constexpr uint32_t VERSION = 9;
+
+    static bool
+    write(const std::string &path, std::string_view src,
+          const std::vector<Stmt *> &stmts,
+          const std::vector<std::pair<std::string_view, uint>> &globals,
+          uint base_global_num);
+
+    // Read the program or module into tokens and arena and the globals it
+    // declares, whose names view cache. Return false when the file is
+    // missing, stale or corrupted.
+    static bool read(const std::string &path, SourceBuffer &cache,
+                     std::string_view src, std::vector<Token> &tokens,
+                     AstArena &arena, std::vector<Stmt *> &stmts,
+                     uint base_global_num,
+                     const std::unordered_map<std::string, uint> &global_slots,
+                     std::vector<std::pair<std::string_view, uint>> &globals,
+                     bool is_module);
+
+  public:
+    // Return the cache file of a script
+    static std::string path_of(const std::string &script_path);
+
+    static uint64_t hash_source(std::string_view src);
+
+    // Number of globals of the interpreter, to be passed to save before the
+    // program is resolved
+    static uint global_num(const AstInterpreter &interpreter);
+
+    // Write the program of src resolved for the interpreter, which had
+    // base_global_num globals before. Return false when the cache cannot be
+    // written.
+    static bool save(const std::string &path, std::string_view src,
+                     const std::vector<Stmt *> &stmts,
+                     const AstInterpreter &interpreter, uint base_global_num);
+
+    // Load the program of src from the cache file into tokens and arena, and
+    // declare its globals in the interpreter as the resolver would. Return
+    // false, declaring nothing, when the file is missing, stale or corrupted.
+    static bool load(const std::string &path, std::string_view src,
+                     std::vector<Token> &tokens, AstArena &arena,
+                     std::vector<Stmt *> &stmts, AstInterpreter &interpreter);
+
+    // Same for a module, which is resolved against the builtins only
+    static bool save_module(const std::string &path, const Module &module,
+                            const AstInterpreter &interpreter);
+    static bool load_module(const std::string &path, Module &module,
+                            const AstInterpreter &interpreter);
+};
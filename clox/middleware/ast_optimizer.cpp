@@ -0,0 +1,325 @@
+#include "clox/middleware/ast_optimizer.hpp"
+#include "clox/ast_interpreter/helper.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+
+OptimizerStats AstOptimizer::stats = {};
+
+// The visitors take const nodes, the optimizer rewrites the program it is
+// given
+template <typename T> static T &mutable_node(const T &node) {
+    return const_cast<T &>(node);
+}
+
+// Return the literal when the expr is one, its value is known
+static LiteralExpr *as_literal(Expr *expr) {
+    return dynamic_cast<LiteralExpr *>(expr);
+}
+
+AstOptimizer::AstOptimizer(std::shared_ptr<AstInterpreter> interpreter,
+                           AstArena &arena)
+    : interpreter(interpreter), arena(&arena) {}
+
+void AstOptimizer::optimize_program(std::vector<Stmt *> &stmts) {
+    uint size = 0;
+    optimize_stmts(stmts, size);
+}
+
+void AstOptimizer::print_stats(std::ostream &os) {
+    os << "[optimizer] folded exprs: " << stats.folded_exprs << std::endl;
+    os << "[optimizer] pruned branches: " << stats.pruned_branches
+       << std::endl;
+    os << "[optimizer] removed nodes: " << stats.removed_nodes << std::endl;
+}
+
+void AstOptimizer::set_result(Expr *expr, uint size) {
+    expr_result = expr;
+    result_size = size;
+}
+
+void AstOptimizer::set_result(Stmt *stmt, uint size) {
+    stmt_result = stmt;
+    result_size = size;
+}
+
+Expr *AstOptimizer::optimize(Expr *expr, uint &size) {
+    if (expr == nullptr) {
+        return nullptr;
+    }
+    expr->accept(*this);
+    size += result_size;
+    return expr_result;
+}
+
+Stmt *AstOptimizer::optimize(Stmt *stmt, uint &size) {
+    if (stmt == nullptr) {
+        return nullptr;
+    }
+    stmt->accept(*this);
+    size += result_size;
+    return stmt_result;
+}
+
+// A block is optimized in place, it is never replaced
+BlockStmt *AstOptimizer::optimize_block(BlockStmt *block, uint &size) {
+    optimize(static_cast<Stmt *>(block), size);
+    return block;
+}
+
+void AstOptimizer::optimize_stmts(std::vector<Stmt *> &stmts, uint &size) {
+    size_t kept_num = 0;
+    for (Stmt *stmt : stmts) {
+        Stmt *result = optimize(stmt, size);
+        if (result != nullptr) {
+            stmts[kept_num++] = result;
+        }
+    }
+    stmts.resize(kept_num);
+}
+
+void AstOptimizer::fold(Expr &expr, uint size) {
+    ExprVal value;
+    try {
+        value = interpreter->evaluate_expr(expr);
+    } catch (RuntimeException &) {
+        // The error is raised when the expr is executed
+        set_result(&expr, size);
+        return;
+    }
+
+    // The literal is referenced by the AST, it is pinned with it
+    if (value.is_string()) {
+        Heap::pin_for_ast(value.as<LoxString>());
+    }
+    stats.folded_exprs++;
+    stats.removed_nodes += size - 1;
+    set_result(arena->make<LiteralExpr>(value), 1);
+}
+
+void AstOptimizer::visit_expr_stmt(const ExprStmt &expr_stmt) {
+    uint size = 1;
+    auto &stmt = mutable_node(expr_stmt);
+    stmt.expr = optimize(stmt.expr, size);
+    set_result(&stmt, size);
+}
+
+void AstOptimizer::visit_assign_stmt(const AssignStmt &assign_stmt) {
+    uint size = 2;
+    auto &stmt = mutable_node(assign_stmt);
+    stmt.value = optimize(stmt.value, size);
+    set_result(&stmt, size);
+}
+
+void AstOptimizer::visit_var_decl(const VarDecl &var_decl) {
+    uint size = 1;
+    auto &stmt = mutable_node(var_decl);
+    stmt.initializer = optimize(stmt.initializer, size);
+    set_result(&stmt, size);
+}
+
+void AstOptimizer::visit_block_stmt(const BlockStmt &block_stmt,
+                                    Environment *) {
+    uint size = 1;
+    auto &block = mutable_node(block_stmt);
+    optimize_stmts(block.stmts, size);
+    // The increment, an assign stmt, is still the last stmt of a for loop
+    if (block.for_loop_increment != nullptr) {
+        block.for_loop_increment = block.stmts.back();
+    }
+    set_result(&block, size);
+}
+
+/*
+Branches whose condition is false are removed. The first branch whose
+condition is true becomes the else block, the branches after it and the else
+block are removed. An if without any branch left is replaced by its else
+block.
+*/
+void AstOptimizer::visit_if_stmt(const IfStmt &if_stmt) {
+    auto &stmt = mutable_node(if_stmt);
+    std::vector<Expr *> conditions;
+    std::vector<Stmt *> if_blocks;
+    uint size = 1;
+    Stmt *true_block = nullptr;
+    uint true_block_size = 0;
+
+    for (size_t i = 0; i < stmt.conditions.size(); ++i) {
+        uint condition_size = 0, block_size = 0;
+        Expr *condition = optimize(stmt.conditions[i], condition_size);
+        Stmt *block = optimize(stmt.if_blocks[i], block_size);
+
+        LiteralExpr *literal = as_literal(condition);
+        if (true_block != nullptr ||
+            (literal != nullptr && !cast_expr_val_to_bool(literal->value))) {
+            stats.pruned_branches++;
+            stats.removed_nodes += condition_size + block_size;
+        } else if (literal != nullptr) {
+            stats.removed_nodes += condition_size;
+            true_block = block;
+            true_block_size = block_size;
+        } else {
+            conditions.push_back(condition);
+            if_blocks.push_back(block);
+            size += condition_size + block_size;
+        }
+    }
+
+    if (true_block != nullptr) {
+        if (stmt.else_block != nullptr) {
+            uint else_size = 0;
+            optimize(stmt.else_block, else_size);
+            stats.pruned_branches++;
+            stats.removed_nodes += else_size;
+        }
+        stmt.else_block = true_block;
+        size += true_block_size;
+    } else {
+        stmt.else_block = optimize(stmt.else_block, size);
+    }
+    stmt.conditions = conditions;
+    stmt.if_blocks = if_blocks;
+
+    if (stmt.conditions.empty()) {
+        stats.removed_nodes++;
+        set_result(stmt.else_block, size - 1);
+        return;
+    }
+    set_result(&stmt, size);
+}
+
+// A while whose condition is false is removed, a true condition is dropped:
+// the engines run a while without condition until a break or a return
+void AstOptimizer::visit_while_stmt(const WhileStmt &while_stmt) {
+    auto &stmt = mutable_node(while_stmt);
+    uint condition_size = 0, size = 1;
+    stmt.condition = optimize(stmt.condition, condition_size);
+    stmt.body = optimize_block(stmt.body, size);
+
+    LiteralExpr *literal = as_literal(stmt.condition);
+    if (literal == nullptr) {
+        set_result(&stmt, size + condition_size);
+    } else if (cast_expr_val_to_bool(literal->value)) {
+        stats.removed_nodes += condition_size;
+        stmt.condition = nullptr;
+        set_result(&stmt, size);
+    } else {
+        stats.pruned_branches++;
+        stats.removed_nodes += size + condition_size;
+        set_result(static_cast<Stmt *>(nullptr), 0);
+    }
+}
+
+void AstOptimizer::visit_break_stmt(const BreakStmt &break_stmt) {
+    set_result(&mutable_node<Stmt>(break_stmt), 1);
+}
+
+void AstOptimizer::visit_continue_stmt(const ContinueStmt &continue_stmt) {
+    set_result(&mutable_node<Stmt>(continue_stmt), 1);
+}
+
+void AstOptimizer::visit_function_decl(FunctionDecl &function_decl) {
+    uint size = 1 + function_decl.params.size();
+    optimize_block(function_decl.body, size);
+    set_result(&function_decl, size);
+}
+
+void AstOptimizer::visit_class_decl(const ClassDecl &class_decl) {
+    uint size = class_decl.superclass == nullptr ? 1 : 2;
+    for (FunctionDecl *method : class_decl.methods) {
+        optimize(method, size);
+    }
+    set_result(&mutable_node<Stmt>(class_decl), size);
+}
+
+void AstOptimizer::visit_return_stmt(const ReturnStmt &return_stmt) {
+    uint size = 1;
+    auto &stmt = mutable_node(return_stmt);
+    stmt.expr = optimize(stmt.expr, size);
+    set_result(&stmt, size);
+}
+
+void AstOptimizer::visit_set_class_field(const SetClassFieldStmt &set_stmt) {
+    uint size = 1;
+    auto &stmt = mutable_node(set_stmt);
+    stmt.lox_instance = optimize(stmt.lox_instance, size);
+    stmt.value = optimize(stmt.value, size);
+    set_result(&stmt, size);
+}
+
+void AstOptimizer::visit_import_stmt(const ImportStmt &import_stmt) {
+    set_result(&mutable_node<Stmt>(import_stmt), 1);
+}
+
+ExprVal AstOptimizer::visit_identifier(const IdentifierExpr &identifier) {
+    set_result(&mutable_node<Expr>(identifier), 1);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_this(const ThisExpr &this_expr) {
+    set_result(&mutable_node<Expr>(this_expr), 1);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_super(const SuperExpr &super_expr) {
+    set_result(&mutable_node<Expr>(super_expr), 2);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_literal(const LiteralExpr &literal) {
+    set_result(&mutable_node<Expr>(literal), 1);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_grouping(const GroupExpr &group) {
+    uint size = 0;
+    Expr *expr = optimize(group.expr, size);
+    stats.removed_nodes++;
+    set_result(expr, size);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_func_call(const FuncCallExpr &func_call) {
+    uint size = 1;
+    auto &expr = mutable_node(func_call);
+    expr.callee = optimize(expr.callee, size);
+    expr.method_callee = dynamic_cast<GetClassFieldExpr *>(expr.callee);
+    for (auto &arg : expr.args) {
+        arg = optimize(arg, size);
+    }
+    set_result(&expr, size);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_get_class_field(const GetClassFieldExpr &get) {
+    uint size = 1;
+    auto &expr = mutable_node(get);
+    expr.lox_instance = optimize(expr.lox_instance, size);
+    set_result(&expr, size);
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_unary(const UnaryExpr &unary) {
+    uint size = 1;
+    auto &expr = mutable_node(unary);
+    expr.operand = optimize(expr.operand, size);
+    if (as_literal(expr.operand) != nullptr) {
+        fold(expr, size);
+    } else {
+        set_result(&expr, size);
+    }
+    return NIL;
+}
+
+ExprVal AstOptimizer::visit_binary(const BinaryExpr &binary) {
+    uint size = 1;
+    auto &expr = mutable_node(binary);
+    expr.left_operand = optimize(expr.left_operand, size);
+    expr.right_operand = optimize(expr.right_operand, size);
+    if (as_literal(expr.left_operand) != nullptr &&
+        as_literal(expr.right_operand) != nullptr) {
+        fold(expr, size);
+    } else {
+        set_result(&expr, size);
+    }
+    return NIL;
+}
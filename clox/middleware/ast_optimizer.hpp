@@ -0,0 +1,85 @@
+#pragma once
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/parser/ast_arena.hpp"
+#include "clox/parser/expr.hpp"
+#include "clox/parser/stmt.hpp"
+#include <memory>
+#include <ostream>
+#include <vector>
+
+struct OptimizerStats {
+    uint folded_exprs = 0;
+    uint pruned_branches = 0;
+    uint removed_nodes = 0;
+};
+
+// Simplify a resolved program before it is executed:
+// - unary and binary exprs whose operands are literals are folded into a
+//   literal, groups are replaced by the expr they wrap
+// - the branches of an if whose condition is a literal are pruned, a while
+//   whose condition is false is dropped and a true condition (like the one
+//   of a for loop without condition) is removed, the loop runs until a break
+// Nodes are rewritten in place, the resolver annotations of the kept nodes
+// stay valid. Exprs are folded by the AstInterpreter so that a folded value
+// is exactly the one computed at run time, an expr raising a runtime error
+// is kept.
+class AstOptimizer : public IExprVisitor, public IStmtVisitor {
+  private:
+    // Evaluate the exprs to fold
+    std::shared_ptr<AstInterpreter> interpreter = nullptr;
+    // Own the literals created by folding
+    AstArena *arena;
+    // Set by each visit: the node replacing the visited one (nullptr when
+    // it is removed) and the number of nodes of its subtree
+    Expr *expr_result = nullptr;
+    Stmt *stmt_result = nullptr;
+    uint result_size = 0;
+
+    void set_result(Expr *expr, uint size);
+    void set_result(Stmt *stmt, uint size);
+    // Optimize the node and add the number of nodes of the result to size
+    Expr *optimize(Expr *expr, uint &size);
+    Stmt *optimize(Stmt *stmt, uint &size);
+    BlockStmt *optimize_block(BlockStmt *block, uint &size);
+    // Optimize the stmts, erasing the removed ones
+    void optimize_stmts(std::vector<Stmt *> &stmts, uint &size);
+    // Replace the expr of size nodes by the literal it evaluates to, when it
+    // can be
+    void fold(Expr &expr, uint size);
+
+    void visit_expr_stmt(const ExprStmt &) override;
+    void visit_assign_stmt(const AssignStmt &) override;
+    void visit_var_decl(const VarDecl &) override;
+    void visit_block_stmt(const BlockStmt &,
+                          Environment *block_env = nullptr) override;
+    void visit_if_stmt(const IfStmt &) override;
+    void visit_while_stmt(const WhileStmt &) override;
+    void visit_break_stmt(const BreakStmt &) override;
+    void visit_continue_stmt(const ContinueStmt &) override;
+    void visit_function_decl(FunctionDecl &) override;
+    void visit_class_decl(const ClassDecl &) override;
+    void visit_return_stmt(const ReturnStmt &) override;
+    void visit_set_class_field(const SetClassFieldStmt &) override;
+    void visit_import_stmt(const ImportStmt &) override;
+
+    ExprVal visit_identifier(const IdentifierExpr &) override;
+    ExprVal visit_this(const ThisExpr &) override;
+    ExprVal visit_super(const SuperExpr &) override;
+    ExprVal visit_literal(const LiteralExpr &) override;
+    ExprVal visit_grouping(const GroupExpr &) override;
+    ExprVal visit_func_call(const FuncCallExpr &) override;
+    ExprVal visit_get_class_field(const GetClassFieldExpr &) override;
+    ExprVal visit_unary(const UnaryExpr &) override;
+    ExprVal visit_binary(const BinaryExpr &) override;
+
+  public:
+    // Totals of every program optimized
+    static OptimizerStats stats;
+
+    AstOptimizer(std::shared_ptr<AstInterpreter> interpreter,
+                 AstArena &arena);
+
+    void optimize_program(std::vector<Stmt *> &stmts);
+
+    static void print_stats(std::ostream &os);
+};
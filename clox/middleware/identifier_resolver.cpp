@@ -2,35 +2,85 @@
 #include "clox/common/constants.hpp"
 #include "clox/common/error_manager.hpp"
 #include "clox/common/token.hpp"
+#include "clox/middleware/module_loader.hpp"
 #include "clox/parser/expr.hpp"
 #include "clox/parser/stmt.hpp"
 #include "clox/utils/helper.hpp"
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
 IdentifierResolver::IdentifierResolver(
-    std::shared_ptr<AstInterpreter> interpreter)
-    : interpreter(interpreter) {
+    std::shared_ptr<AstInterpreter> interpreter, std::string base_dir)
+    : interpreter(interpreter), base_dir(std::move(base_dir)) {
     scopes.emplace_back();
-    for (const auto &identifier : interpreter->global_env->identifier_table) {
-        scopes.back()[identifier.first] = true;
+    for (const auto &[name, slot] : interpreter->global_slots) {
+        scopes.back().identifiers[name] = {true, slot};
     }
+    scopes.back().slot_num = interpreter->global_slots.size();
 };
 
 void IdentifierResolver::resolve_program(
-    const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    const std::vector<Stmt *> &stmts) {
     resolve_stmts(stmts);
+    resolve_late_bound_identifiers();
+
+    // Keep the globals declared by this program for the next program run by
+    // the same interpreter (interactive mode, streaming mode). They are
+    // renamed to the interpreter names, which outlive the program source.
+    auto &globals = scopes.front();
+    for (std::string_view name : new_globals) {
+        ScopeIdentifier identifier = globals.identifiers[name];
+        globals.identifiers.erase(name);
+        if (!ErrorManager::had_static_err) {
+            auto [global, _] = interpreter->global_slots.insert_or_assign(
+                std::string(name), identifier.slot);
+            globals.identifiers[global->first] = identifier;
+        }
+    }
+    // The slots of a rejected program are reused
+    globals.slot_num = interpreter->global_slots.size();
+    new_globals.clear();
+    resolve_pending_globals();
+}
+
+void IdentifierResolver::resolve_module(const std::vector<Stmt *> &stmts) {
+    auto &globals = scopes.front().identifiers;
+    for (auto it = globals.begin(); it != globals.end();) {
+        if (it->second.slot < interpreter->builtin_num) {
+            ++it;
+        } else {
+            it = globals.erase(it);
+        }
+    }
+    addScope();
+    top_level_scope_num = scopes.size();
+    resolve_stmts(stmts);
+    resolve_late_bound_identifiers();
+    late_bound_identifiers.clear();
 }
 
 void IdentifierResolver::resolve_stmts(
-    const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    const std::vector<Stmt *> &stmts) {
+    size_t scope_num = scopes.size();
+    size_t function_num = functions.size();
+    ResolveFuncType func_type = current_func_type;
+    ResolveClassType class_type = current_class_type;
+    ResolveLoopType loop_type = current_loop_type;
     for (auto &stmt : stmts) {
         try {
             stmt->accept(*this);
         } catch (StaticException &err) {
             ErrorManager::handle_static_err(err);
+            // Leave the scopes opened by the stmt, the resolver is reused
+            // by the next stmts and programs
+            scopes.resize(scope_num);
+            functions.resize(function_num);
+            current_func_type = func_type;
+            current_class_type = class_type;
+            current_loop_type = loop_type;
             continue;
         }
     }
@@ -51,19 +101,40 @@ void IdentifierResolver::visit_var_decl(const VarDecl &var_decl_stmt) {
        accessed in its initializer. var a = a;
         => raise error
     */
-    declare_identifier(*var_decl_stmt.var_name);
+    var_decl_stmt.slot = declare_identifier(*var_decl_stmt.var_name,
+                                            &var_decl_stmt.is_captured);
     if (var_decl_stmt.initializer != nullptr) {
         var_decl_stmt.initializer->accept(*this);
     }
     define_identifier(*var_decl_stmt.var_name);
 }
 
-void IdentifierResolver::visit_block_stmt(
-    const BlockStmt &block_stmt, std::shared_ptr<Environment> block_env) {
+// Return whether the stmt binds an identifier in the scope it belongs to
+static bool is_declaration(const Stmt *stmt) {
+    return dynamic_cast<const VarDecl *>(stmt) != nullptr ||
+           dynamic_cast<const FunctionDecl *>(stmt) != nullptr ||
+           dynamic_cast<const ClassDecl *>(stmt) != nullptr ||
+           dynamic_cast<const ImportStmt *>(stmt) != nullptr;
+}
+
+void IdentifierResolver::visit_block_stmt(const BlockStmt &block_stmt,
+                                          Environment *) {
+    // A block declaring nothing has no scope (slot_num is 0), it runs in the
+    // env of the enclosing scope
+    if (std::none_of(block_stmt.stmts.begin(), block_stmt.stmts.end(),
+                     is_declaration)) {
+        for (auto stmt : block_stmt.stmts) {
+            stmt->accept(*this);
+        }
+        block_stmt.slot_num = 0;
+        return;
+    }
+
     addScope();
     for (auto stmt : block_stmt.stmts) {
         stmt->accept(*this);
     }
+    block_stmt.slot_num = scopes.back().slot_num;
     closeScope();
 }
 
@@ -111,7 +182,8 @@ void IdentifierResolver::visit_function_decl(FunctionDecl &func_decl_stmt) {
 }
 
 void IdentifierResolver::visit_class_decl(const ClassDecl &class_decl_stmt) {
-    declare_identifier(*class_decl_stmt.name);
+    class_decl_stmt.slot = declare_identifier(*class_decl_stmt.name,
+                                              &class_decl_stmt.is_captured);
     define_identifier(*class_decl_stmt.name);
 
     if (class_decl_stmt.superclass != nullptr) {
@@ -127,11 +199,11 @@ void IdentifierResolver::visit_class_decl(const ClassDecl &class_decl_stmt) {
     current_class_type = ResolveClassType::CLASS;
 
     addScope(); // class scope
-    scopes.back()["this"] = true;
     if (class_decl_stmt.superclass != nullptr) {
         current_class_type = ResolveClassType::SUBCLASS;
-        scopes.back()["super"] = true;
+        scopes.back().identifiers["super"] = {true, SUPER_SLOT, true};
     }
+    scopes.back().slot_num = CLASS_ENV_SLOT_NUM;
     for (auto method : class_decl_stmt.methods) {
         bool is_initializer =
             method->name->lexeme == class_decl_stmt.name->lexeme;
@@ -151,16 +223,30 @@ void IdentifierResolver::resolve_function(const FunctionDecl &func_decl_stmt,
     ResolveFuncType enclosing_func_type = current_func_type;
     current_func_type = func_type;
 
-    declare_identifier(*func_decl_stmt.name);
-    define_identifier(*func_decl_stmt.name);
+    // Methods are looked up through their class, they are not declared in
+    // the class scope.
+    if (func_type == ResolveFuncType::FUNCTION) {
+        func_decl_stmt.slot = declare_identifier(*func_decl_stmt.name,
+                                                 &func_decl_stmt.is_captured);
+        define_identifier(*func_decl_stmt.name);
+    }
 
     addScope();
+    func_decl_stmt.captures.clear();
+    functions.push_back({&func_decl_stmt, scopes.size() - 1});
+    // The receiver of a method call is stored in the env of the call
+    if (func_type == ResolveFuncType::METHOD ||
+        func_type == ResolveFuncType::INITIALIZER) {
+        add_identifier("this", true, nullptr);
+    }
     for (auto param : func_decl_stmt.params) {
-        define_identifier(*param->token);
+        param->slot =
+            add_identifier(param->token->lexeme, true, &param->is_cell);
     }
-    std::shared_ptr<BlockStmt> func_body =
-        std::dynamic_pointer_cast<BlockStmt>(func_decl_stmt.body);
+    BlockStmt *func_body = func_decl_stmt.body;
     resolve_stmts(func_body->stmts);
+    func_body->slot_num = scopes.back().slot_num;
+    functions.pop_back();
     closeScope();
 
     current_func_type = enclosing_func_type;
@@ -175,7 +261,15 @@ void IdentifierResolver::visit_return_stmt(const ReturnStmt &return_stmt) {
         throw StaticException(return_stmt.return_kw,
                               "Cannot return inside the class initializer.");
     }
-    return_stmt.expr->accept(*this);
+    if (return_stmt.expr != nullptr) {
+        return_stmt.expr->accept(*this);
+        // init returns its instance, so its frame outlives the returned call
+        bool is_init = current_func_type == ResolveFuncType::METHOD &&
+                       functions.back().decl->name->lexeme == INIT_METHOD;
+        return_stmt.is_tail_call =
+            !is_init &&
+            dynamic_cast<FuncCallExpr *>(return_stmt.expr) != nullptr;
+    }
 }
 
 void IdentifierResolver::visit_set_class_field(
@@ -186,8 +280,9 @@ void IdentifierResolver::visit_set_class_field(
 
 ExprVal
 IdentifierResolver::visit_identifier(const IdentifierExpr &identifier_expr) {
-    if (scopes.back().count(identifier_expr.token->lexeme) != 0 and
-        scopes.back()[identifier_expr.token->lexeme] == false) {
+    auto &identifiers = scopes.back().identifiers;
+    auto identifier = identifiers.find(identifier_expr.token->lexeme);
+    if (identifier != identifiers.end() and !identifier->second.is_defined) {
         throw StaticException(
             identifier_expr.token,
             "Can't read local variable in its own initializer.");
@@ -217,21 +312,172 @@ ExprVal IdentifierResolver::visit_super(const SuperExpr &super_expr) {
     }
 
     resolve_identifier(super_expr);
+    bind_identifier("this", super_expr.this_depth, super_expr.this_slot,
+                    nullptr);
     return NIL;
 }
 
 void IdentifierResolver::resolve_identifier(
     const IdentifierExpr &identifier_expr) {
-    for (int i = scopes.size() - 1; i >= 0; --i) {
-        if (scopes[i].count(identifier_expr.token->lexeme) != 0) {
-            interpreter->update_identifier_scope_depth_map(
-                identifier_expr, scopes.size() - 1 - i);
-            return;
+    if (!bind_identifier(identifier_expr.token->lexeme, identifier_expr.depth,
+                         identifier_expr.slot, &identifier_expr.is_cell)) {
+        late_bound_identifiers.push_back(
+            {&identifier_expr, top_level_depth(), !functions.empty()});
+    }
+}
+
+/*
+The env of a function call is nested in the top level env, not in the env the
+function is declared in. A function reads the identifiers of the scopes of
+the enclosing functions through its upvalues, which the closure captures
+when it is created.
+*/
+bool IdentifierResolver::bind_identifier(std::string_view name, int &depth,
+                                         uint &slot, bool *is_cell) {
+    size_t scope_num = scopes.size();
+    while (scope_num > 0 &&
+           scopes[scope_num - 1].identifiers.count(name) == 0) {
+        --scope_num;
+    }
+    if (scope_num == 0) {
+        return false;
+    }
+
+    size_t i = scope_num - 1;
+    ScopeIdentifier &identifier = scopes[i].identifiers.find(name)->second;
+    slot = identifier.slot;
+    if (i == 0 || i == top_level_scope_num - 1) {
+        depth = i == 0 ? GLOBAL_DEPTH : top_level_depth();
+        // Only the imported variables and the ones of a module are cells
+        if (is_cell != nullptr) {
+            *is_cell = identifier.is_captured;
+        }
+    } else if (functions.empty() || i >= functions.back().scope_index) {
+        depth = scopes.size() - 1 - i;
+        add_cell_flag(identifier, is_cell);
+    } else {
+        depth = UPVALUE_DEPTH;
+        slot = capture(functions.size() - 1, i, identifier);
+        add_cell_flag(identifier, is_cell);
+    }
+    return true;
+}
+
+uint IdentifierResolver::capture(size_t function_index, size_t scope_index,
+                                 ScopeIdentifier &identifier) {
+    const ResolverFunction &function = functions[function_index];
+    Capture capture;
+    if (function_index == 0 ||
+        scope_index >= functions[function_index - 1].scope_index) {
+        // The identifier is in the env the closure is created in or above it
+        capture = {true, uint(function.scope_index - 1 - scope_index),
+                   identifier.slot};
+        if (!identifier.is_immutable && !identifier.is_captured) {
+            identifier.is_captured = true;
+            for (bool *is_cell : identifier.cell_flags) {
+                *is_cell = true;
+            }
+            identifier.cell_flags.clear();
+        }
+    } else {
+        capture = {false, 0,
+                   this->capture(function_index - 1, scope_index, identifier)};
+    }
+
+    auto &captures = function.decl->captures;
+    for (uint j = 0; j < captures.size(); ++j) {
+        if (captures[j].is_local == capture.is_local &&
+            captures[j].depth == capture.depth &&
+            captures[j].slot == capture.slot) {
+            return j;
         }
     }
+    captures.push_back(capture);
+    return captures.size() - 1;
 }
 
-ExprVal IdentifierResolver::visit_literal(const LiteralExpr &literal_expr) {
+void IdentifierResolver::add_cell_flag(ScopeIdentifier &identifier,
+                                       bool *is_cell) {
+    if (is_cell == nullptr || identifier.is_immutable) {
+        return;
+    }
+    if (identifier.is_captured) {
+        *is_cell = true;
+    } else {
+        identifier.cell_flags.push_back(is_cell);
+    }
+}
+
+int IdentifierResolver::top_level_depth() const {
+    size_t top_level = top_level_scope_num - 1;
+    if (top_level == 0) {
+        return GLOBAL_DEPTH;
+    }
+    if (functions.empty()) {
+        return scopes.size() - 1 - top_level;
+    }
+    // One level above the env of the innermost call
+    return scopes.size() - functions.back().scope_index;
+}
+
+void IdentifierResolver::resolve_late_bound_identifiers() {
+    auto &identifiers = scopes[top_level_scope_num - 1].identifiers;
+    auto is_bound = [&](const LateBoundIdentifier &late_bound) {
+        auto identifier =
+            identifiers.find(late_bound.identifier->token->lexeme);
+        if (identifier == identifiers.end()) {
+            return false;
+        }
+        late_bound.identifier->depth = late_bound.depth;
+        late_bound.identifier->slot = identifier->second.slot;
+        late_bound.identifier->is_cell = identifier->second.is_captured;
+        return true;
+    };
+    late_bound_identifiers.erase(
+        std::remove_if(late_bound_identifiers.begin(),
+                       late_bound_identifiers.end(), is_bound),
+        late_bound_identifiers.end());
+}
+
+/*
+A function may reference a global declared by a later program. The
+identifiers read outside of a function are evaluated before, the others stay
+pending while their AST is alive and are reported when read unresolved.
+*/
+void IdentifierResolver::resolve_pending_globals() {
+    if (!ErrorManager::had_static_err) {
+        for (auto [identifier_expr, _, is_in_function] :
+             late_bound_identifiers) {
+            if (is_in_function) {
+                pending_globals.push_back({identifier_expr,
+                                           interpreter->ast_owner,
+                                           interpreter->ast_owner != nullptr});
+            }
+        }
+    }
+    late_bound_identifiers.clear();
+
+    auto &globals = scopes.front().identifiers;
+    auto is_bound_or_released = [&](const PendingGlobal &pending) {
+        if (pending.is_owned && pending.ast_owner.expired()) {
+            return true;
+        }
+        auto global = globals.find(pending.identifier->token->lexeme);
+        if (global == globals.end()) {
+            return false;
+        }
+        pending.identifier->depth = GLOBAL_DEPTH;
+        pending.identifier->slot = global->second.slot;
+        pending.identifier->is_cell = global->second.is_captured;
+        return true;
+    };
+    pending_globals.erase(std::remove_if(pending_globals.begin(),
+                                         pending_globals.end(),
+                                         is_bound_or_released),
+                          pending_globals.end());
+}
+
+ExprVal IdentifierResolver::visit_literal(const LiteralExpr &) {
     return NIL;
 }
 
@@ -266,8 +512,41 @@ ExprVal IdentifierResolver::visit_binary(const BinaryExpr &binary_expr) {
     return NIL;
 }
 
+// Bind the exports of the module in the top level scope, to the cells of the
+// module variables. Importing the module again binds the same cells.
+void IdentifierResolver::visit_import_stmt(const ImportStmt &import_stmt) {
+    if (scopes.size() != top_level_scope_num) {
+        throw StaticException(import_stmt.import_kw,
+                              "Can only import a module at the top level.");
+    }
+    const Module &module =
+        ModuleLoader::load(*import_stmt.path, base_dir, interpreter);
+    import_stmt.module = &module;
+    import_stmt.slots.clear();
+    for (const Export &name : module.exports) {
+        auto &identifiers = scopes.back().identifiers;
+        auto declared = identifiers.find(name.name);
+        if (declared != identifiers.end() &&
+            declared->second.module == &module) {
+            import_stmt.slots.push_back(declared->second.slot);
+            continue;
+        }
+        if (declared != identifiers.end()) {
+            throw StaticException(import_stmt.path,
+                                  "Variable with name " +
+                                      std::string(name.name) +
+                                      " already declared in this scope.");
+        }
+        uint slot = add_identifier(name.name, true, nullptr);
+        ScopeIdentifier &identifier = identifiers[name.name];
+        identifier.is_captured = true;
+        identifier.module = &module;
+        import_stmt.slots.push_back(slot);
+    }
+}
+
 void IdentifierResolver::addScope() {
-    scopes.push_back(std::unordered_map<std::string, bool>{});
+    scopes.push_back(ResolverScope{});
 }
 
 void IdentifierResolver::closeScope() { scopes.pop_back(); }
@@ -277,19 +556,42 @@ Adds identifier to the innermost scope so that it shadows any outer one and
 so that we know the variable exists. We mark it as “not ready yet” by
 binding its name to false in the scope map.
 */
-void IdentifierResolver::declare_identifier(Token &identifier_name) {
-    if (scopes.back().count(identifier_name.lexeme) != 0) {
+uint IdentifierResolver::declare_identifier(const Token &identifier_name,
+                                            bool *is_cell) {
+    if (scopes.back().identifiers.count(identifier_name.lexeme) != 0) {
         std::cout << "Huhu" << std::endl;
-        throw StaticException(
-            std::shared_ptr<Token>(&identifier_name,
-                                   smart_pointer_no_op_deleter),
-            "Variable with name " + identifier_name.lexeme +
-                " already declared in this scope.");
+        throw StaticException(&identifier_name,
+                              "Variable with name " +
+                                  std::string(identifier_name.lexeme) +
+                                  " already declared in this scope.");
     }
-    scopes.back()[identifier_name.lexeme] = false;
+    return add_identifier(identifier_name.lexeme, false, is_cell);
 }
 
 // Mark identifier as resolved
 void IdentifierResolver::define_identifier(const Token &identifier_name) {
-    scopes.back()[identifier_name.lexeme] = true;
+    scopes.back().identifiers[identifier_name.lexeme].is_defined = true;
+}
+
+// Allocate the next slot of the innermost scope to the identifier
+uint IdentifierResolver::add_identifier(std::string_view name,
+                                        bool is_defined, bool *is_cell) {
+    uint slot = scopes.back().slot_num++;
+    ScopeIdentifier &identifier = scopes.back().identifiers[name];
+    identifier = {is_defined, slot, is_cell == nullptr};
+    // The top level identifiers are read from the top level env, they are
+    // never captured. The ones of a module are cells shared with the scopes
+    // importing them.
+    if (scopes.size() > top_level_scope_num) {
+        add_cell_flag(identifier, is_cell);
+    } else if (top_level_scope_num > 1) {
+        identifier.is_captured = true;
+        if (is_cell != nullptr) {
+            *is_cell = true;
+        }
+    }
+    if (scopes.size() == 1) {
+        new_globals.push_back(name);
+    }
+    return slot;
 }
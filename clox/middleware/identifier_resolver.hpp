@@ -1,7 +1,10 @@
+#pragma once
 #include "clox/ast_interpreter/ast_interpreter.hpp"
 #include "clox/parser/expr.hpp"
 #include "clox/parser/stmt.hpp"
 #include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
 enum class ResolveFuncType {
@@ -24,15 +27,74 @@ enum class ResolveLoopType {
     LOOP,
 };
 
+struct ScopeIdentifier {
+    // false between the declaration and the end of the initializer
+    bool is_defined;
+    uint slot;
+    // "this" and "super" cannot be assigned, closures capture their value
+    bool is_immutable = false;
+    // Set once a closure captures the variable. Until then, the is_cell flags
+    // of its declaration and references, set when it is captured.
+    bool is_captured = false;
+    std::vector<bool *> cell_flags = {};
+    // Module the variable is imported from, the identifier is then bound to
+    // the cell of the module variable
+    const Module *module = nullptr;
+};
+
+class ResolverScope {
+  public:
+    // Names view the source or the interpreter global names
+    std::unordered_map<std::string_view, ScopeIdentifier> identifiers = {};
+    // Number of slots the env of this scope needs
+    uint slot_num = 0;
+};
+
+// Identifier not found in the scopes opened when it was resolved, with the
+// depth of the top level env from the scope it is referenced in
+struct LateBoundIdentifier {
+    const IdentifierExpr *identifier;
+    int depth;
+    bool is_in_function;
+};
+
+// Global referenced by a function of a previous program (interactive mode,
+// streaming mode), bound once a later program declares it
+struct PendingGlobal {
+    const IdentifierExpr *identifier;
+    // Owner of the AST of the identifier, see AstInterpreter::ast_owner.
+    // Unused when the AST is kept until exit.
+    std::weak_ptr<const void> ast_owner;
+    bool is_owned;
+};
+
+// Function being resolved and the index of the scope of its params
+struct ResolverFunction {
+    const FunctionDecl *decl;
+    size_t scope_index;
+};
+
 class IdentifierResolver : public IExprVisitor, public IStmtVisitor {
   private:
     std::shared_ptr<AstInterpreter> interpreter = nullptr;
-    std::vector<std::unordered_map<std::string, bool>> scopes = {};
+    std::vector<ResolverScope> scopes = {};
+    // Enclosing functions of the current scope, the innermost last
+    std::vector<ResolverFunction> functions = {};
+    // Globals declared since the last resolve_program
+    std::vector<std::string_view> new_globals = {};
+    // Identifiers resolved once the whole program is, as a function may
+    // reference a top level declaration which follows it
+    std::vector<LateBoundIdentifier> late_bound_identifiers = {};
+    std::vector<PendingGlobal> pending_globals = {};
+    // Directory the imported paths are relative to
+    std::string base_dir;
+    // Imports are only allowed in the scope of the program or module
+    size_t top_level_scope_num = 1;
     ResolveFuncType current_func_type = ResolveFuncType::NONE;
     ResolveClassType current_class_type = ResolveClassType::NONE;
     ResolveLoopType current_loop_type = ResolveLoopType::NONE;
 
-    void resolve_stmts(const std::vector<std::shared_ptr<Stmt>> &stmts);
+    void resolve_stmts(const std::vector<Stmt *> &stmts);
 
     void visit_expr_stmt(const ExprStmt &) override;
 
@@ -42,7 +104,7 @@ class IdentifierResolver : public IExprVisitor, public IStmtVisitor {
 
     void
     visit_block_stmt(const BlockStmt &,
-                     std::shared_ptr<Environment> block_env = nullptr) override;
+                     Environment *block_env = nullptr) override;
 
     void visit_if_stmt(const IfStmt &) override;
 
@@ -60,6 +122,8 @@ class IdentifierResolver : public IExprVisitor, public IStmtVisitor {
 
     void visit_set_class_field(const SetClassFieldStmt &) override;
 
+    void visit_import_stmt(const ImportStmt &) override;
+
     ExprVal visit_identifier(const IdentifierExpr &) override;
 
     ExprVal visit_this(const ThisExpr &) override;
@@ -81,14 +145,39 @@ class IdentifierResolver : public IExprVisitor, public IStmtVisitor {
     void addScope();
     void closeScope();
 
-    void declare_identifier(Token &identifier_name);
+    // is_cell is the flag of the declaration set when the identifier is
+    // captured, nullptr for an immutable identifier
+    uint declare_identifier(const Token &identifier_name, bool *is_cell);
     void define_identifier(const Token &var_name);
+    uint add_identifier(std::string_view name, bool is_defined,
+                        bool *is_cell);
 
     void resolve_identifier(const IdentifierExpr &);
+    // Set the depth and slot of the identifier named name referenced in the
+    // current scope. Return false when it is not declared yet.
+    bool bind_identifier(std::string_view name, int &depth, uint &slot,
+                         bool *is_cell);
+    // Capture the identifier of scope_index in functions[function_index] and
+    // the functions between them, return the upvalue index in the function
+    uint capture(size_t function_index, size_t scope_index,
+                 ScopeIdentifier &identifier);
+    void add_cell_flag(ScopeIdentifier &identifier, bool *is_cell);
+    // Depth of the top level env from the current scope
+    int top_level_depth() const;
+    // Resolve the late bound identifiers declared in the top level scope
+    void resolve_late_bound_identifiers();
+    // Keep the late bound identifiers of the functions of the program which
+    // are still unresolved, bind the pending ones now declared
+    void resolve_pending_globals();
     void resolve_function(const FunctionDecl &, ResolveFuncType);
 
   public:
-    IdentifierResolver(std::shared_ptr<AstInterpreter> interpreter);
+    IdentifierResolver(std::shared_ptr<AstInterpreter> interpreter,
+                       std::string base_dir = "");
+
+    void resolve_program(const std::vector<Stmt *> &stmts);
 
-    void resolve_program(const std::vector<std::shared_ptr<Stmt>> &stmts);
+    // Resolve the stmts of a module in the module scope, nested in the scope
+    // of the builtins. Called once on a new resolver.
+    void resolve_module(const std::vector<Stmt *> &stmts);
 };
\ No newline at end of file
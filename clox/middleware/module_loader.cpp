@@ -0,0 +1,115 @@
+#include "clox/middleware/module_loader.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/middleware/ast_cache.hpp"
+#include "clox/middleware/ast_optimizer.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+std::unordered_map<std::string, std::unique_ptr<Module>> ModuleLoader::modules;
+bool ModuleLoader::use_cache = false;
+bool ModuleLoader::use_optimizer = false;
+
+// Module caches are resolved differently from the caches of the scripts
+static std::string cache_path_of(const Module &module) {
+    return AstCache::path_of(module.path + ".module");
+}
+
+const Module &ModuleLoader::load(const Token &path,
+                                 const std::string &base_dir,
+                                 std::shared_ptr<AstInterpreter> interpreter) {
+    const std::string &relative_path = path.literal.as<LoxString>()->str;
+    std::error_code error;
+    std::string module_path =
+        std::filesystem::weakly_canonical(
+            std::filesystem::path(base_dir) / relative_path, error)
+            .string();
+
+    auto it = modules.find(module_path);
+    if (it != modules.end()) {
+        const Module &module = *it->second;
+        if (!module.is_resolved) {
+            throw StaticException(&path, "Circular import of module " +
+                                             relative_path);
+        }
+        if (module.had_static_err) {
+            throw StaticException(&path,
+                                  "Cannot import module " + relative_path);
+        }
+        return module;
+    }
+
+    auto loaded_module = std::make_unique<Module>();
+    Module &module = *loaded_module;
+    module.path = module_path;
+    if (error || !module.source.load_file(module.path)) {
+        throw StaticException(&path, "Unable to open module " + relative_path);
+    }
+    modules[module.path] = std::move(loaded_module);
+
+    // The importing program keeps its own error state, the module keeps its
+    // AST and so its pins until exit
+    bool had_static_err = ErrorManager::had_static_err;
+    ErrorManager::had_static_err = false;
+    std::vector<LoxObject *> *importer_pins =
+        std::exchange(Heap::ast_pins, nullptr);
+    if (!use_cache ||
+        !AstCache::load_module(cache_path_of(module), module, *interpreter)) {
+        module.tokens = Scanner(module.source.view()).scan_tokens();
+        module.stmts = Parser(module.tokens, module.arena).parse_program();
+        if (!ErrorManager::had_static_err) {
+            std::string module_dir =
+                std::filesystem::path(module.path).parent_path().string();
+            IdentifierResolver{interpreter, module_dir}.resolve_module(
+                module.stmts);
+        }
+        if (use_cache && !ErrorManager::had_static_err) {
+            AstCache::save_module(cache_path_of(module), module, *interpreter);
+        }
+    }
+    if (use_optimizer && !ErrorManager::had_static_err) {
+        AstOptimizer(interpreter, module.arena).optimize_program(module.stmts);
+    }
+    Heap::ast_pins = importer_pins;
+    load_exports(module);
+    module.had_static_err = ErrorManager::had_static_err;
+    module.is_resolved = true;
+    ErrorManager::had_static_err = had_static_err;
+
+    if (module.had_static_err) {
+        throw StaticException(&path, "Cannot import module " + relative_path);
+    }
+    return module;
+}
+
+// The declarations and imports of the top level are the only ones of the
+// module scope, the others are in blocks
+void ModuleLoader::load_exports(Module &module) {
+    for (Stmt *stmt : module.stmts) {
+        if (auto var_decl = dynamic_cast<VarDecl *>(stmt)) {
+            module.exports.push_back(
+                {var_decl->var_name->lexeme, var_decl->slot});
+        } else if (auto func_decl = dynamic_cast<FunctionDecl *>(stmt)) {
+            module.exports.push_back(
+                {func_decl->name->lexeme, func_decl->slot});
+        } else if (auto class_decl = dynamic_cast<ClassDecl *>(stmt)) {
+            module.exports.push_back(
+                {class_decl->name->lexeme, class_decl->slot});
+        } else if (auto import_stmt = dynamic_cast<ImportStmt *>(stmt)) {
+            // Imported names are not exported again
+            for (uint slot : import_stmt->slots) {
+                module.slot_num = std::max(module.slot_num, slot + 1);
+            }
+            continue;
+        } else {
+            continue;
+        }
+        module.slot_num =
+            std::max(module.slot_num, module.exports.back().slot + 1);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/token.hpp"
+#include "clox/parser/ast_arena.hpp"
+#include "clox/parser/stmt.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Top level declaration of a module, bound by the programs importing it
+struct Export {
+    // Views the module source
+    std::string_view name;
+    // Slot in the module env
+    uint slot;
+};
+
+// Script imported by other programs. Its top level declarations live in its
+// own env, nested in the env of the builtins: a module doesn't see the
+// globals of the programs importing it.
+struct Module {
+    // Canonical path, unique per module
+    std::string path;
+    SourceBuffer source;
+    std::vector<Token> tokens;
+    AstArena arena;
+    std::vector<Stmt *> stmts;
+    std::vector<Export> exports;
+    // Number of slots of the module env
+    uint slot_num = 0;
+    // False while the module is loaded, an import of it is then circular
+    bool is_resolved = false;
+    bool had_static_err = false;
+};
+
+// Scan, parse and resolve each module once per process, on its first import.
+// With use_cache, the resolved AST of a module is also kept next to it as the
+// AstCache of a script is, so the next processes skip its front end.
+class ModuleLoader {
+  private:
+    // Keyed by path, the modules live until the interpreter exits
+    static std::unordered_map<std::string, std::unique_ptr<Module>> modules;
+
+    static void load_exports(Module &module);
+
+  public:
+    static bool use_cache;
+    // Run the AstOptimizer on the modules, after they are cached
+    static bool use_optimizer;
+
+    // Return the module of the path token (a string literal) relative to
+    // base_dir, throw a StaticException when it can't be imported
+    static const Module &load(const Token &path, const std::string &base_dir,
+                              std::shared_ptr<AstInterpreter> interpreter);
+};
@@ -0,0 +1,62 @@
+#include "clox/middleware/streaming_runner.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <algorithm>
+#include <iostream>
+#include <ostream>
+
+void StreamingRunner::run(std::string_view src, std::deque<Token> &tokens,
+                          AstArena &arena, IdentifierResolver &resolver,
+                          const Execute &execute) {
+    Scanner scanner{src};
+    Parser parser{scanner, tokens, arena};
+    bool had_parser_err = false;
+    bool had_resolver_err = false;
+
+    while (!parser.at_end()) {
+        ErrorManager::had_static_err = false;
+        std::vector<Stmt *> stmts = {parser.parse_next_declaration()};
+        if (ErrorManager::had_static_err) {
+            had_parser_err = true;
+        } else if (!had_parser_err) {
+            resolver.resolve_program(stmts);
+            had_resolver_err |= ErrorManager::had_static_err;
+            if (!had_resolver_err && !execute(stmts)) {
+                return;
+            }
+        }
+
+        // The declaration is nullptr on syntax error
+        if (!declares_function(stmts[0])) {
+            parser.release_last_declaration();
+        }
+    }
+
+    ErrorManager::had_static_err = had_parser_err || had_resolver_err;
+    if (had_parser_err) {
+        std::cout << "Parser error occurs" << std::endl;
+    } else if (had_resolver_err) {
+        std::cout << "Resolver error occurs" << std::endl;
+    }
+}
+
+bool StreamingRunner::declares_function(const Stmt *stmt) {
+    if (dynamic_cast<const FunctionDecl *>(stmt) != nullptr ||
+        dynamic_cast<const ClassDecl *>(stmt) != nullptr) {
+        return true;
+    }
+    if (auto block = dynamic_cast<const BlockStmt *>(stmt)) {
+        return std::any_of(block->stmts.begin(), block->stmts.end(),
+                           declares_function);
+    }
+    if (auto if_stmt = dynamic_cast<const IfStmt *>(stmt)) {
+        return std::any_of(if_stmt->if_blocks.begin(),
+                           if_stmt->if_blocks.end(), declares_function) ||
+               declares_function(if_stmt->else_block);
+    }
+    if (auto while_stmt = dynamic_cast<const WhileStmt *>(stmt)) {
+        return declares_function(while_stmt->body);
+    }
+    return false;
+}
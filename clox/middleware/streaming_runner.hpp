@@ -0,0 +1,30 @@
+#pragma once
+#include "clox/common/token.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/ast_arena.hpp"
+#include "clox/parser/stmt.hpp"
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Run a whole file one top-level declaration at a time: each one is resolved
+// and executed before the next one is scanned and parsed. The tokens and AST
+// of a declaration which declares no function are released once it ran, so
+// long scripts run in bounded memory.
+class StreamingRunner {
+  public:
+    // Optimize and execute the declaration, return false on runtime error
+    using Execute = std::function<bool(std::vector<Stmt *> &)>;
+
+    // The kept declarations are stored in tokens and arena, which must live
+    // as long as the functions they declare. After a static error, the rest
+    // of the file is only parsed and resolved to report its errors.
+    static void run(std::string_view src, std::deque<Token> &tokens,
+                    AstArena &arena, IdentifierResolver &resolver,
+                    const Execute &execute);
+
+    // Functions are only declared by function and class declarations, there
+    // is no function expression
+    static bool declares_function(const Stmt *stmt);
+};
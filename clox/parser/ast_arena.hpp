@@ -0,0 +1,89 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Own the AST nodes of a parsed program. Nodes are bump allocated in large
+// blocks so that the tree is laid out in parse order, children are referred
+// to by raw pointers and the whole tree is freed at once with the arena.
+class AstArena {
+  private:
+    struct Destructor {
+        void *object;
+        void (*destroy)(void *);
+    };
+
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks = {};
+    std::byte *next = nullptr;
+    size_t remaining = 0;
+    // Nodes owning heap memory (vectors...), destructed with the arena
+    std::vector<Destructor> destructors = {};
+
+    void *allocate(size_t size, size_t align) {
+        size_t padding = (align - reinterpret_cast<uintptr_t>(next) % align) %
+                         align;
+        if (next == nullptr || padding + size > remaining) {
+            size_t block_size = std::max(BLOCK_SIZE, size + align);
+            blocks.emplace_back(new std::byte[block_size]);
+            next = blocks.back().get();
+            remaining = block_size;
+            padding = (align - reinterpret_cast<uintptr_t>(next) % align) %
+                      align;
+        }
+
+        void *memory = next + padding;
+        next += padding + size;
+        remaining -= padding + size;
+        return memory;
+    }
+
+  public:
+    AstArena() = default;
+    AstArena(const AstArena &) = delete;
+    AstArena &operator=(const AstArena &) = delete;
+
+    ~AstArena() { clear(); }
+
+    // State of the arena, the nodes allocated after it can be freed
+    struct Mark {
+        size_t block_num = 0;
+        std::byte *next = nullptr;
+        size_t remaining = 0;
+        size_t destructor_num = 0;
+    };
+
+    Mark mark() const {
+        return {blocks.size(), next, remaining, destructors.size()};
+    }
+
+    // Free the nodes allocated since the mark, the older ones stay
+    void release(const Mark &mark) {
+        for (size_t i = destructors.size(); i > mark.destructor_num; --i) {
+            destructors[i - 1].destroy(destructors[i - 1].object);
+        }
+        destructors.resize(mark.destructor_num);
+        blocks.resize(mark.block_num);
+        next = mark.next;
+        remaining = mark.remaining;
+    }
+
+    // Free all the nodes, the arena can then be reused for another AST
+    void clear() { release({}); }
+
+    template <typename T, typename... Args> T *make(Args &&...args) {
+        T *node = new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back(
+                {node, [](void *object) { static_cast<T *>(object)->~T(); }});
+        }
+        return node;
+    }
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include "clox/common/constants.hpp"
+#include "clox/common/shape.hpp"
 #include "clox/common/token.hpp"
 #include <memory>
 
@@ -36,14 +38,26 @@ class Expr {
     virtual ExprVal accept(IExprVisitor &visitor) = 0;
 };
 
+// Operand types a BinaryExpr site of the AstInterpreter is specialized for.
+// A site specializes on the types of its first evaluation and falls back to
+// GENERIC for good on the first evaluation with other types.
+enum class BinarySpecialization : uint8_t {
+    UNINITIALIZED,
+    NUMBERS,
+    STRINGS,
+    GENERIC,
+};
+
 class BinaryExpr : public Expr {
   public:
-    std::shared_ptr<Expr> left_operand;
-    std::shared_ptr<Token> operation;
-    std::shared_ptr<Expr> right_operand;
-
-    BinaryExpr(std::shared_ptr<Expr> &left_operand, std::shared_ptr<Token> &op,
-               std::shared_ptr<Expr> &right_operand)
+    Expr *left_operand;
+    const Token *operation;
+    Expr *right_operand;
+    // Rewritten by the AstInterpreter when the expr is evaluated
+    mutable BinarySpecialization specialization =
+        BinarySpecialization::UNINITIALIZED;
+
+    BinaryExpr(Expr *left_operand, const Token *op, Expr *right_operand)
         : left_operand(left_operand), operation(op),
           right_operand(right_operand) {}
 
@@ -54,9 +68,9 @@ class BinaryExpr : public Expr {
 
 class GroupExpr : public Expr {
   public:
-    std::shared_ptr<Expr> expr;
+    Expr *expr;
 
-    GroupExpr(std::shared_ptr<Expr> &expr) : expr(expr) {}
+    GroupExpr(Expr *expr) : expr(expr) {}
 
     ExprVal accept(IExprVisitor &visitor) override {
         return visitor.visit_grouping(*this);
@@ -76,10 +90,10 @@ class LiteralExpr : public Expr {
 
 class UnaryExpr : public Expr {
   public:
-    std::shared_ptr<Token> operation;
-    std::shared_ptr<Expr> operand;
+    const Token *operation;
+    Expr *operand;
 
-    UnaryExpr(std::shared_ptr<Token> &op, std::shared_ptr<Expr> &operand)
+    UnaryExpr(const Token *op, Expr *operand)
         : operation(op), operand(operand) {}
 
     ExprVal accept(IExprVisitor &visitor) override {
@@ -89,9 +103,17 @@ class UnaryExpr : public Expr {
 
 class IdentifierExpr : public Expr {
   public:
-    std::shared_ptr<Token> token;
-
-    IdentifierExpr(std::shared_ptr<Token> token) : token(token) {}
+    const Token *token;
+    // Resolved by IdentifierResolver: number of envs to walk up from the
+    // current env and the slot of the identifier in the env found. For a
+    // variable captured from an enclosing function, the index of the upvalue.
+    mutable int depth = UNRESOLVED_DEPTH;
+    mutable uint slot = 0;
+    // Set when the variable is captured by a closure, its value is then
+    // stored in a Cell shared with the closure
+    mutable bool is_cell = false;
+
+    IdentifierExpr(const Token *token) : token(token) {}
 
     ExprVal accept(IExprVisitor &visitor) override {
         return visitor.visit_identifier(*this);
@@ -108,10 +130,12 @@ class ThisExpr : public IdentifierExpr {
 
 class SuperExpr : public IdentifierExpr {
   public:
-    std::shared_ptr<IdentifierExpr> method;
+    IdentifierExpr *method;
+    // Location of "this" in the method, resolved like an identifier
+    mutable int this_depth = UNRESOLVED_DEPTH;
+    mutable uint this_slot = 0;
 
-    SuperExpr(std::shared_ptr<Token> token,
-              std::shared_ptr<IdentifierExpr> method)
+    SuperExpr(const Token *token, IdentifierExpr *method)
         : IdentifierExpr(token), method(method) {}
 
     ExprVal accept(IExprVisitor &visitor) override {
@@ -119,32 +143,36 @@ class SuperExpr : public IdentifierExpr {
     }
 };
 
-class FuncCallExpr : public Expr {
+class GetClassFieldExpr : public Expr {
   public:
-    std::shared_ptr<Expr> callee;
-    std::shared_ptr<Token> func_token;
-    std::vector<std::shared_ptr<Expr>> args;
+    Expr *lox_instance;
+    const Token *field_token;
+    // Filled by the AstInterpreter when the expr is evaluated
+    mutable PropertyCache cache = {};
 
-    FuncCallExpr(std::shared_ptr<Expr> callee,
-                 std::shared_ptr<Token> func_token,
-                 std::vector<std::shared_ptr<Expr>> &args)
-        : callee(callee), func_token(func_token), args(args) {}
+    GetClassFieldExpr(Expr *lox_instance, const Token *field_token)
+        : lox_instance(lox_instance), field_token(field_token) {}
 
     ExprVal accept(IExprVisitor &visitor) override {
-        return visitor.visit_func_call(*this);
+        return visitor.visit_get_class_field(*this);
     }
 };
 
-class GetClassFieldExpr : public Expr {
+class FuncCallExpr : public Expr {
   public:
-    std::shared_ptr<Expr> lox_instance;
-    std::shared_ptr<Token> field_token;
-
-    GetClassFieldExpr(std::shared_ptr<Expr> lox_instance,
-                      std::shared_ptr<Token> field_token)
-        : lox_instance(lox_instance), field_token(field_token) {}
+    Expr *callee;
+    const Token *func_token;
+    std::vector<Expr *> args;
+    // Set when the callee is obj.method, the call is then done without
+    // creating a bound method.
+    GetClassFieldExpr *method_callee;
+
+    FuncCallExpr(Expr *callee, const Token *func_token,
+                 std::vector<Expr *> &args)
+        : callee(callee), func_token(func_token), args(args),
+          method_callee(dynamic_cast<GetClassFieldExpr *>(callee)) {}
 
     ExprVal accept(IExprVisitor &visitor) override {
-        return visitor.visit_get_class_field(*this);
+        return visitor.visit_func_call(*this);
     }
 };
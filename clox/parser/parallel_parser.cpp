@@ -0,0 +1,123 @@
+#include "clox/parser/parallel_parser.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/char_class.hpp"
+#include "clox/scanner/scan_kernels.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <algorithm>
+#include <iostream>
+
+// Return whether a fun or class keyword starts at pos
+static bool starts_declaration(const char *pos, const char *end) {
+    for (std::string_view keyword : {"fun", "class"}) {
+        if (size_t(end - pos) > keyword.size() &&
+            std::string_view(pos, keyword.size()) == keyword &&
+            !char_is(pos[keyword.size()], CHAR_IDENTIFIER)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<SourceChunk> split_source(std::string_view src, size_t chunk_num) {
+    const char *end = src.data() + src.size();
+    size_t chunk_size = src.size() / std::max<size_t>(chunk_num, 1) + 1;
+
+    std::vector<SourceChunk> chunks;
+    const char *chunk_start = src.data();
+    uint chunk_line = 1;
+    uint line = 1;
+    int depth = 0;
+    const char *pos = src.data();
+    while (pos < end) {
+        char c = *pos++;
+        switch (c) {
+        case '"':
+            pos = find_string_end(pos, end, line);
+            pos += pos < end;
+            break;
+        case '/':
+            if (pos < end && *pos == '/') {
+                // Stop at the new line, it may be followed by a boundary
+                pos = find_line_end(pos, end);
+            } else if (pos < end && *pos == '*') {
+                pos = find_block_comment_end(pos + 1, end, line);
+                pos = pos < end ? pos + 2 : end;
+            }
+            break;
+        case '{':
+        case '(':
+            depth++;
+            break;
+        case '}':
+        case ')':
+            depth--;
+            break;
+        case '\n':
+            line++;
+            if (depth == 0 && size_t(pos - chunk_start) >= chunk_size &&
+                starts_declaration(pos, end)) {
+                chunks.push_back(
+                    {std::string_view(chunk_start, pos - chunk_start),
+                     chunk_line});
+                chunk_start = pos;
+                chunk_line = line;
+            }
+            break;
+        }
+    }
+
+    chunks.push_back(
+        {std::string_view(chunk_start, end - chunk_start), chunk_line});
+    return chunks;
+}
+
+std::vector<Stmt *> ParallelParser::parse_program(std::string_view src,
+                                                  ThreadPool &pool) {
+    chunks.clear();
+    size_t chunk_num = std::min(pool.size() * 4, src.size() / MIN_CHUNK_SIZE);
+    for (const SourceChunk &source : split_source(src, chunk_num)) {
+        chunks.emplace_back().source = source;
+    }
+
+    for (Chunk &chunk : chunks) {
+        pool.submit([&chunk] { parse_chunk(chunk); });
+    }
+    pool.wait();
+
+    bool had_static_err =
+        std::any_of(chunks.begin(), chunks.end(),
+                    [](const Chunk &chunk) { return chunk.had_static_err; });
+    if (had_static_err) {
+        // A statement cut by a boundary is reported at the end of its chunk,
+        // the calling thread reports the errors of the whole file instead
+        chunks.clear();
+        Chunk &file = chunks.emplace_back();
+        file.source = {src, 1};
+        Scanner scanner{src};
+        file.tokens = scanner.scan_tokens();
+        Parser parser{file.tokens, file.arena};
+        return parser.parse_program();
+    }
+
+    std::vector<Stmt *> stmts;
+    for (Chunk &chunk : chunks) {
+        stmts.insert(stmts.end(), chunk.stmts.begin(), chunk.stmts.end());
+    }
+    return stmts;
+}
+
+void ParallelParser::parse_chunk(Chunk &chunk) {
+    ErrorManager::had_static_err = false;
+    ErrorManager::out = &chunk.errors;
+
+    Scanner scanner{chunk.source.text, chunk.source.first_line};
+    chunk.tokens = scanner.scan_tokens();
+    Parser parser{chunk.tokens, chunk.arena};
+    chunk.stmts = parser.parse_program();
+
+    // Scanner errors are only printed
+    chunk.had_static_err =
+        ErrorManager::had_static_err || chunk.errors.tellp() > 0;
+    ErrorManager::out = &std::cout;
+}
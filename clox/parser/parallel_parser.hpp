@@ -0,0 +1,50 @@
+#pragma once
+#include "clox/common/token.hpp"
+#include "clox/parser/ast_arena.hpp"
+#include "clox/parser/stmt.hpp"
+#include "clox/utils/thread_pool.hpp"
+#include <deque>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+struct SourceChunk {
+    std::string_view text;
+    // Line of the first char of text in the file
+    uint first_line = 1;
+};
+
+// Split the source into about chunk_num chunks. Each chunk but the first
+// starts with a fun or class keyword at the start of a line, outside any
+// brace, paren, string or comment: a top-level declaration starts there.
+std::vector<SourceChunk> split_source(std::string_view src, size_t chunk_num);
+
+// Scan and parse a whole file on a thread pool: the chunks of the source are
+// parsed independently, then their statements are stitched back in order.
+class ParallelParser {
+  private:
+    struct Chunk {
+        SourceChunk source;
+        std::vector<Token> tokens = {};
+        AstArena arena;
+        std::vector<Stmt *> stmts = {};
+        // Errors of the chunk, they are dropped when the file is parsed again
+        std::ostringstream errors;
+        bool had_static_err = false;
+    };
+
+    // The AST of a chunk points to its tokens and is allocated in its arena,
+    // a deque never moves them
+    std::deque<Chunk> chunks = {};
+
+    static void parse_chunk(Chunk &chunk);
+
+  public:
+    // Chunks smaller than this are not worth a task
+    static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+    // Return the statements of the program in source order. When a chunk has
+    // a static error, the file is parsed again by the calling thread so that
+    // errors are reported as with the Parser, one file at a time.
+    std::vector<Stmt *> parse_program(std::string_view src, ThreadPool &pool);
+};
@@ -8,10 +8,14 @@
 #include <memory>
 #include <vector>
 
-Parser::Parser(const std::vector<std::shared_ptr<Token>> &tokens)
-    : tokens(tokens) {}
+Parser::Parser(const std::vector<Token> &tokens, AstArena &arena)
+    : tokens(&tokens), arena(&arena) {}
 
-std::shared_ptr<Expr> Parser::parse_single_expr() {
+Parser::Parser(Scanner &scanner, std::deque<Token> &token_store,
+               AstArena &arena)
+    : scanner(&scanner), token_store(&token_store), arena(&arena) {}
+
+Expr *Parser::parse_single_expr() {
     try {
         return parse_expr();
     } catch (StaticException &err) {
@@ -21,17 +25,35 @@ std::shared_ptr<Expr> Parser::parse_single_expr() {
 }
 
 // program → declaration*
-std::vector<std::shared_ptr<Stmt>> Parser::parse_program() {
-    std::vector<std::shared_ptr<Stmt>> stmts{};
+std::vector<Stmt *> Parser::parse_program() {
+    std::vector<Stmt *> stmts{};
     while (!consumed_all_tokens()) {
         stmts.push_back(parse_declaration());
     }
     return stmts;
 }
 
-// declaration → varDecl | funcDecl | classDecl | statement
-std::shared_ptr<Stmt> Parser::parse_declaration() {
+bool Parser::at_end() { return consumed_all_tokens(); }
+
+Stmt *Parser::parse_next_declaration() {
+    declaration_token_num = token_store->size();
+    declaration_mark = arena->mark();
+    return parse_declaration();
+}
+
+// The lookahead is not stored yet, it stays for the next declaration
+void Parser::release_last_declaration() {
+    token_store->resize(declaration_token_num);
+    arena->release(declaration_mark);
+    prev_tok = nullptr;
+}
+
+// declaration → varDecl | funcDecl | classDecl | importStmt | statement
+Stmt *Parser::parse_declaration() {
     try {
+        if (validate_token(TokenType::IMPORT)) {
+            return parse_import_stmt();
+        }
         if (validate_token(TokenType::VAR)) {
             return parse_var_decl();
         }
@@ -51,7 +73,7 @@ std::shared_ptr<Stmt> Parser::parse_declaration() {
 
 // statement → block | forStmt | whileStmt | ifStmt | exprStmt | printStmt |
 // assignStmt | returnStmt
-std::shared_ptr<Stmt> Parser::parse_stmt() {
+Stmt *Parser::parse_stmt() {
     if (validate_token(TokenType::LEFT_BRACE)) {
         return parse_block_stmt();
     }
@@ -77,11 +99,11 @@ std::shared_ptr<Stmt> Parser::parse_stmt() {
 }
 
 // returnStmt → return expression? ";"
-std::shared_ptr<ReturnStmt> Parser::parse_return_stmt() {
+ReturnStmt *Parser::parse_return_stmt() {
     assert_tok_and_advance(TokenType::RETURN, "Expected return statement");
 
-    std::shared_ptr<Token> return_kw = get_prev_tok();
-    std::shared_ptr<Expr> expr = nullptr;
+    const Token *return_kw = get_prev_tok();
+    Expr *expr = nullptr;
 
     if (!validate_token(TokenType::SEMICOLON)) {
         expr = parse_expr();
@@ -89,59 +111,68 @@ std::shared_ptr<ReturnStmt> Parser::parse_return_stmt() {
 
     assert_tok_and_advance(TokenType::SEMICOLON,
                            "Expected ';' at the end of return statement");
-    return std::make_shared<ReturnStmt>(return_kw, expr);
+    return arena->make<ReturnStmt>(return_kw, expr);
+}
+
+// importStmt → "import" STRING ";"
+ImportStmt *Parser::parse_import_stmt() {
+    assert_tok_and_advance(TokenType::IMPORT, "Expected import statement");
+    const Token *import_kw = get_prev_tok();
+    const Token *path = assert_tok_and_advance(
+        TokenType::STRING, "Expected the path of the imported module");
+    assert_tok_and_advance(TokenType::SEMICOLON,
+                           "Expected ';' at the end of import statement");
+    return arena->make<ImportStmt>(import_kw, path);
 }
 
 // funcDecl → function;
-std::shared_ptr<FunctionDecl> Parser::parse_function_decl() {
+FunctionDecl *Parser::parse_function_decl() {
     return parse_function();
 }
 
 // classDecl -> "class" IDENTIFIER (: IDENTIFIER)? "{" function* "}"
-std::shared_ptr<ClassDecl> Parser::parse_class_decl() {
+ClassDecl *Parser::parse_class_decl() {
     assert_tok_and_advance(TokenType::CLASS, "Expected class declaration");
-    std::shared_ptr<Token> class_name =
+    const Token *class_name =
         assert_tok_and_advance(TokenType::IDENTIFIER, "Expected class name");
 
     // parse super class
-    std::shared_ptr<IdentifierExpr> superclass = nullptr;
+    IdentifierExpr *superclass = nullptr;
     if (validate_token_and_advance({TokenType::EXTEND})) {
-        std::shared_ptr<Token> superclass_name = assert_tok_and_advance(
+        const Token *superclass_name = assert_tok_and_advance(
             TokenType::IDENTIFIER, "Expected super class name");
         if (superclass_name->lexeme == class_name->lexeme) {
             throw StaticException(superclass_name,
                                   "Class cannot extend itself: " +
-                                      superclass_name->lexeme);
+                                      std::string(superclass_name->lexeme));
         }
-        superclass = std::make_shared<IdentifierExpr>(superclass_name);
+        superclass = arena->make<IdentifierExpr>(superclass_name);
     }
 
     assert_tok_and_advance(TokenType::LEFT_BRACE,
                            "Expected '{' at the start of class body");
 
-    std::vector<std::shared_ptr<FunctionDecl>> methods{};
+    std::vector<FunctionDecl *> methods{};
     while (!consumed_all_tokens() and !validate_token(TokenType::RIGHT_BRACE)) {
-        auto method = parse_function();
-        methods.push_back(std::dynamic_pointer_cast<FunctionDecl>(method));
+        methods.push_back(parse_function());
     }
 
     assert_tok_and_advance(TokenType::RIGHT_BRACE,
                            "Expected '}' at the end of class body");
 
-    return std::make_shared<ClassDecl>(class_name, superclass, methods);
+    return arena->make<ClassDecl>(class_name, superclass, methods);
 }
 
 // function -> "fun" IDENTIFIER "(" parameters ")" block
-std::shared_ptr<FunctionDecl> Parser::parse_function() {
+FunctionDecl *Parser::parse_function() {
     assert_tok_and_advance(TokenType::FUNC, "Expected function declaration");
-    std::shared_ptr<Token> func_name =
+    const Token *func_name =
         assert_tok_and_advance(TokenType::IDENTIFIER, "Expected function name");
 
-    std::shared_ptr<Token> left_parenthesis = assert_tok_and_advance(
+    const Token *left_parenthesis = assert_tok_and_advance(
         TokenType::LEFT_PAREN, "Expected '(' after function name");
 
-    std::vector<std::shared_ptr<IdentifierExpr>> func_params =
-        parse_func_params();
+    std::vector<IdentifierExpr *> func_params = parse_func_params();
 
     if (!validate_token_and_advance({TokenType::RIGHT_PAREN})) {
         throw StaticException(left_parenthesis,
@@ -149,22 +180,22 @@ std::shared_ptr<FunctionDecl> Parser::parse_function() {
                               "of function params list to match '('");
     }
 
-    std::shared_ptr<BlockStmt> func_body = parse_block_stmt();
+    BlockStmt *func_body = parse_block_stmt();
 
-    return std::make_shared<FunctionDecl>(func_name, func_params, func_body);
+    return arena->make<FunctionDecl>(func_name, func_params, func_body);
 }
 
 // parameters -> "" | (IDENTIFIER (","IDENTIFIER)*)
-std::vector<std::shared_ptr<IdentifierExpr>> Parser::parse_func_params() {
+std::vector<IdentifierExpr *> Parser::parse_func_params() {
     if (validate_token(TokenType::RIGHT_PAREN)) {
         return {};
     }
 
-    std::vector<std::shared_ptr<IdentifierExpr>> params{};
+    std::vector<IdentifierExpr *> params{};
     do {
-        std::shared_ptr<Token> var_name = assert_tok_and_advance(
+        const Token *var_name = assert_tok_and_advance(
             TokenType::IDENTIFIER, "Expected function parameter");
-        params.push_back(std::make_shared<IdentifierExpr>(var_name));
+        params.push_back(arena->make<IdentifierExpr>(var_name));
     } while (validate_token_and_advance({TokenType::COMMA}));
 
     if (params.size() > MAX_ARGS_NUM) {
@@ -187,11 +218,11 @@ std::vector<std::shared_ptr<IdentifierExpr>> Parser::parse_func_params() {
         }
     }
 */
-std::shared_ptr<Stmt> Parser::parse_for_stmt() {
+Stmt *Parser::parse_for_stmt() {
     // std::shared_ptr<Stmt> Parser::parse_for_stmt() {
     assert_tok_and_advance(TokenType::FOR, "Expected for loop");
 
-    std::shared_ptr<Stmt> initializer;
+    Stmt *initializer;
     if (validate_token_and_advance({TokenType::SEMICOLON})) {
         initializer = nullptr;
     } else if (validate_token(TokenType::VAR)) {
@@ -200,63 +231,63 @@ std::shared_ptr<Stmt> Parser::parse_for_stmt() {
         initializer = parse_assign_stmt();
     }
 
-    std::shared_ptr<Expr> condition(new LiteralExpr(true));
+    Expr *condition = arena->make<LiteralExpr>(true);
     if (!validate_token(TokenType::SEMICOLON)) {
         condition = parse_expr();
     }
     assert_tok_and_advance(TokenType::SEMICOLON,
                            "Expected ; after for loop condition.");
 
-    std::shared_ptr<Stmt> increment = nullptr;
+    Stmt *increment = nullptr;
     if (!validate_token(TokenType::LEFT_BRACE)) {
         increment = parse_assign_stmt();
     }
 
-    std::shared_ptr<BlockStmt> body = parse_block_stmt();
+    BlockStmt *body = parse_block_stmt();
     if (increment != nullptr) {
         body->stmts.push_back(increment);
         body->for_loop_increment = increment;
     }
 
-    auto while_stmt = std::make_shared<WhileStmt>(condition, body);
+    auto while_stmt = arena->make<WhileStmt>(condition, body);
     if (initializer != nullptr) {
-        std::vector<std::shared_ptr<Stmt>> stmts = {initializer, while_stmt};
-        auto for_stmt = std::make_shared<BlockStmt>(stmts);
+        std::vector<Stmt *> stmts = {initializer, while_stmt};
+        auto for_stmt = arena->make<BlockStmt>(stmts);
         return for_stmt;
     }
     return while_stmt;
 }
 
 // whileStmt → "while" expression block
-std::shared_ptr<WhileStmt> Parser::parse_while_stmt() {
+WhileStmt *Parser::parse_while_stmt() {
     assert_tok_and_advance(TokenType::WHILE, "Expected while loop");
-    std::shared_ptr<Expr> condition = parse_expr();
-    std::shared_ptr<BlockStmt> body = parse_block_stmt();
+    Expr *condition = parse_expr();
+    BlockStmt *body = parse_block_stmt();
 
-    return std::make_shared<WhileStmt>(condition, body);
+    return arena->make<WhileStmt>(condition, body);
 }
 
-std::shared_ptr<BreakStmt> Parser::parse_break_stmt() {
+BreakStmt *Parser::parse_break_stmt() {
     assert_tok_and_advance(TokenType::BREAK, "Expected break keyword.");
-    std::shared_ptr<Token> break_kw = get_prev_tok();
+    const Token *break_kw = get_prev_tok();
     assert_tok_and_advance(TokenType::SEMICOLON,
                            "Expected ; at the end of break statement");
-    return std::make_shared<BreakStmt>(break_kw);
+    return arena->make<BreakStmt>(break_kw);
 }
 
-std::shared_ptr<ContinueStmt> Parser::parse_continue_stmt() {
+ContinueStmt *Parser::parse_continue_stmt() {
     assert_tok_and_advance(TokenType::CONTINUE, "Expected continue keyword.");
-    std::shared_ptr<Token> continue_kw = get_prev_tok();
+    const Token *continue_kw = get_prev_tok();
     assert_tok_and_advance(TokenType::SEMICOLON,
                            "Expected ; at the end of continue statement");
-    return std::make_shared<ContinueStmt>(continue_kw);
+    return arena->make<ContinueStmt>(continue_kw);
 }
 
 // ifStmt -> "if" expression block ("elif" block)+ ("else" block)?
-std::shared_ptr<IfStmt> Parser::parse_if_stmt() {
+IfStmt *Parser::parse_if_stmt() {
     assert_tok_and_advance(TokenType::IF, "Expected if statement");
-    std::vector<std::shared_ptr<Expr>> conditions;
-    std::vector<std::shared_ptr<Stmt>> if_blocks;
+    std::vector<Expr *> conditions;
+    std::vector<Stmt *> if_blocks;
     conditions.push_back(parse_expr());
     if_blocks.push_back(parse_block_stmt());
 
@@ -265,21 +296,21 @@ std::shared_ptr<IfStmt> Parser::parse_if_stmt() {
         if_blocks.push_back(parse_block_stmt());
     }
 
-    std::shared_ptr<Stmt> else_block = nullptr;
+    Stmt *else_block = nullptr;
     if (validate_token_and_advance({TokenType::ELSE})) {
         else_block = parse_block_stmt();
     }
 
-    return std::make_shared<IfStmt>(conditions, if_blocks, else_block);
+    return arena->make<IfStmt>(conditions, if_blocks, else_block);
 }
 
 // block → "{" statement* "}"
-std::shared_ptr<BlockStmt> Parser::parse_block_stmt() {
+BlockStmt *Parser::parse_block_stmt() {
     assert_tok_and_advance(TokenType::LEFT_BRACE,
                            "Expected block of statements wrapped inside '{}'");
 
     auto left_brace = get_prev_tok();
-    std::vector<std::shared_ptr<Stmt>> stmts{};
+    std::vector<Stmt *> stmts{};
 
     while (!consumed_all_tokens() and !validate_token(TokenType::RIGHT_BRACE)) {
         stmts.push_back(parse_declaration());
@@ -291,17 +322,16 @@ std::shared_ptr<BlockStmt> Parser::parse_block_stmt() {
                               "of the block to match '{'");
     }
 
-    return std::make_shared<BlockStmt>(stmts);
+    return arena->make<BlockStmt>(stmts);
 }
 
 // varDecl → "var" IDENTIFIER ( "=" expression )? ";"
-std::shared_ptr<VarDecl> Parser::parse_var_decl() {
+VarDecl *Parser::parse_var_decl() {
     assert_tok_and_advance(TokenType::VAR, "Expected 'var'");
     assert_tok_and_advance(TokenType::IDENTIFIER, "Expected a variable name");
-    std::shared_ptr<Token> tok_var = get_prev_tok();
+    const Token *tok_var = get_prev_tok();
 
-    std::shared_ptr<Expr> var_initializer = nullptr;
-    ExprVal var_value = NIL;
+    Expr *var_initializer = nullptr;
     if (validate_token_and_advance({TokenType::EQUAL})) {
         var_initializer = parse_expr();
     }
@@ -310,33 +340,32 @@ std::shared_ptr<VarDecl> Parser::parse_var_decl() {
         TokenType::SEMICOLON,
         "Expected ; at the end of variable declaration statement");
 
-    return std::make_shared<VarDecl>(tok_var, var_initializer);
+    return arena->make<VarDecl>(tok_var, var_initializer);
 }
 
 // assignStmt -> (IDENTIFIER | call) "=" expression";" | exprStmt
 // exprStmt → expression ";" ;
-std::shared_ptr<Stmt> Parser::parse_assign_stmt() {
-    std::shared_ptr<Expr> expr = parse_expr();
+Stmt *Parser::parse_assign_stmt() {
+    Expr *expr = parse_expr();
 
     if (validate_token_and_advance({TokenType::EQUAL})) {
         // For now, only support variable assignment.
-        auto identifier_expr = std::dynamic_pointer_cast<IdentifierExpr>(expr);
-        auto get_class_field_expr =
-            std::dynamic_pointer_cast<GetClassFieldExpr>(expr);
+        auto identifier_expr = dynamic_cast<IdentifierExpr *>(expr);
+        auto get_class_field_expr = dynamic_cast<GetClassFieldExpr *>(expr);
         if (!identifier_expr && !get_class_field_expr) {
             throw StaticException(get_cur_tok(),
                                   "Expected to assign new value to a variable "
                                   "or instance property");
         }
 
-        std::shared_ptr<Expr> value = parse_expr();
+        Expr *value = parse_expr();
         assert_tok_and_advance(TokenType::SEMICOLON,
                                "Expected ; at the end of assign statement");
 
         if (identifier_expr) {
-            return std::make_shared<AssignStmt>(identifier_expr, value);
+            return arena->make<AssignStmt>(identifier_expr, value);
         } else {
-            return std::make_shared<SetClassFieldStmt>(
+            return arena->make<SetClassFieldStmt>(
                 get_class_field_expr->lox_instance,
                 get_class_field_expr->field_token, value);
         }
@@ -345,54 +374,54 @@ std::shared_ptr<Stmt> Parser::parse_assign_stmt() {
     // Expr stmt
     assert_tok_and_advance(TokenType::SEMICOLON,
                            "Expected ; at the end of assign statement");
-    return std::make_shared<ExprStmt>(expr);
+    return arena->make<ExprStmt>(expr);
 }
 
 // expression → logic_or ;
-std::shared_ptr<Expr> Parser::parse_expr() { return parse_logic_or_expr(); }
+Expr *Parser::parse_expr() { return parse_logic_or_expr(); }
 
 // logic_or → logic_and ( "or" logic_and )*
-std::shared_ptr<Expr> Parser::parse_logic_or_expr() {
+Expr *Parser::parse_logic_or_expr() {
     auto left = parse_logic_and_expr();
 
     while (validate_token_and_advance({TokenType::OR})) {
         auto op = get_prev_tok();
         auto right = parse_logic_and_expr();
-        left = std::make_shared<BinaryExpr>(left, op, right);
+        left = arena->make<BinaryExpr>(left, op, right);
     }
 
     return left;
 }
 
 // logic_and → equality ( "and" equality )*
-std::shared_ptr<Expr> Parser::parse_logic_and_expr() {
+Expr *Parser::parse_logic_and_expr() {
     auto left = parse_equality_expr();
 
     while (validate_token_and_advance({TokenType::AND})) {
         auto op = get_prev_tok();
         auto right = parse_equality_expr();
-        left = std::make_shared<BinaryExpr>(left, op, right);
+        left = arena->make<BinaryExpr>(left, op, right);
     }
 
     return left;
 }
 
 // equality → comparison ( ( "!=" | "==" ) comparison )*
-std::shared_ptr<Expr> Parser::parse_equality_expr() {
+Expr *Parser::parse_equality_expr() {
     auto left = parse_comparision_expr();
 
     while (validate_token_and_advance(
         {TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
         auto op = get_prev_tok();
         auto right = parse_comparision_expr();
-        left = std::make_shared<BinaryExpr>(left, op, right);
+        left = arena->make<BinaryExpr>(left, op, right);
     }
 
     return left;
 }
 
 // comparison → term ( ( ">" | ">=" | "<" | "<=" ) term )*
-std::shared_ptr<Expr> Parser::parse_comparision_expr() {
+Expr *Parser::parse_comparision_expr() {
     auto left = parse_term();
 
     while (validate_token_and_advance({TokenType::GREATER, TokenType::LESS,
@@ -400,69 +429,69 @@ std::shared_ptr<Expr> Parser::parse_comparision_expr() {
                                        TokenType::LESS_EQUAL})) {
         auto op = get_prev_tok();
         auto right = parse_term();
-        left = std::make_shared<BinaryExpr>(left, op, right);
+        left = arena->make<BinaryExpr>(left, op, right);
     }
 
     return left;
 }
 
 // term → factor ( ( "-" | "+" ) factor )*
-std::shared_ptr<Expr> Parser::parse_term() {
+Expr *Parser::parse_term() {
     auto left = parse_factor();
 
     while (validate_token_and_advance({TokenType::MINUS, TokenType::PLUS})) {
         auto op = get_prev_tok();
         auto right = parse_factor();
-        left = std::make_shared<BinaryExpr>(left, op, right);
+        left = arena->make<BinaryExpr>(left, op, right);
     }
 
     return left;
 }
 
 // factor → unary ( ( "/" | "*" | "%" ) unary )*
-std::shared_ptr<Expr> Parser::parse_factor() {
+Expr *Parser::parse_factor() {
     auto left = parse_unary();
 
     while (validate_token_and_advance(
         {TokenType::SLASH, TokenType::STAR, TokenType::MOD})) {
         auto op = get_prev_tok();
         auto right = parse_unary();
-        left = std::make_shared<BinaryExpr>(left, op, right);
+        left = arena->make<BinaryExpr>(left, op, right);
     }
 
     return left;
 }
 
 // unary → ( "!" | "-" ) unary | call
-std::shared_ptr<Expr> Parser::parse_unary() {
+Expr *Parser::parse_unary() {
     if (validate_token_and_advance({TokenType::BANG, TokenType::MINUS})) {
         auto op = get_prev_tok();
-        std::shared_ptr<Expr> right = parse_unary();
-        return std::make_shared<UnaryExpr>(op, right);
+        Expr *right = parse_unary();
+        return arena->make<UnaryExpr>(op, right);
     }
 
     return parse_call();
 }
 
 // call → primary ("(" arguments ")" | "." IDENTIFIER)*
-std::shared_ptr<Expr> Parser::parse_call() {
-    std::shared_ptr<Expr> call_expr = parse_primary();
+Expr *Parser::parse_call() {
+    Expr *call_expr = parse_primary();
 
     while (true) {
-        std::shared_ptr<Token> func_token = get_prev_tok();
+        const Token *func_token = get_prev_tok();
         if (validate_token_and_advance({TokenType::LEFT_PAREN})) {
-            std::vector<std::shared_ptr<Expr>> arguments =
+            std::vector<Expr *> arguments =
                 parse_func_call_arguments();
 
             assert_tok_and_advance(TokenType::RIGHT_PAREN,
                                    "Expected ')' after function invocation");
 
-            call_expr = std::make_shared<FuncCallExpr>(call_expr, func_token,
-                                                       arguments);
+            call_expr =
+                arena->make<FuncCallExpr>(call_expr, func_token, arguments);
         } else if (validate_token_and_advance({TokenType::DOT})) {
-            std::shared_ptr<Token> field = assert_tok_and_advance(
+            const Token *field = assert_tok_and_advance(
                 TokenType::IDENTIFIER, "Expected instance field");
-            call_expr = std::make_shared<GetClassFieldExpr>(call_expr, field);
+            call_expr = arena->make<GetClassFieldExpr>(call_expr, field);
         } else {
             break;
         }
@@ -472,12 +501,12 @@ std::shared_ptr<Expr> Parser::parse_call() {
 }
 
 // arguments -> "" | (expression (","expression)*)
-std::vector<std::shared_ptr<Expr>> Parser::parse_func_call_arguments() {
+std::vector<Expr *> Parser::parse_func_call_arguments() {
     if (validate_token(TokenType::RIGHT_PAREN)) {
         return {};
     }
 
-    std::vector<std::shared_ptr<Expr>> args{};
+    std::vector<Expr *> args{};
     do {
         args.push_back(parse_expr());
     } while (validate_token_and_advance({TokenType::COMMA}));
@@ -494,12 +523,12 @@ std::vector<std::shared_ptr<Expr>> Parser::parse_func_call_arguments() {
 
 // primary → IDENTIFIER | "this" | NUMBER | STRING | "true" | "false" | "nil" |
 // "super".IDENTIFIER | "(" expression ")"
-std::shared_ptr<Expr> Parser::parse_primary() {
+Expr *Parser::parse_primary() {
     if (validate_token_and_advance({TokenType::IDENTIFIER})) {
-        return std::make_shared<IdentifierExpr>(get_prev_tok());
+        return arena->make<IdentifierExpr>(get_prev_tok());
     }
     if (validate_token_and_advance({TokenType::THIS})) {
-        return std::make_shared<ThisExpr>(get_prev_tok());
+        return arena->make<ThisExpr>(get_prev_tok());
     }
     if (validate_token_and_advance({TokenType::SUPER})) {
         auto super_tok = get_prev_tok();
@@ -507,35 +536,43 @@ std::shared_ptr<Expr> Parser::parse_primary() {
                                "Expected '.' after 'super' keyword");
         assert_tok_and_advance(TokenType::IDENTIFIER, "Expected method name "
                                                       "after 'super' keyword");
-        auto method = std::make_shared<IdentifierExpr>(get_prev_tok());
-        return std::make_shared<SuperExpr>(super_tok, method);
+        auto method = arena->make<IdentifierExpr>(get_prev_tok());
+        return arena->make<SuperExpr>(super_tok, method);
     }
     if (validate_token_and_advance({TokenType::FALSE})) {
-        return std::make_shared<LiteralExpr>(false);
+        return arena->make<LiteralExpr>(false);
     }
     if (validate_token_and_advance({TokenType::TRUE})) {
-        return std::make_shared<LiteralExpr>(true);
+        return arena->make<LiteralExpr>(true);
     }
     if (validate_token_and_advance({TokenType::NIL})) {
-        return std::make_shared<LiteralExpr>(NIL);
+        return arena->make<LiteralExpr>(NIL);
     }
     if (validate_token_and_advance({TokenType::NUMBER, TokenType::STRING})) {
         auto tok = get_prev_tok();
-        return std::make_shared<LiteralExpr>(tok->literal);
+        return arena->make<LiteralExpr>(tok->literal);
     }
 
     if (validate_token_and_advance({TokenType::LEFT_PAREN})) {
-        std::shared_ptr<Expr> expr = parse_expr();
+        Expr *expr = parse_expr();
         assert_tok_and_advance(TokenType::RIGHT_PAREN,
                                "Expected ) character but not found.");
-        return std::make_shared<GroupExpr>(expr);
+        return arena->make<GroupExpr>(expr);
     }
 
     throw StaticException(get_cur_tok(),
                           "Parsering primary error: Expect expression");
 }
 
-bool Parser::consumed_all_tokens() { return current_tok_pos >= tokens.size(); }
+bool Parser::consumed_all_tokens() {
+    if (scanner == nullptr) {
+        return current_tok_pos >= tokens->size();
+    }
+    if (!has_lookahead) {
+        has_lookahead = scanner->scan_next_token(lookahead);
+    }
+    return !has_lookahead;
+}
 
 bool Parser::validate_token_and_advance(
     const std::vector<TokenType> &tok_types) {
@@ -554,31 +591,47 @@ bool Parser::validate_token_and_advance(
 }
 
 // get current token and move to the next tok
-std::shared_ptr<Token> Parser::advance() {
-    if (!consumed_all_tokens()) {
+const Token *Parser::advance() {
+    if (consumed_all_tokens()) {
+        return get_prev_tok();
+    }
+
+    if (scanner == nullptr) {
         current_tok_pos++;
+    } else {
+        // The AST points to the consumed tokens, which must not move
+        token_store->push_back(lookahead);
+        prev_tok = &token_store->back();
+        has_lookahead = false;
     }
     return get_prev_tok();
 }
 
 // get current token without moving to the next tok
-std::shared_ptr<Token> Parser::get_cur_tok() {
+const Token *Parser::get_cur_tok() {
     if (consumed_all_tokens()) {
-        return std::make_shared<Token>();
+        static const Token eos{};
+        return &eos;
     }
-    return tokens.at(current_tok_pos);
+    return scanner == nullptr ? &(*tokens)[current_tok_pos] : &lookahead;
 }
 
-std::shared_ptr<Token> Parser::get_prev_tok() {
-    if (current_tok_pos - 1 < 0) {
+const Token *Parser::get_prev_tok() {
+    if (scanner != nullptr) {
+        if (prev_tok == nullptr) {
+            throw StaticException(
+                get_cur_tok(), "Error: get previous token at invalid position");
+        }
+        return prev_tok;
+    }
+    if (current_tok_pos == 0) {
         throw StaticException(get_cur_tok(),
                               "Error: get previous token at invalid position");
     }
-    return tokens.at(current_tok_pos - 1);
+    return &(*tokens)[current_tok_pos - 1];
 }
 
-std::shared_ptr<Token> Parser::assert_tok_and_advance(TokenType type,
-                                                      std::string msg) {
+const Token *Parser::assert_tok_and_advance(TokenType type, std::string msg) {
     if (!validate_token(type)) {
         throw StaticException(get_cur_tok(), msg);
     }
@@ -602,6 +655,7 @@ void Parser::panic_mode_synchornize() {
         case TokenType::BREAK:
         case TokenType::CONTINUE:
         case TokenType::CLASS:
+        case TokenType::IMPORT:
         case TokenType::FOR:
         case TokenType::IF:
         case TokenType::WHILE:
@@ -1,57 +1,82 @@
 #pragma once
 #include "clox/common/token.hpp"
+#include "clox/parser/ast_arena.hpp"
 #include "clox/parser/expr.hpp"
 #include "clox/parser/stmt.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <deque>
 #include <memory>
 
 class Parser {
   private:
-    std::vector<std::shared_ptr<Token>> tokens = {};
+    // Nodes point to the tokens, which must outlive the AST like the arena
+    const std::vector<Token> *tokens = nullptr;
     uint32_t current_tok_pos = 0;
+    // Streaming mode: tokens are pulled from the scanner while parsing and
+    // moved to token_store once consumed
+    Scanner *scanner = nullptr;
+    std::deque<Token> *token_store = nullptr;
+    Token lookahead = {};
+    bool has_lookahead = false;
+    const Token *prev_tok = nullptr;
+    // Nodes are allocated in the arena, which must outlive the AST
+    AstArena *arena;
+    // Storage used before the last streamed declaration
+    size_t declaration_token_num = 0;
+    AstArena::Mark declaration_mark = {};
 
-    std::shared_ptr<Stmt> parse_declaration();
-    std::shared_ptr<Stmt> parse_stmt();
-    std::shared_ptr<ReturnStmt> parse_return_stmt();
-    std::shared_ptr<BlockStmt> parse_block_stmt();
-    std::shared_ptr<FunctionDecl> parse_function_decl();
-    std::shared_ptr<ClassDecl> parse_class_decl();
-    std::shared_ptr<FunctionDecl> parse_function();
+    Stmt *parse_declaration();
+    Stmt *parse_stmt();
+    ReturnStmt *parse_return_stmt();
+    BlockStmt *parse_block_stmt();
+    FunctionDecl *parse_function_decl();
+    ClassDecl *parse_class_decl();
+    ImportStmt *parse_import_stmt();
+    FunctionDecl *parse_function();
     // return BlockStmt or WhileStmt
-    std::shared_ptr<Stmt> parse_for_stmt();
-    std::shared_ptr<WhileStmt> parse_while_stmt();
-    std::shared_ptr<BreakStmt> parse_break_stmt();
-    std::shared_ptr<ContinueStmt> parse_continue_stmt();
-    std::shared_ptr<IfStmt> parse_if_stmt();
-    std::shared_ptr<VarDecl> parse_var_decl();
+    Stmt *parse_for_stmt();
+    WhileStmt *parse_while_stmt();
+    BreakStmt *parse_break_stmt();
+    ContinueStmt *parse_continue_stmt();
+    IfStmt *parse_if_stmt();
+    VarDecl *parse_var_decl();
     // return SetClassFieldStmt or AssignStmt
-    std::shared_ptr<Stmt> parse_assign_stmt();
-    std::shared_ptr<Expr> parse_expr();
-    std::shared_ptr<Expr> parse_logic_or_expr();
-    std::shared_ptr<Expr> parse_logic_and_expr();
-    std::shared_ptr<Expr> parse_equality_expr();
-    std::shared_ptr<Expr> parse_comparision_expr();
-    std::shared_ptr<Expr> parse_term();
-    std::shared_ptr<Expr> parse_factor();
-    std::shared_ptr<Expr> parse_unary();
-    std::shared_ptr<Expr> parse_call();
-    std::vector<std::shared_ptr<IdentifierExpr>> parse_func_params();
-    std::vector<std::shared_ptr<Expr>> parse_func_call_arguments();
-    std::shared_ptr<Expr> parse_primary();
+    Stmt *parse_assign_stmt();
+    Expr *parse_expr();
+    Expr *parse_logic_or_expr();
+    Expr *parse_logic_and_expr();
+    Expr *parse_equality_expr();
+    Expr *parse_comparision_expr();
+    Expr *parse_term();
+    Expr *parse_factor();
+    Expr *parse_unary();
+    Expr *parse_call();
+    std::vector<IdentifierExpr *> parse_func_params();
+    std::vector<Expr *> parse_func_call_arguments();
+    Expr *parse_primary();
 
     bool consumed_all_tokens();
     bool validate_token_and_advance(const std::vector<TokenType> &tok_types);
-    std::shared_ptr<Token> assert_tok_and_advance(TokenType type,
-                                                  std::string msg);
+    const Token *assert_tok_and_advance(TokenType type, std::string msg);
     bool validate_token(TokenType tok_type);
-    std::shared_ptr<Token> get_prev_tok();
-    std::shared_ptr<Token> advance();
-    std::shared_ptr<Token> get_cur_tok();
+    const Token *get_prev_tok();
+    const Token *advance();
+    const Token *get_cur_tok();
 
     void panic_mode_synchornize();
 
   public:
-    Parser(const std::vector<std::shared_ptr<Token>> &tokens);
+    Parser(const std::vector<Token> &tokens, AstArena &arena);
+    Parser(Scanner &scanner, std::deque<Token> &token_store, AstArena &arena);
 
-    std::vector<std::shared_ptr<Stmt>> parse_program();
-    std::shared_ptr<Expr> parse_single_expr();
+    std::vector<Stmt *> parse_program();
+    Expr *parse_single_expr();
+
+    // Streaming mode: parse the program one top-level declaration at a time
+    bool at_end();
+    // Return nullptr on syntax error
+    Stmt *parse_next_declaration();
+    // Free the tokens of the last declaration and the nodes allocated in the
+    // arena since it was parsed, nothing must refer to them anymore
+    void release_last_declaration();
 };
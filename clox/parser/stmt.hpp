@@ -18,6 +18,8 @@ class FunctionDecl;
 class ReturnStmt;
 class ClassDecl;
 class SetClassFieldStmt;
+class ImportStmt;
+struct Module;
 
 class IStmtVisitor {
   public:
@@ -27,7 +29,7 @@ class IStmtVisitor {
     virtual void visit_assign_stmt(const AssignStmt &) = 0;
     virtual void
     visit_block_stmt(const BlockStmt &b,
-                     std::shared_ptr<Environment> block_env = nullptr) = 0;
+                     Environment *block_env = nullptr) = 0;
     virtual void visit_if_stmt(const IfStmt &) = 0;
     virtual void visit_while_stmt(const WhileStmt &) = 0;
     virtual void visit_break_stmt(const BreakStmt &) = 0;
@@ -35,6 +37,7 @@ class IStmtVisitor {
     virtual void visit_return_stmt(const ReturnStmt &) = 0;
     virtual void visit_class_decl(const ClassDecl &) = 0;
     virtual void visit_set_class_field(const SetClassFieldStmt &) = 0;
+    virtual void visit_import_stmt(const ImportStmt &) = 0;
 };
 
 // We use the same class Stmt for both statment and declaration for simplicity
@@ -46,19 +49,23 @@ class Stmt {
 
 class ExprStmt : public Stmt {
   public:
-    std::shared_ptr<Expr> expr;
+    Expr *expr;
 
-    ExprStmt(std::shared_ptr<Expr> expr) : expr(expr) {};
+    ExprStmt(Expr *expr) : expr(expr) {};
 
     void accept(IStmtVisitor &v) override { return v.visit_expr_stmt(*this); }
 };
 
 class VarDecl : public Stmt {
   public:
-    std::shared_ptr<Token> var_name;
-    std::shared_ptr<Expr> initializer;
-
-    VarDecl(std::shared_ptr<Token> var_name, std::shared_ptr<Expr> initializer)
+    const Token *var_name;
+    Expr *initializer;
+    // Slot of the variable in the env it is declared in, set by resolver
+    mutable uint slot = 0;
+    // Set by resolver when a closure captures the variable, see Cell
+    mutable bool is_captured = false;
+
+    VarDecl(const Token *var_name, Expr *initializer)
         : var_name(var_name), initializer(initializer) {};
 
     void accept(IStmtVisitor &v) override { return v.visit_var_decl(*this); }
@@ -66,37 +73,39 @@ class VarDecl : public Stmt {
 
 class AssignStmt : public Stmt {
   public:
-    std::shared_ptr<IdentifierExpr> var;
-    std::shared_ptr<Expr> value;
+    IdentifierExpr *var;
+    Expr *value;
 
-    AssignStmt(std::shared_ptr<IdentifierExpr> var, std::shared_ptr<Expr> value)
-        : var(var), value(value) {}
+    AssignStmt(IdentifierExpr *var, Expr *value) : var(var), value(value) {}
 
     void accept(IStmtVisitor &v) override { return v.visit_assign_stmt(*this); }
 };
 
 class BlockStmt : public Stmt {
   public:
-    std::vector<std::shared_ptr<Stmt>> stmts;
+    std::vector<Stmt *> stmts;
     // This is used when we exec continue statement in a for loop, run this
     // statement to increment the loop variable before jumping out from the
     // block scope
-    std::shared_ptr<Stmt> for_loop_increment = nullptr;
+    Stmt *for_loop_increment = nullptr;
+    // Number of identifiers declared in the block scope, set by resolver. For
+    // a function body, it includes the function params. A block with no slot
+    // has no scope, it runs in the env of the enclosing scope.
+    mutable uint slot_num = 0;
 
-    BlockStmt(const std::vector<std::shared_ptr<Stmt>> &stmts) : stmts(stmts) {}
+    BlockStmt(const std::vector<Stmt *> &stmts) : stmts(stmts) {}
 
     void accept(IStmtVisitor &v) override { return v.visit_block_stmt(*this); }
 };
 
 class IfStmt : public Stmt {
   public:
-    std::vector<std::shared_ptr<Expr>> conditions;
-    std::vector<std::shared_ptr<Stmt>> if_blocks;
-    std::shared_ptr<Stmt> else_block;
+    std::vector<Expr *> conditions;
+    std::vector<Stmt *> if_blocks;
+    Stmt *else_block;
 
-    IfStmt(std::vector<std::shared_ptr<Expr>> &conditions,
-           std::vector<std::shared_ptr<Stmt>> &if_blocks,
-           std::shared_ptr<Stmt> else_block)
+    IfStmt(std::vector<Expr *> &conditions, std::vector<Stmt *> &if_blocks,
+           Stmt *else_block)
         : conditions(conditions), if_blocks(if_blocks), else_block(else_block) {
     }
 
@@ -105,10 +114,10 @@ class IfStmt : public Stmt {
 
 class WhileStmt : public Stmt {
   public:
-    std::shared_ptr<Expr> condition;
-    std::shared_ptr<BlockStmt> body;
+    Expr *condition;
+    BlockStmt *body;
 
-    WhileStmt(std::shared_ptr<Expr> condition, std::shared_ptr<BlockStmt> body)
+    WhileStmt(Expr *condition, BlockStmt *body)
         : condition(condition), body(body) {}
 
     void accept(IStmtVisitor &v) override { return v.visit_while_stmt(*this); }
@@ -116,35 +125,45 @@ class WhileStmt : public Stmt {
 
 class BreakStmt : public Stmt {
   public:
-    std::shared_ptr<Token> break_kw;
+    const Token *break_kw;
 
-    BreakStmt(std::shared_ptr<Token> break_kw) : break_kw(break_kw) {}
+    BreakStmt(const Token *break_kw) : break_kw(break_kw) {}
     void accept(IStmtVisitor &v) override { return v.visit_break_stmt(*this); }
 };
 
-class BreakKwException : public std::exception {};
 class ContinueStmt : public Stmt {
   public:
-    std::shared_ptr<Token> continue_kw;
+    const Token *continue_kw;
 
-    ContinueStmt(std::shared_ptr<Token> continue_kw)
-        : continue_kw(continue_kw) {}
+    ContinueStmt(const Token *continue_kw) : continue_kw(continue_kw) {}
     void accept(IStmtVisitor &v) override {
         return v.visit_continue_stmt(*this);
     }
 };
 
-class ContinueKwException : public std::exception {};
+// Variable captured by a closure when it is created: a slot of the env
+// depth levels above the env the function is declared in, or an upvalue of
+// the enclosing function
+struct Capture {
+    bool is_local;
+    uint depth;
+    uint slot;
+};
 
 class FunctionDecl : public Stmt {
   public:
-    std::shared_ptr<Token> name;
-    std::vector<std::shared_ptr<IdentifierExpr>> params;
-    std::shared_ptr<BlockStmt> body;
-
-    FunctionDecl(std::shared_ptr<Token> name,
-                 std::vector<std::shared_ptr<IdentifierExpr>> &params,
-                 std::shared_ptr<BlockStmt> body)
+    const Token *name;
+    std::vector<IdentifierExpr *> params;
+    BlockStmt *body;
+    // Slot of the function name in the env it is declared in, set by resolver
+    mutable uint slot = 0;
+    mutable bool is_captured = false;
+    // Variables of the enclosing functions referenced by the function or the
+    // functions nested in it, set by resolver. Index i is upvalue i.
+    mutable std::vector<Capture> captures = {};
+
+    FunctionDecl(const Token *name, std::vector<IdentifierExpr *> &params,
+                 BlockStmt *body)
         : name(name), params(params), body(body) {}
 
     void accept(IStmtVisitor &v) override {
@@ -154,30 +173,29 @@ class FunctionDecl : public Stmt {
 
 class ReturnStmt : public Stmt {
   public:
-    std::shared_ptr<Token> return_kw; // used for err reporting
-    std::shared_ptr<Expr> expr;
+    const Token *return_kw; // used for err reporting
+    Expr *expr;
+    // Set by resolver when expr is a call in a function: the call can reuse
+    // the frame of the returning function
+    mutable bool is_tail_call = false;
 
-    ReturnStmt(std::shared_ptr<Token> return_kw, std::shared_ptr<Expr> expr)
+    ReturnStmt(const Token *return_kw, Expr *expr)
         : return_kw(return_kw), expr(expr) {}
 
     void accept(IStmtVisitor &v) override { return v.visit_return_stmt(*this); }
 };
 
-class ReturnKwException : std::exception {
-  public:
-    ExprVal return_val;
-    ReturnKwException(ExprVal return_val) : return_val(return_val) {}
-};
-
 class ClassDecl : public Stmt {
   public:
-    std::shared_ptr<Token> name;
-    std::shared_ptr<IdentifierExpr> superclass;
-    std::vector<std::shared_ptr<FunctionDecl>> methods;
-
-    ClassDecl(std::shared_ptr<Token> name,
-              std::shared_ptr<IdentifierExpr> superclass,
-              std::vector<std::shared_ptr<FunctionDecl>> &methods)
+    const Token *name;
+    IdentifierExpr *superclass;
+    std::vector<FunctionDecl *> methods;
+    // Slot of the class name in the env it is declared in, set by resolver
+    mutable uint slot = 0;
+    mutable bool is_captured = false;
+
+    ClassDecl(const Token *name, IdentifierExpr *superclass,
+              std::vector<FunctionDecl *> &methods)
         : name(name), superclass(superclass), methods(methods) {}
 
     void accept(IStmtVisitor &v) override { return v.visit_class_decl(*this); }
@@ -185,16 +203,32 @@ class ClassDecl : public Stmt {
 
 class SetClassFieldStmt : public Stmt {
   public:
-    std::shared_ptr<Expr> lox_instance;
-    std::shared_ptr<Token> field_token;
-    std::shared_ptr<Expr> value;
+    Expr *lox_instance;
+    const Token *field_token;
+    Expr *value;
+    // Filled by the AstInterpreter when the stmt is executed
+    mutable PropertyCache cache = {};
 
-    SetClassFieldStmt(std::shared_ptr<Expr> lox_instance,
-                      std::shared_ptr<Token> field_token,
-                      std::shared_ptr<Expr> value)
+    SetClassFieldStmt(Expr *lox_instance, const Token *field_token, Expr *value)
         : lox_instance(lox_instance), field_token(field_token), value(value) {}
 
     void accept(IStmtVisitor &v) override {
         return v.visit_set_class_field(*this);
     }
 };
+
+class ImportStmt : public Stmt {
+  public:
+    const Token *import_kw;
+    // String token, its literal is the path of the module
+    const Token *path;
+    // Set by the resolver: the loaded module and the slot of each of its
+    // exports in the importing scope
+    mutable const Module *module = nullptr;
+    mutable std::vector<uint> slots = {};
+
+    ImportStmt(const Token *import_kw, const Token *path)
+        : import_kw(import_kw), path(path) {}
+
+    void accept(IStmtVisitor &v) override { return v.visit_import_stmt(*this); }
+};
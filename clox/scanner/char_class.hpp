@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Class bits of each char, computed at compile time so that the scanner
+// checks a class with one table load instead of a <cctype> call.
+enum CharClass : uint8_t {
+    CHAR_BLANK = 1 << 0,
+    CHAR_DIGIT = 1 << 1,
+    // Letters and '_', they can start an identifier
+    CHAR_ALPHA = 1 << 2,
+    CHAR_IDENTIFIER = CHAR_ALPHA | CHAR_DIGIT,
+};
+
+constexpr std::array<uint8_t, 256> make_char_classes() {
+    std::array<uint8_t, 256> classes = {};
+    classes[' '] = classes['\t'] = classes['\r'] = classes['\n'] = CHAR_BLANK;
+    for (char c = '0'; c <= '9'; ++c) {
+        classes[c] = CHAR_DIGIT;
+    }
+    for (char c = 'a'; c <= 'z'; ++c) {
+        classes[c] = classes[c - 'a' + 'A'] = CHAR_ALPHA;
+    }
+    classes['_'] = CHAR_ALPHA;
+    return classes;
+}
+
+constexpr std::array<uint8_t, 256> CHAR_CLASSES = make_char_classes();
+
+// Return whether the char belongs to one of the classes
+constexpr bool char_is(char c, uint8_t classes) {
+    return CHAR_CLASSES[static_cast<uint8_t>(c)] & classes;
+}
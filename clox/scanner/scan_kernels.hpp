@@ -0,0 +1,181 @@
+#pragma once
+#include "clox/scanner/char_class.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Kernels used by the scanner to skip whitespace, comments, string bodies
+// and identifiers 32 (AVX2) or 16 (SSE2) bytes at a time. The bytes left
+// after the last full vector, or the whole input on other targets, are
+// scanned one char at a time. Kernels crossing new lines add them to line.
+
+#if defined(__AVX2__)
+#define CLOX_SCAN_VECTOR_SIZE 32
+using ScanVector = __m256i;
+const uint32_t SCAN_FULL_MASK = 0xffffffff;
+
+inline ScanVector scan_load(const char *pos) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+}
+inline ScanVector scan_eq(ScanVector chars, char c) {
+    return _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(c));
+}
+// Signed compare, bytes >= 0x80 are never inside an ASCII range
+inline ScanVector scan_in_range(ScanVector chars, char low, char high) {
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(chars, _mm256_set1_epi8(low - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chars));
+}
+inline ScanVector scan_or(ScanVector a, ScanVector b) {
+    return _mm256_or_si256(a, b);
+}
+inline ScanVector scan_and(ScanVector a, ScanVector b) {
+    return _mm256_and_si256(a, b);
+}
+inline uint32_t scan_mask(ScanVector matches) {
+    return _mm256_movemask_epi8(matches);
+}
+#elif defined(__SSE2__)
+#define CLOX_SCAN_VECTOR_SIZE 16
+using ScanVector = __m128i;
+const uint32_t SCAN_FULL_MASK = 0xffff;
+
+inline ScanVector scan_load(const char *pos) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+}
+inline ScanVector scan_eq(ScanVector chars, char c) {
+    return _mm_cmpeq_epi8(chars, _mm_set1_epi8(c));
+}
+// Signed compare, bytes >= 0x80 are never inside an ASCII range
+inline ScanVector scan_in_range(ScanVector chars, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(high + 1), chars));
+}
+inline ScanVector scan_or(ScanVector a, ScanVector b) {
+    return _mm_or_si128(a, b);
+}
+inline ScanVector scan_and(ScanVector a, ScanVector b) {
+    return _mm_and_si128(a, b);
+}
+inline uint32_t scan_mask(ScanVector matches) {
+    return _mm_movemask_epi8(matches);
+}
+#endif
+
+#ifdef CLOX_SCAN_VECTOR_SIZE
+// Return the first position whose mask bit is set by find, or the position
+// where less than a vector (plus lookahead bytes) is left to scan.
+template <bool count_lines, typename Find>
+inline const char *scan_vectors(const char *pos, const char *end, uint &line,
+                                size_t lookahead, Find find) {
+    while (size_t(end - pos) >= CLOX_SCAN_VECTOR_SIZE + lookahead) {
+        ScanVector chars = scan_load(pos);
+        uint32_t found = find(pos, chars);
+        uint32_t new_lines = count_lines ? scan_mask(scan_eq(chars, '\n')) : 0;
+        if (found != 0) {
+            uint offset = __builtin_ctz(found);
+            line += __builtin_popcount(new_lines & ((1u << offset) - 1));
+            return pos + offset;
+        }
+        line += __builtin_popcount(new_lines);
+        pos += CLOX_SCAN_VECTOR_SIZE;
+    }
+    return pos;
+}
+#endif
+
+// Return the first position where found returns true, or end
+template <typename Found>
+inline const char *scan_chars(const char *pos, const char *end, uint &line,
+                              size_t lookahead, Found found) {
+    for (; size_t(end - pos) > lookahead; ++pos) {
+        if (found(pos)) {
+            return pos;
+        }
+        line += *pos == '\n';
+    }
+    for (; pos < end; ++pos) {
+        line += *pos == '\n';
+    }
+    return end;
+}
+
+// Skip spaces, tabs and new lines
+inline const char *skip_blank(const char *pos, const char *end, uint &line) {
+#ifdef CLOX_SCAN_VECTOR_SIZE
+    auto find = [](const char *, ScanVector chars) {
+        ScanVector blank =
+            scan_or(scan_or(scan_eq(chars, ' '), scan_eq(chars, '\t')),
+                    scan_or(scan_eq(chars, '\r'), scan_eq(chars, '\n')));
+        return ~scan_mask(blank) & SCAN_FULL_MASK;
+    };
+    pos = scan_vectors<true>(pos, end, line, 0, find);
+#endif
+    return scan_chars(pos, end, line, 0,
+                      [](const char *c) { return !char_is(*c, CHAR_BLANK); });
+}
+
+// Return the end of the line comment starting at pos
+inline const char *find_line_end(const char *pos, const char *end) {
+    uint line = 0;
+#ifdef CLOX_SCAN_VECTOR_SIZE
+    auto find = [](const char *, ScanVector chars) {
+        return scan_mask(scan_eq(chars, '\n'));
+    };
+    pos = scan_vectors<false>(pos, end, line, 0, find);
+#endif
+    return scan_chars(pos, end, line, 0,
+                      [](const char *c) { return *c == '\n'; });
+}
+
+// Return the closing quote of the string whose body starts at pos
+inline const char *find_string_end(const char *pos, const char *end,
+                                   uint &line) {
+#ifdef CLOX_SCAN_VECTOR_SIZE
+    auto find = [](const char *, ScanVector chars) {
+        return scan_mask(scan_eq(chars, '"'));
+    };
+    pos = scan_vectors<true>(pos, end, line, 0, find);
+#endif
+    return scan_chars(pos, end, line, 0,
+                      [](const char *c) { return *c == '"'; });
+}
+
+// Return the "*/" closing the block comment whose body starts at pos
+inline const char *find_block_comment_end(const char *pos, const char *end,
+                                          uint &line) {
+#ifdef CLOX_SCAN_VECTOR_SIZE
+    auto find = [](const char *c, ScanVector chars) {
+        return scan_mask(scan_and(scan_eq(chars, '*'),
+                                  scan_eq(scan_load(c + 1), '/')));
+    };
+    pos = scan_vectors<true>(pos, end, line, 1, find);
+#endif
+    return scan_chars(pos, end, line, 1,
+                      [](const char *c) { return c[0] == '*' && c[1] == '/'; });
+}
+
+// Skip the letters, digits and underscores of an identifier
+inline const char *skip_identifier(const char *pos, const char *end) {
+    uint line = 0;
+#ifdef CLOX_SCAN_VECTOR_SIZE
+    auto find = [](const char *, ScanVector chars) {
+        ScanVector identifier =
+            scan_or(scan_or(scan_in_range(chars, 'a', 'z'),
+                            scan_in_range(chars, 'A', 'Z')),
+                    scan_or(scan_in_range(chars, '0', '9'),
+                            scan_eq(chars, '_')));
+        return ~scan_mask(identifier) & SCAN_FULL_MASK;
+    };
+    pos = scan_vectors<false>(pos, end, line, 0, find);
+#endif
+    return scan_chars(pos, end, line, 0, [](const char *c) {
+        return !char_is(*c, CHAR_IDENTIFIER);
+    });
+}
@@ -1,13 +1,21 @@
 #include "clox/scanner/scanner.hpp"
 #include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
 #include "clox/common/token.hpp"
-#include <cctype>
+#include "clox/scanner/char_class.hpp"
+#include "clox/scanner/scan_kernels.hpp"
+#include <charconv>
+#include <cstdlib>
 #include <memory>
 #include <string>
 
-Scanner::Scanner(std::string src) { this->src = src; }
+Scanner::Scanner(std::string_view src, uint first_line)
+    : src(src), line(first_line) {}
 
-std::vector<std::shared_ptr<Token>> Scanner::scan_tokens() {
+std::vector<Token> Scanner::scan_tokens() {
+    // About one token every 6 source bytes, the pages of the reserved
+    // capacity are only touched once used
+    tokens.reserve(src.size() / 6);
     while (!is_end_of_src()) {
         lexeme_start_pos = current_pos;
         scan_token();
@@ -16,12 +24,26 @@ std::vector<std::shared_ptr<Token>> Scanner::scan_tokens() {
     return tokens;
 }
 
+bool Scanner::scan_next_token(Token &token) {
+    while (!is_end_of_src()) {
+        lexeme_start_pos = current_pos;
+        scan_token();
+        // Blanks and comments don't add a token
+        if (!tokens.empty()) {
+            token = tokens.back();
+            tokens.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Scanner::is_end_of_src() {
     return this->current_pos >= this->src.length();
 }
 
 void Scanner::scan_token() {
-    char c = src.at(current_pos);
+    char c = src[current_pos];
     move_to_next_pos();
 
     switch (c) {
@@ -77,23 +99,14 @@ void Scanner::scan_token() {
         break;
     case '/':
         if (next_char_is('/')) {
-            while (!is_end_of_src() && src.at(current_pos) != '\n') {
-                move_to_next_pos();
-            }
+            move_to(find_line_end(pos(), src_end()));
         } else if (next_char_is('*')) {
-            while (current_pos < src.length() - 1 &&
-                   !(src.at(current_pos) == '*' &&
-                     src.at(current_pos + 1) == '/')) {
-                if (src.at(current_pos) == '\n') {
-                    line++;
-                }
-                move_to_next_pos();
-            }
-            if (current_pos == src.length() - 1) {
-                move_to_next_pos();
+            const char *comment_end =
+                find_block_comment_end(pos(), src_end(), line);
+            if (comment_end == src_end()) {
+                move_to(comment_end);
             } else { // found */ to close block of cmts
-                move_to_next_pos();
-                move_to_next_pos();
+                move_to(comment_end + 2);
             }
         } else {
             add_token(TokenType::SLASH);
@@ -102,18 +115,18 @@ void Scanner::scan_token() {
     case ' ':
     case '\r':
     case '\t':
-        break;
     case '\n':
-        line++;
+        // Skip the whole run of blanks from the consumed one
+        move_to(skip_blank(pos() - 1, src_end(), line));
         break;
     case '"':
         parse_str();
         break;
     default:
-        if (std::isdigit(c)) {
+        if (char_is(c, CHAR_DIGIT)) {
             parse_num();
             break;
-        } else if (std::isalpha(c) || c == '_') {
+        } else if (char_is(c, CHAR_ALPHA)) {
             parse_identifier();
             break;
         } else {
@@ -124,9 +137,9 @@ void Scanner::scan_token() {
 }
 
 void Scanner::add_token(TokenType type, ExprVal literal) {
-    std::string lexeme =
+    std::string_view lexeme =
         src.substr(lexeme_start_pos, current_pos - lexeme_start_pos);
-    tokens.push_back(std::make_shared<Token>(type, lexeme, literal, line));
+    tokens.push_back({lexeme, literal, line, type});
 }
 
 bool Scanner::next_char_is(char expected) {
@@ -134,7 +147,7 @@ bool Scanner::next_char_is(char expected) {
         return false;
     }
 
-    if (src.at(current_pos) == expected) {
+    if (src[current_pos] == expected) {
         move_to_next_pos();
         return true;
     }
@@ -144,59 +157,70 @@ bool Scanner::next_char_is(char expected) {
 
 void Scanner::parse_str() {
     uint str_start_pos = current_pos;
-
-    while (!is_end_of_src() and src.at(current_pos) != '"') {
-        if (src.at(current_pos) == '\n') {
-            line++;
-        }
-        move_to_next_pos();
-    }
+    move_to(find_string_end(pos(), src_end(), line));
 
     if (is_end_of_src()) {
         ErrorManager::handle_scanner_err(line, "Unterminated string");
         return;
     }
 
-    std::string str = src.substr(str_start_pos, current_pos - str_start_pos);
-    add_token(TokenType::STRING, str);
+    std::string_view str =
+        src.substr(str_start_pos, current_pos - str_start_pos);
+    // Literals are referenced by the AST, they are never collected
+    add_token(TokenType::STRING, Heap::make_pinned_string(str));
     move_to_next_pos();
 }
 
 void Scanner::parse_num() {
     uint str_start_pos = current_pos - 1;
 
-    while (!is_end_of_src() and std::isdigit(src.at(current_pos))) {
+    while (!is_end_of_src() and char_is(src[current_pos], CHAR_DIGIT)) {
         move_to_next_pos();
     }
 
-    if (!is_end_of_src() && src.at(current_pos) == '.') {
+    if (!is_end_of_src() && src[current_pos] == '.') {
         move_to_next_pos();
-        while (!is_end_of_src() and std::isdigit(src.at(current_pos))) {
+        while (!is_end_of_src() and char_is(src[current_pos], CHAR_DIGIT)) {
             move_to_next_pos();
         }
     }
 
-    std::string num_str =
-        src.substr(str_start_pos, current_pos - str_start_pos);
-    double num = std::stod(num_str);
+    // Parse the digits in place, without copying them
+    const char *num_start = src.data() + str_start_pos;
+    double num = 0;
+    auto [num_end, err] = std::from_chars(num_start, pos(), num);
+    // A literal out of the double range is rounded to inf or 0, as strtod
+    // does
+    if (err == std::errc::result_out_of_range) {
+        num = std::strtod(std::string(num_start, num_end).c_str(), nullptr);
+    }
     add_token(TokenType::NUMBER, num);
 }
 
 void Scanner::parse_identifier() {
     uint str_start_pos = current_pos - 1;
 
-    while (!is_end_of_src() &&
-           (std::isalnum(src.at(current_pos)) || src.at(current_pos) == '_')) {
-        move_to_next_pos();
-    }
+    move_to(skip_identifier(pos(), src_end()));
 
-    std::string identifier_str =
+    std::string_view identifier_str =
         src.substr(str_start_pos, current_pos - str_start_pos);
-    if (reserved_kws.find(identifier_str) == reserved_kws.end()) {
-        add_token(TokenType::IDENTIFIER, identifier_str);
+    TokenType type = find_keyword(identifier_str);
+    if (type == TokenType::IDENTIFIER) {
+        // Identifier names are interned once, the runtime uses them as
+        // property keys
+        add_token(TokenType::IDENTIFIER,
+                  Heap::make_pinned_string(identifier_str));
     } else {
-        add_token(reserved_kws.at(identifier_str));
+        add_token(type);
     }
 }
 
-void Scanner::move_to_next_pos() { current_pos++; }
\ No newline at end of file
+void Scanner::move_to_next_pos() { current_pos++; }
+
+void Scanner::move_to(const char *new_pos) {
+    current_pos = new_pos - src.data();
+}
+
+const char *Scanner::pos() const { return src.data() + current_pos; }
+
+const char *Scanner::src_end() const { return src.data() + src.size(); }
\ No newline at end of file
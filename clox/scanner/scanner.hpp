@@ -3,20 +3,25 @@
 #include "clox/common/constants.hpp"
 #include "clox/common/token.hpp"
 #include <memory>
+#include <string_view>
 #include <vector>
 
-// Scan the whole file or a single line to return a vector of tokens
+// Scan the whole file or a single line to return a vector of tokens. The
+// lexemes view the source, the caller keeps it alive as long as the tokens.
 class Scanner {
   private:
-    std::string src = "";
-    std::vector<std::shared_ptr<Token>> tokens = {};
+    std::string_view src = "";
+    std::vector<Token> tokens = {};
     uint lexeme_start_pos = 0;
     uint current_pos = 0;
     uint line = 1;
 
   public:
-    Scanner(std::string src);
-    std::vector<std::shared_ptr<Token>> scan_tokens();
+    // first_line is the line of the first char, when src is a part of a file
+    Scanner(std::string_view src, uint first_line = 1);
+    std::vector<Token> scan_tokens();
+    // Scan only the next token, return false at the end of the source
+    bool scan_next_token(Token &token);
 
   private:
     void scan_token();
@@ -27,4 +32,7 @@ class Scanner {
     void parse_num();
     void parse_identifier();
     void move_to_next_pos();
+    void move_to(const char *new_pos);
+    const char *pos() const;
+    const char *src_end() const;
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "clox/scanner/source_buffer.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::~SourceBuffer() { unmap(); }
+
+bool SourceBuffer::load_file(const std::string &path) {
+    unmap();
+    text.clear();
+    content = "";
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+        file_stat.st_size > 0) {
+        size_t size = file_stat.st_size;
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            // The scanner reads the file once from start to end
+            madvise(addr, size, MADV_SEQUENTIAL);
+            close(fd);
+            mapping = addr;
+            mapping_size = size;
+            content = std::string_view(static_cast<const char *>(addr), size);
+            return true;
+        }
+    }
+
+    // Pipes and special files have no size to map, read them until EOF
+    bool ok = read_fd(fd);
+    close(fd);
+    return ok;
+}
+
+void SourceBuffer::load_text(std::string text) {
+    unmap();
+    this->text = std::move(text);
+    content = this->text;
+}
+
+bool SourceBuffer::read_fd(int fd) {
+    const size_t CHUNK_SIZE = 64 * 1024;
+    size_t size = 0;
+    while (true) {
+        text.resize(size + CHUNK_SIZE);
+        ssize_t read_size = read(fd, text.data() + size, CHUNK_SIZE);
+        if (read_size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read_size < 0) {
+            text.clear();
+            return false;
+        }
+        if (read_size == 0) {
+            break;
+        }
+        size += read_size;
+    }
+
+    text.resize(size);
+    content = text;
+    return true;
+}
+
+void SourceBuffer::unmap() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+}
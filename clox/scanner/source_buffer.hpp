@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only bytes of a program, scanned in place. A regular file is mapped
+// into memory so it is never copied, other inputs (pipe, interactive line)
+// are read into an owned string once.
+class SourceBuffer {
+  private:
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    std::string text = "";
+    std::string_view content = "";
+
+    bool read_fd(int fd);
+    void unmap();
+
+  public:
+    SourceBuffer() = default;
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    ~SourceBuffer();
+
+    // Return false when the file cannot be opened or read
+    bool load_file(const std::string &path);
+    void load_text(std::string text);
+    // Stays valid until the buffer is reloaded or destructed
+    std::string_view view() const { return content; }
+    bool is_mapped() const { return mapping != nullptr; }
+};
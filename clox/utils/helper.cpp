@@ -1,4 +1,5 @@
 #include "helper.hpp"
+#include <cmath>
 #include <iomanip>
 #include <sstream>
 
@@ -42,8 +43,6 @@ std::string double_to_string(double num) {
     }
 }
 
-void smart_pointer_no_op_deleter(void *) {}
-
 bool is_double_int(double num) {
     return std::floor(num) == num && std::isfinite(num);
 }
\ No newline at end of file
@@ -9,6 +9,4 @@ std::string strip(const std::string &str);
 
 std::string double_to_string(double num);
 
-void smart_pointer_no_op_deleter(void *);
-
 bool is_double_int(double num);
\ No newline at end of file
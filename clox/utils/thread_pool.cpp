@@ -0,0 +1,59 @@
+#include "clox/utils/thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_num) {
+    if (thread_num == 0) {
+        thread_num = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < thread_num; ++i) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopping = true;
+    }
+    task_added.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+        pending_num++;
+    }
+    task_added.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    task_done.wait(lock, [this] { return pending_num == 0; });
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_added.wait(lock,
+                            [this] { return is_stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending_num == 0) {
+            task_done.notify_all();
+        }
+    }
+}
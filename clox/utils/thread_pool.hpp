@@ -0,0 +1,35 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running the submitted tasks in FIFO order
+class ThreadPool {
+  private:
+    std::vector<std::thread> workers = {};
+    std::deque<std::function<void()>> tasks = {};
+    std::mutex mutex;
+    std::condition_variable task_added;
+    std::condition_variable task_done;
+    // Tasks submitted and not finished yet
+    size_t pending_num = 0;
+    bool is_stopping = false;
+
+    void work();
+
+  public:
+    // thread_num = 0 uses one thread per core
+    explicit ThreadPool(size_t thread_num = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+    // Block until every submitted task has finished
+    void wait();
+    size_t size() const { return workers.size(); }
+};
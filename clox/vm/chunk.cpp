@@ -0,0 +1,46 @@
+#include "clox/vm/chunk.hpp"
+#include "clox/common/heap.hpp"
+#include <algorithm>
+
+void Chunk::write(uint8_t byte, const Token *token) {
+    uint line = token != nullptr ? token->line : 0;
+    std::string_view lexeme = token != nullptr ? token->lexeme : "";
+    if (tokens.empty() || tokens.back().line != line ||
+        tokens.back().lexeme != lexeme) {
+        tokens.push_back({uint(code.size()), line, std::string(lexeme)});
+    }
+    code.push_back(byte);
+}
+
+Chunk::~Chunk() {
+    for (const auto &constant : constants) {
+        if (constant.is_object()) {
+            Heap::unpin(constant.as_object());
+        }
+    }
+}
+
+uint Chunk::add_constant(const ExprVal &value) {
+    if (value.is_object()) {
+        Heap::pin(value.as_object());
+    }
+    constants.push_back(value);
+    return constants.size() - 1;
+}
+
+uint Chunk::add_property_cache() {
+    property_caches.emplace_back();
+    return property_caches.size() - 1;
+}
+
+std::pair<uint, std::string_view> Chunk::get_token(uint offset) const {
+    auto it = std::upper_bound(
+        tokens.begin(), tokens.end(), offset,
+        [](uint offset, const TokenStart &t) {
+            return offset < t.start_offset;
+        });
+    if (it == tokens.begin()) {
+        return {0, ""};
+    }
+    return {std::prev(it)->line, std::prev(it)->lexeme};
+}
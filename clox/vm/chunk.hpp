@@ -0,0 +1,109 @@
+#pragma once
+#include "clox/common/expr_val.hpp"
+#include "clox/common/shape.hpp"
+#include "clox/common/token.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+class VmFunction;
+
+enum class OpCode : uint8_t {
+    CONSTANT,
+    NIL,
+    TRUE,
+    FALSE,
+    POP,
+    // Pop the top value and print it, used for expression statements in the
+    // interactive mode.
+    ECHO,
+    // SET_* instructions pop the assigned value as assignment is a statement
+    GET_LOCAL,
+    SET_LOCAL,
+    GET_GLOBAL,
+    DEFINE_GLOBAL,
+    SET_GLOBAL,
+    GET_UPVALUE,
+    SET_UPVALUE,
+    GET_PROPERTY,
+    SET_PROPERTY,
+    GET_SUPER,
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    MODULO,
+    // Lox "and"/"or" evaluate both operands and return a bool, same as the
+    // AstInterpreter.
+    AND,
+    OR,
+    NOT,
+    NEGATE,
+    JUMP,
+    JUMP_IF_FALSE,
+    LOOP,
+    CALL,
+    INVOKE,
+    // CALL/INVOKE of a tail return, a closure callee reuses the frame of the
+    // returning function
+    TAIL_CALL,
+    TAIL_INVOKE,
+    CLOSURE,
+    CLOSE_UPVALUE,
+    RETURN,
+    CLASS,
+    INHERIT,
+    METHOD,
+    // Call the script of a module the first time it is imported, push nil
+    // otherwise
+    IMPORT,
+};
+
+// A chunk of bytecode of a single function. Operands are stored inline after
+// their opcode: local slots and arg counts use 1 byte, constant/global/function
+// /property cache indexes and jump offsets use 2 bytes (big endian).
+class Chunk {
+  private:
+    // Run-length encoded token table: the instruction at offset is compiled
+    // from the token of the last entry whose start_offset <= offset. The
+    // lexeme is copied, the source may be released before the chunk.
+    struct TokenStart {
+        uint start_offset;
+        uint line;
+        std::string lexeme;
+    };
+    std::vector<TokenStart> tokens = {};
+
+  public:
+    std::vector<uint8_t> code = {};
+    std::vector<ExprVal> constants = {};
+    // Prototypes of the functions declared inside this chunk, referenced by
+    // OpCode::CLOSURE
+    std::vector<std::shared_ptr<VmFunction>> functions = {};
+    // Inline caches of the GET_PROPERTY/SET_PROPERTY/INVOKE instructions
+    std::vector<PropertyCache> property_caches = {};
+
+    Chunk() = default;
+    // The constants are pinned as long as the chunk lives
+    Chunk(const Chunk &) = delete;
+    Chunk &operator=(const Chunk &) = delete;
+    ~Chunk();
+
+    // token is nullptr for the instructions compiled from no token
+    void write(uint8_t byte, const Token *token);
+    uint add_constant(const ExprVal &value);
+    uint add_property_cache();
+    // Line and lexeme of the token of the instruction at offset, the lexeme
+    // is empty when unknown
+    std::pair<uint, std::string_view> get_token(uint offset) const;
+};
@@ -0,0 +1,666 @@
+#include "clox/vm/compiler.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/common/token.hpp"
+#include "clox/middleware/module_loader.hpp"
+#include "clox/parser/expr.hpp"
+#include "clox/parser/stmt.hpp"
+#include "clox/vm/vm.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+const uint MAX_LOCALS_NUM = 256;
+const uint MAX_SHORT_OPERAND = UINT16_MAX;
+
+Compiler::Compiler(VM &vm, const Module *module) : vm(vm), module(module) {}
+
+std::shared_ptr<VmFunction>
+Compiler::compile_program(const std::vector<Stmt *> &stmts) {
+    FunctionState script{};
+    begin_function(script, CompileFuncType::SCRIPT, "script");
+    try {
+        for (const auto &stmt : stmts) {
+            stmt->accept(*this);
+        }
+    } catch (StaticException &err) {
+        // Compile errors are limit errors, stop at the first one
+        ErrorManager::handle_static_err(err);
+        current = &script;
+    }
+    return end_function();
+}
+
+std::shared_ptr<VmFunction> Compiler::compile_single_expr(Expr &expr) {
+    FunctionState script{};
+    begin_function(script, CompileFuncType::SCRIPT, "script");
+    try {
+        expr.accept(*this);
+        emit_op(OpCode::RETURN);
+    } catch (StaticException &err) {
+        ErrorManager::handle_static_err(err);
+        current = &script;
+    }
+    return end_function();
+}
+
+void Compiler::begin_function(FunctionState &state, CompileFuncType type,
+                              std::string_view name) {
+    state.function = std::make_shared<VmFunction>();
+    state.function->name = name;
+    state.function->is_method = type == CompileFuncType::METHOD;
+    state.type = type;
+    state.enclosing = current;
+    current = &state;
+
+    // Slot 0 holds the callee, or the receiver "this" for methods
+    current->locals.push_back(
+        {type == CompileFuncType::METHOD ? "this" : "", 0, false});
+}
+
+std::shared_ptr<VmFunction> Compiler::end_function() {
+    emit_op(OpCode::NIL);
+    emit_op(OpCode::RETURN);
+
+    auto function = current->function;
+    function->upvalue_count = current->upvalues.size();
+    current = current->enclosing;
+    return function;
+}
+
+void Compiler::visit_expr_stmt(const ExprStmt &expr_stmt) {
+    expr_stmt.expr->accept(*this);
+    emit_op(vm.is_interactive_mode ? OpCode::ECHO : OpCode::POP);
+}
+
+void Compiler::visit_assign_stmt(const AssignStmt &assign_stmt) {
+    assign_stmt.value->accept(*this);
+    token = assign_stmt.var->token;
+    set_variable(assign_stmt.var->token->lexeme);
+}
+
+void Compiler::visit_var_decl(const VarDecl &var_decl) {
+    if (var_decl.initializer != nullptr) {
+        var_decl.initializer->accept(*this);
+    } else {
+        emit_op(OpCode::NIL);
+    }
+    token = var_decl.var_name;
+    define_variable(var_decl.var_name->lexeme);
+}
+
+void Compiler::visit_block_stmt(const BlockStmt &block_stmt, Environment *) {
+    begin_scope();
+    for (const auto &stmt : block_stmt.stmts) {
+        stmt->accept(*this);
+    }
+    end_scope();
+}
+
+void Compiler::visit_if_stmt(const IfStmt &if_stmt) {
+    std::vector<uint> end_jumps{};
+
+    for (size_t j = 0; j < if_stmt.conditions.size(); ++j) {
+        if_stmt.conditions[j]->accept(*this);
+        uint next_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+        emit_op(OpCode::POP);
+        if_stmt.if_blocks[j]->accept(*this);
+        end_jumps.push_back(emit_jump(OpCode::JUMP));
+
+        patch_jump(next_jump);
+        emit_op(OpCode::POP);
+    }
+
+    if (if_stmt.else_block != nullptr) {
+        if_stmt.else_block->accept(*this);
+    }
+
+    for (uint end_jump : end_jumps) {
+        patch_jump(end_jump);
+    }
+}
+
+void Compiler::visit_while_stmt(const WhileStmt &while_stmt) {
+    uint loop_start = chunk().code.size();
+    // A while without condition, left by the AstOptimizer, has no exit jump
+    int exit_jump = -1;
+    if (while_stmt.condition != nullptr) {
+        while_stmt.condition->accept(*this);
+        exit_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+        emit_op(OpCode::POP);
+    }
+
+    current->loops.push_back({current->scope_depth, current->scope_depth,
+                              int(loop_start)});
+    compile_loop_body(*while_stmt.body);
+    emit_loop(loop_start);
+
+    if (exit_jump != -1) {
+        patch_jump(exit_jump);
+        emit_op(OpCode::POP);
+    }
+
+    for (uint break_jump : current->loops.back().break_jumps) {
+        patch_jump(break_jump);
+    }
+    current->loops.pop_back();
+}
+
+/*
+The for loop increment is the last stmt of the loop body and continue has to
+jump to it. The other body stmts are compiled in an inner scope so that no
+local of the body is left on the stack when continue jumps to the increment:
+    {
+        { body stmts }
+    continue_target:
+        increment;
+    }
+*/
+void Compiler::compile_loop_body(const BlockStmt &body) {
+    if (body.for_loop_increment == nullptr) {
+        visit_block_stmt(body);
+        return;
+    }
+
+    begin_scope();
+    current->loops.back().continue_scope_depth = current->scope_depth;
+    current->loops.back().continue_target = -1;
+
+    begin_scope();
+    for (int i = 0; i < int(body.stmts.size()) - 1; ++i) {
+        body.stmts[i]->accept(*this);
+    }
+    end_scope();
+
+    for (uint continue_jump : current->loops.back().continue_jumps) {
+        patch_jump(continue_jump);
+    }
+    body.for_loop_increment->accept(*this);
+    end_scope();
+}
+
+void Compiler::visit_break_stmt(const BreakStmt &break_stmt) {
+    token = break_stmt.break_kw;
+    Loop &loop = current->loops.back();
+    emit_pops_until(loop.break_scope_depth);
+    loop.break_jumps.push_back(emit_jump(OpCode::JUMP));
+}
+
+void Compiler::visit_continue_stmt(const ContinueStmt &continue_stmt) {
+    token = continue_stmt.continue_kw;
+    Loop &loop = current->loops.back();
+    emit_pops_until(loop.continue_scope_depth);
+    if (loop.continue_target >= 0) {
+        emit_loop(loop.continue_target);
+    } else {
+        loop.continue_jumps.push_back(emit_jump(OpCode::JUMP));
+    }
+}
+
+void Compiler::visit_function_decl(FunctionDecl &func_decl) {
+    token = func_decl.name;
+    // Declare the function before compiling its body to support recursion
+    if (current->scope_depth > 0) {
+        add_local(func_decl.name->lexeme);
+        compile_function(func_decl, CompileFuncType::FUNCTION);
+    } else {
+        compile_function(func_decl, CompileFuncType::FUNCTION);
+        define_variable(func_decl.name->lexeme);
+    }
+}
+
+void Compiler::compile_function(const FunctionDecl &func_decl,
+                                CompileFuncType type) {
+    FunctionState state{};
+    begin_function(state, type, func_decl.name->lexeme);
+    begin_scope();
+
+    current->function->arity = func_decl.params.size();
+    for (const auto &param : func_decl.params) {
+        add_local(param->token->lexeme);
+    }
+    for (const auto &stmt : func_decl.body->stmts) {
+        stmt->accept(*this);
+    }
+
+    std::vector<Upvalue> upvalues = current->upvalues;
+    std::shared_ptr<VmFunction> function = end_function();
+
+    chunk().functions.push_back(function);
+    uint function_idx = chunk().functions.size() - 1;
+    if (function_idx > MAX_SHORT_OPERAND) {
+        throw StaticException(func_decl.name,
+                              "Too many functions in one chunk.");
+    }
+    emit_op_short(OpCode::CLOSURE, function_idx);
+    for (const Upvalue &upvalue : upvalues) {
+        emit_byte(upvalue.is_local ? 1 : 0);
+        emit_byte(upvalue.index);
+    }
+}
+
+void Compiler::visit_class_decl(const ClassDecl &class_decl) {
+    token = class_decl.name;
+    std::string_view class_name = class_decl.name->lexeme;
+
+    emit_op_short(OpCode::CLASS, name_constant(class_name));
+    if (current->scope_depth > 0) {
+        add_local(class_name);
+    } else {
+        define_variable(class_name);
+    }
+
+    if (class_decl.superclass != nullptr) {
+        class_decl.superclass->accept(*this);
+        // "super" is a local of the scope wrapping the class methods so that
+        // every method captures it as an upvalue.
+        begin_scope();
+        add_local("super");
+
+        get_variable(class_name);
+        emit_op(OpCode::INHERIT);
+    }
+
+    get_variable(class_name);
+    for (const auto &method : class_decl.methods) {
+        token = method->name;
+        compile_function(*method, CompileFuncType::METHOD);
+        emit_op_short(OpCode::METHOD, name_constant(method->name->lexeme));
+    }
+    emit_op(OpCode::POP);
+
+    if (class_decl.superclass != nullptr) {
+        end_scope();
+    }
+}
+
+// The module runs on its first import. Its exports are bound to the global
+// slots of the module variables, the importing program or module reads and
+// updates them in place.
+void Compiler::visit_import_stmt(const ImportStmt &import_stmt) {
+    const Module &imported = *import_stmt.module;
+    uint module_index = vm.get_module_index(imported);
+    token = import_stmt.import_kw;
+    emit_op_short(OpCode::IMPORT, module_index);
+    emit_op(OpCode::POP);
+    for (const Export &name : imported.exports) {
+        vm.bind_global(
+            global_name(name.name),
+            vm.get_global_slot(VM::module_global_name(imported, name.name)));
+    }
+}
+
+void Compiler::visit_return_stmt(const ReturnStmt &return_stmt) {
+    token = return_stmt.return_kw;
+    if (return_stmt.expr != nullptr) {
+        is_tail_call = return_stmt.is_tail_call;
+        return_stmt.expr->accept(*this);
+    } else {
+        emit_op(OpCode::NIL);
+    }
+    emit_op(OpCode::RETURN);
+}
+
+void Compiler::visit_set_class_field(
+    const SetClassFieldStmt &set_class_field_stmt) {
+    set_class_field_stmt.lox_instance->accept(*this);
+    set_class_field_stmt.value->accept(*this);
+    token = set_class_field_stmt.field_token;
+    emit_op_short(OpCode::SET_PROPERTY,
+                  name_constant(set_class_field_stmt.field_token->lexeme));
+    emit_short(make_property_cache());
+}
+
+ExprVal Compiler::visit_identifier(const IdentifierExpr &identifier_expr) {
+    token = identifier_expr.token;
+    get_variable(identifier_expr.token->lexeme);
+    return NIL;
+}
+
+ExprVal Compiler::visit_this(const ThisExpr &this_expr) {
+    token = this_expr.token;
+    get_variable("this");
+    return NIL;
+}
+
+ExprVal Compiler::visit_super(const SuperExpr &super_expr) {
+    token = super_expr.token;
+    get_variable("this");
+    get_variable("super");
+    emit_op_short(OpCode::GET_SUPER,
+                  name_constant(super_expr.method->token->lexeme));
+    return NIL;
+}
+
+ExprVal Compiler::visit_literal(const LiteralExpr &literal_expr) {
+    if (literal_expr.value.is_bool()) {
+        emit_op(literal_expr.value.as_bool() ? OpCode::TRUE : OpCode::FALSE);
+    } else if (literal_expr.value.is_nil()) {
+        emit_op(OpCode::NIL);
+    } else {
+        emit_constant(literal_expr.value);
+    }
+    return NIL;
+}
+
+ExprVal Compiler::visit_grouping(const GroupExpr &group_expr) {
+    group_expr.expr->accept(*this);
+    return NIL;
+}
+
+ExprVal Compiler::visit_func_call(const FuncCallExpr &func_call_expr) {
+    // Only the call of the tail return is a tail call, not the calls
+    // compiled for its callee and args
+    bool is_tail_call = std::exchange(this->is_tail_call, false);
+    // obj.method(args) is compiled to a single INVOKE instruction to avoid
+    // creating a bound method.
+    auto get_field = func_call_expr.method_callee;
+    if (get_field) {
+        get_field->lox_instance->accept(*this);
+    } else {
+        func_call_expr.callee->accept(*this);
+    }
+
+    for (const auto &arg : func_call_expr.args) {
+        arg->accept(*this);
+    }
+
+    token = func_call_expr.func_token;
+    if (get_field) {
+        emit_op_short(is_tail_call ? OpCode::TAIL_INVOKE : OpCode::INVOKE,
+                      name_constant(get_field->field_token->lexeme));
+        emit_byte(func_call_expr.args.size());
+        emit_short(make_property_cache());
+    } else {
+        emit_op(is_tail_call ? OpCode::TAIL_CALL : OpCode::CALL,
+                func_call_expr.args.size());
+    }
+    return NIL;
+}
+
+ExprVal Compiler::visit_get_class_field(const GetClassFieldExpr &expr) {
+    expr.lox_instance->accept(*this);
+    token = expr.field_token;
+    emit_op_short(OpCode::GET_PROPERTY,
+                  name_constant(expr.field_token->lexeme));
+    emit_short(make_property_cache());
+    return NIL;
+}
+
+ExprVal Compiler::visit_unary(const UnaryExpr &unary_expr) {
+    unary_expr.operand->accept(*this);
+    token = unary_expr.operation;
+
+    switch (unary_expr.operation->type) {
+    case TokenType::BANG:
+        emit_op(OpCode::NOT);
+        break;
+    case TokenType::MINUS:
+        emit_op(OpCode::NEGATE);
+        break;
+    default:
+        throw StaticException(unary_expr.operation,
+                              "Invalid unary expression");
+    }
+    return NIL;
+}
+
+ExprVal Compiler::visit_binary(const BinaryExpr &binary_expr) {
+    binary_expr.left_operand->accept(*this);
+    binary_expr.right_operand->accept(*this);
+    token = binary_expr.operation;
+
+    switch (binary_expr.operation->type) {
+    case TokenType::PLUS:
+        emit_op(OpCode::ADD);
+        break;
+    case TokenType::MINUS:
+        emit_op(OpCode::SUBTRACT);
+        break;
+    case TokenType::STAR:
+        emit_op(OpCode::MULTIPLY);
+        break;
+    case TokenType::SLASH:
+        emit_op(OpCode::DIVIDE);
+        break;
+    case TokenType::MOD:
+        emit_op(OpCode::MODULO);
+        break;
+    case TokenType::GREATER:
+        emit_op(OpCode::GREATER);
+        break;
+    case TokenType::GREATER_EQUAL:
+        emit_op(OpCode::GREATER_EQUAL);
+        break;
+    case TokenType::LESS:
+        emit_op(OpCode::LESS);
+        break;
+    case TokenType::LESS_EQUAL:
+        emit_op(OpCode::LESS_EQUAL);
+        break;
+    case TokenType::EQUAL_EQUAL:
+        emit_op(OpCode::EQUAL);
+        break;
+    case TokenType::BANG_EQUAL:
+        emit_op(OpCode::NOT_EQUAL);
+        break;
+    case TokenType::AND:
+        emit_op(OpCode::AND);
+        break;
+    case TokenType::OR:
+        emit_op(OpCode::OR);
+        break;
+    default:
+        throw StaticException(binary_expr.operation,
+                              "Invalid binary expression");
+    }
+    return NIL;
+}
+
+void Compiler::begin_scope() { current->scope_depth++; }
+
+void Compiler::end_scope() {
+    current->scope_depth--;
+    emit_pops_until(current->scope_depth);
+    while (!current->locals.empty() &&
+           current->locals.back().depth > current->scope_depth) {
+        current->locals.pop_back();
+    }
+}
+
+// Emit instructions to discard the locals declared deeper than depth, without
+// forgetting them in the compiler (used by break/continue jumps).
+void Compiler::emit_pops_until(int depth) {
+    for (int i = current->locals.size() - 1;
+         i >= 0 && current->locals[i].depth > depth; --i) {
+        emit_op(current->locals[i].is_captured ? OpCode::CLOSE_UPVALUE
+                                               : OpCode::POP);
+    }
+}
+
+void Compiler::add_local(std::string_view name) {
+    if (current->locals.size() == MAX_LOCALS_NUM) {
+        throw StaticException(nullptr,
+                              "Too many local variables in function.");
+    }
+    current->locals.push_back({name, current->scope_depth, false});
+}
+
+int Compiler::resolve_local(FunctionState &state, std::string_view name) {
+    for (int i = state.locals.size() - 1; i >= 0; --i) {
+        if (state.locals[i].name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Compiler::resolve_upvalue(FunctionState &state, std::string_view name) {
+    if (state.enclosing == nullptr) {
+        return -1;
+    }
+
+    int local = resolve_local(*state.enclosing, name);
+    if (local != -1) {
+        state.enclosing->locals[local].is_captured = true;
+        return add_upvalue(state, local, true);
+    }
+
+    int upvalue = resolve_upvalue(*state.enclosing, name);
+    if (upvalue != -1) {
+        return add_upvalue(state, upvalue, false);
+    }
+
+    return -1;
+}
+
+int Compiler::add_upvalue(FunctionState &state, uint8_t index, bool is_local) {
+    for (size_t i = 0; i < state.upvalues.size(); ++i) {
+        if (state.upvalues[i].index == index &&
+            state.upvalues[i].is_local == is_local) {
+            return i;
+        }
+    }
+
+    if (state.upvalues.size() == MAX_LOCALS_NUM) {
+        throw StaticException(nullptr,
+                              "Too many closure variables in function.");
+    }
+    state.upvalues.push_back({index, is_local});
+    return state.upvalues.size() - 1;
+}
+
+void Compiler::get_variable(std::string_view name) {
+    if (int slot = resolve_local(*current, name); slot != -1) {
+        emit_op(OpCode::GET_LOCAL, slot);
+    } else if (int upvalue = resolve_upvalue(*current, name); upvalue != -1) {
+        emit_op(OpCode::GET_UPVALUE, upvalue);
+    } else {
+        emit_op_short(OpCode::GET_GLOBAL, global_slot(name));
+    }
+}
+
+void Compiler::set_variable(std::string_view name) {
+    if (int slot = resolve_local(*current, name); slot != -1) {
+        emit_op(OpCode::SET_LOCAL, slot);
+    } else if (int upvalue = resolve_upvalue(*current, name); upvalue != -1) {
+        emit_op(OpCode::SET_UPVALUE, upvalue);
+    } else {
+        emit_op_short(OpCode::SET_GLOBAL, global_slot(name));
+    }
+}
+
+// The value of the new variable is on top of the stack. A local simply keeps
+// it in its stack slot.
+void Compiler::define_variable(std::string_view name) {
+    if (current->scope_depth > 0) {
+        add_local(name);
+        return;
+    }
+    emit_op_short(OpCode::DEFINE_GLOBAL, global_slot(name));
+}
+
+// The top level variables of a module are stored in the VM global table
+// under a name prefixed by the module path, the builtins are shared
+std::string Compiler::global_name(std::string_view name) {
+    if (module == nullptr) {
+        return std::string(name);
+    }
+    if (vm.is_builtin(name)) {
+        bool is_declared = false;
+        for (const Export &declared : module->exports) {
+            is_declared |= declared.name == name;
+        }
+        if (!is_declared) {
+            return std::string(name);
+        }
+    }
+    return VM::module_global_name(*module, name);
+}
+
+uint Compiler::global_slot(std::string_view name) {
+    return vm.get_global_slot(global_name(name));
+}
+
+Chunk &Compiler::chunk() { return current->function->chunk; }
+
+void Compiler::emit_byte(uint8_t byte) { chunk().write(byte, token); }
+
+void Compiler::emit_op(OpCode op) { emit_byte(static_cast<uint8_t>(op)); }
+
+void Compiler::emit_op(OpCode op, uint8_t operand) {
+    emit_op(op);
+    emit_byte(operand);
+}
+
+void Compiler::emit_op_short(OpCode op, uint operand) {
+    emit_op(op);
+    emit_short(operand);
+}
+
+void Compiler::emit_short(uint operand) {
+    emit_byte((operand >> 8) & 0xff);
+    emit_byte(operand & 0xff);
+}
+
+void Compiler::emit_constant(const ExprVal &value) {
+    emit_op_short(OpCode::CONSTANT, make_constant(value));
+}
+
+uint Compiler::make_constant(const ExprVal &value) {
+    uint constant = chunk().add_constant(value);
+    if (constant > MAX_SHORT_OPERAND) {
+        throw StaticException(nullptr, "Too many constants in one chunk.");
+    }
+    return constant;
+}
+
+// Property/method/class names are deduplicated in the constant table
+uint Compiler::name_constant(std::string_view name) {
+    auto it = current->name_constants.find(name);
+    if (it != current->name_constants.end()) {
+        return it->second;
+    }
+    uint constant = make_constant(Heap::make_string(name));
+    current->name_constants[name] = constant;
+    return constant;
+}
+
+uint Compiler::make_property_cache() {
+    uint cache = chunk().add_property_cache();
+    if (cache > MAX_SHORT_OPERAND) {
+        throw StaticException(nullptr,
+                              "Too many property accesses in one chunk.");
+    }
+    return cache;
+}
+
+uint Compiler::emit_jump(OpCode op) {
+    emit_op_short(op, 0xffff);
+    return chunk().code.size() - 2;
+}
+
+void Compiler::patch_jump(uint offset) {
+    // -2 to skip the jump operand itself
+    uint jump = chunk().code.size() - offset - 2;
+    if (jump > MAX_SHORT_OPERAND) {
+        throw StaticException(nullptr, "Too much code to jump over.");
+    }
+
+    chunk().code[offset] = (jump >> 8) & 0xff;
+    chunk().code[offset + 1] = jump & 0xff;
+}
+
+void Compiler::emit_loop(uint loop_start) {
+    emit_op(OpCode::LOOP);
+
+    uint offset = chunk().code.size() - loop_start + 2;
+    if (offset > MAX_SHORT_OPERAND) {
+        throw StaticException(nullptr, "Loop body too large.");
+    }
+    emit_byte((offset >> 8) & 0xff);
+    emit_byte(offset & 0xff);
+}
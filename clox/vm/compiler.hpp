@@ -0,0 +1,156 @@
+#pragma once
+#include "clox/parser/expr.hpp"
+#include "clox/parser/stmt.hpp"
+#include "clox/vm/chunk.hpp"
+#include "clox/vm/object.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class VM;
+
+enum class CompileFuncType {
+    SCRIPT,
+    FUNCTION,
+    METHOD,
+};
+
+// Compile the resolved AST into bytecode chunks executed by the VM. Local
+// variables live in VM stack slots, variables captured by inner functions are
+// accessed through upvalues and top level variables are stored in the VM
+// global table.
+class Compiler : public IExprVisitor, public IStmtVisitor {
+  private:
+    struct Local {
+        // Views the source
+        std::string_view name;
+        int depth;
+        bool is_captured;
+    };
+
+    struct Upvalue {
+        uint8_t index;
+        bool is_local;
+    };
+
+    struct Loop {
+        // Locals declared deeper than these depths are popped before jumping
+        int break_scope_depth;
+        int continue_scope_depth;
+        // -1 when the continue target is not emitted yet (for loop increment)
+        int continue_target;
+        std::vector<uint> break_jumps = {};
+        std::vector<uint> continue_jumps = {};
+    };
+
+    struct FunctionState {
+        std::shared_ptr<VmFunction> function;
+        CompileFuncType type;
+        std::vector<Local> locals = {};
+        std::vector<Upvalue> upvalues = {};
+        std::vector<Loop> loops = {};
+        std::unordered_map<std::string_view, uint> name_constants = {};
+        int scope_depth = 0;
+        FunctionState *enclosing = nullptr;
+    };
+
+    VM &vm;
+    // Module compiled, nullptr for a program
+    const Module *module = nullptr;
+    FunctionState *current = nullptr;
+    // Last visited token, attached to the emitted instructions
+    const Token *token = nullptr;
+    // Set by a tail return for the call it compiles
+    bool is_tail_call = false;
+
+    void visit_expr_stmt(const ExprStmt &) override;
+
+    void visit_assign_stmt(const AssignStmt &) override;
+
+    void visit_var_decl(const VarDecl &) override;
+
+    void
+    visit_block_stmt(const BlockStmt &,
+                     Environment *block_env = nullptr) override;
+
+    void visit_if_stmt(const IfStmt &) override;
+
+    void visit_while_stmt(const WhileStmt &) override;
+
+    void visit_break_stmt(const BreakStmt &) override;
+
+    void visit_continue_stmt(const ContinueStmt &) override;
+
+    void visit_function_decl(FunctionDecl &) override;
+
+    void visit_class_decl(const ClassDecl &) override;
+
+    void visit_return_stmt(const ReturnStmt &) override;
+
+    void visit_set_class_field(const SetClassFieldStmt &) override;
+
+    void visit_import_stmt(const ImportStmt &) override;
+
+    ExprVal visit_identifier(const IdentifierExpr &) override;
+
+    ExprVal visit_this(const ThisExpr &) override;
+
+    ExprVal visit_super(const SuperExpr &) override;
+
+    ExprVal visit_literal(const LiteralExpr &) override;
+
+    ExprVal visit_grouping(const GroupExpr &) override;
+
+    ExprVal visit_func_call(const FuncCallExpr &) override;
+
+    ExprVal visit_get_class_field(const GetClassFieldExpr &) override;
+
+    ExprVal visit_unary(const UnaryExpr &) override;
+
+    ExprVal visit_binary(const BinaryExpr &) override;
+
+    void begin_function(FunctionState &state, CompileFuncType type,
+                        std::string_view name);
+    std::shared_ptr<VmFunction> end_function();
+    void compile_function(const FunctionDecl &, CompileFuncType type);
+    void compile_loop_body(const BlockStmt &body);
+
+    void begin_scope();
+    void end_scope();
+    void emit_pops_until(int depth);
+
+    void add_local(std::string_view name);
+    int resolve_local(FunctionState &state, std::string_view name);
+    int resolve_upvalue(FunctionState &state, std::string_view name);
+    int add_upvalue(FunctionState &state, uint8_t index, bool is_local);
+    void get_variable(std::string_view name);
+    void set_variable(std::string_view name);
+    void define_variable(std::string_view name);
+    // Key of the top level variable in the VM global table
+    std::string global_name(std::string_view name);
+    uint global_slot(std::string_view name);
+
+    Chunk &chunk();
+    void emit_byte(uint8_t byte);
+    void emit_op(OpCode op);
+    void emit_op(OpCode op, uint8_t operand);
+    void emit_op_short(OpCode op, uint operand);
+    void emit_short(uint operand);
+    void emit_constant(const ExprVal &value);
+    uint make_constant(const ExprVal &value);
+    uint name_constant(std::string_view name);
+    uint make_property_cache();
+    uint emit_jump(OpCode op);
+    void patch_jump(uint offset);
+    void emit_loop(uint loop_start);
+
+  public:
+    Compiler(VM &vm, const Module *module = nullptr);
+
+    std::shared_ptr<VmFunction>
+    compile_program(const std::vector<Stmt *> &stmts);
+    std::shared_ptr<VmFunction> compile_single_expr(Expr &expr);
+};
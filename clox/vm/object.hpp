@@ -0,0 +1,129 @@
+#pragma once
+#include "clox/ast_interpreter/callable/callable.hpp"
+#include "clox/ast_interpreter/callable/class.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/vm/chunk.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled function prototype. It is not a Lox value by itself, a VmClosure
+// wraps it together with the captured upvalues at run time.
+class VmFunction {
+  public:
+    std::string name = "";
+    uint arity = 0;
+    uint upvalue_count = 0;
+    bool is_method = false;
+    Chunk chunk;
+};
+
+// A variable captured by a closure. While the variable is still on the VM
+// stack the upvalue is "open" and points to its stack slot, once the variable
+// goes out of scope the value is moved into closed.
+class VmUpvalue {
+  public:
+    ExprVal *location;
+    ExprVal closed = NIL;
+    // Next open upvalue, sorted by stack slot in descending order
+    std::shared_ptr<VmUpvalue> next_open = nullptr;
+
+    VmUpvalue(ExprVal *location) : location(location) {}
+};
+
+// VM callables derive from LoxCallable so that they can be stored in an
+// ExprVal, but they are called by the VM itself and never by the
+// AstInterpreter.
+class VmCallable : public LoxCallable {
+  public:
+    ExprVal invoke(AstInterpreter &, std::vector<ExprVal> &) override {
+        throw RuntimeException(nullptr,
+                               "VM object cannot be called by AstInterpreter.");
+    }
+};
+
+class VmClosure : public VmCallable {
+  public:
+    std::shared_ptr<VmFunction> function;
+    std::vector<std::shared_ptr<VmUpvalue>> upvalues;
+
+    VmClosure(std::shared_ptr<VmFunction> function)
+        : function(function), upvalues(function->upvalue_count) {}
+
+    uint get_param_num() override { return function->arity; }
+
+    std::string to_string() const override {
+        if (function->is_method) {
+            return "<method " + function->name + ">";
+        }
+        return "<function " + function->name + ">";
+    }
+
+    // Constants of the function are pinned by its chunk, only the captured
+    // variables are traced.
+    void trace() override {
+        for (const auto &upvalue : upvalues) {
+            if (upvalue != nullptr) {
+                Heap::mark_value(*upvalue->location);
+            }
+        }
+    }
+};
+
+class VmClass : public LoxClass {
+  public:
+    // Inherited methods are copied down when the class is created so method
+    // lookup never walks the superclass chain.
+    std::unordered_map<LoxString *, VmClosure *, LoxStringHash> vm_methods =
+        {};
+    // Cached "init" method
+    VmClosure *initializer = nullptr;
+
+    VmClass(std::string name) { this->name = name; }
+
+    uint get_param_num() override {
+        if (initializer == nullptr) {
+            return 0;
+        }
+        return initializer->get_param_num();
+    }
+
+    ExprVal invoke(AstInterpreter &, std::vector<ExprVal> &) override {
+        throw RuntimeException(nullptr,
+                               "VM object cannot be called by AstInterpreter.");
+    }
+
+    void trace() override {
+        LoxClass::trace();
+        for (const auto &method : vm_methods) {
+            Heap::mark_object(method.first);
+            Heap::mark_object(method.second);
+        }
+        Heap::mark_object(initializer);
+    }
+
+    friend class VM;
+};
+
+// Method value created when a method is accessed without being called
+// immediately (var m = obj.method;).
+class VmBoundMethod : public VmCallable {
+  public:
+    ExprVal receiver;
+    LoxCallable *method;
+
+    VmBoundMethod(ExprVal receiver, LoxCallable *method)
+        : receiver(receiver), method(method) {}
+
+    uint get_param_num() override { return method->get_param_num(); }
+
+    std::string to_string() const override { return method->to_string(); }
+
+    void trace() override {
+        Heap::mark_value(receiver);
+        Heap::mark_object(method);
+    }
+};
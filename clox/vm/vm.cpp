@@ -0,0 +1,754 @@
+#include "clox/vm/vm.hpp"
+#include "clox/ast_interpreter/callable/list.hpp"
+#include "clox/ast_interpreter/callable/native_function.hpp"
+#include "clox/ast_interpreter/helper.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/middleware/module_loader.hpp"
+#include "clox/utils/helper.hpp"
+#include "clox/vm/compiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+VM::VM(const bool is_interactive_mode)
+    : stack(STACK_MAX), frames(FRAMES_MAX),
+      is_interactive_mode(is_interactive_mode) {
+    reset_stack();
+    Heap::add_roots(this);
+
+    define_native("clock", Heap::alloc<ClockNativeFunc>());
+    define_native("print", Heap::alloc<PrintNativeFunc>());
+    define_native("read", Heap::alloc<ReadNativeFunc>());
+    define_native("readline", Heap::alloc<ReadlineNativeFunc>());
+    define_native("bool", Heap::alloc<BoolCastNativeFunc>());
+    define_native("str", Heap::alloc<StringCastNativeFunc>());
+    define_native("num", Heap::alloc<DoubleCastNativeFunc>());
+    define_native("int", Heap::alloc<IntCastNativeFunc>());
+    // List methods receive the list instance directly from the VM
+    define_native("List", Heap::alloc<List>());
+    builtin_num = globals.size();
+}
+
+VM::~VM() { Heap::remove_roots(this); }
+
+void VM::mark_roots() {
+    for (ExprVal *slot = stack.data(); slot < stack_top; ++slot) {
+        Heap::mark_value(*slot);
+    }
+    for (uint i = 0; i < frame_count; ++i) {
+        Heap::mark_object(frames[i].closure);
+    }
+    for (const auto &global : globals) {
+        Heap::mark_value(global.value);
+    }
+}
+
+void VM::define_native(const std::string &name, LoxCallable *callable) {
+    uint slot = get_global_slot(name);
+    globals[slot].value = callable;
+    globals[slot].is_defined = true;
+}
+
+uint VM::get_global_slot(std::string_view name) {
+    std::string key{name};
+    auto it = global_slots.find(key);
+    if (it != global_slots.end()) {
+        return it->second;
+    }
+
+    globals.emplace_back();
+    // Errors name the variable of a module without its module path
+    global_names.push_back(key.substr(key.rfind(':') + 1));
+    global_slots[key] = globals.size() - 1;
+    return globals.size() - 1;
+}
+
+void VM::bind_global(const std::string &name, uint slot) {
+    auto [it, is_new] = global_slots.try_emplace(name, slot);
+    if (!is_new && it->second != slot) {
+        imported_globals[it->second] = slot;
+        it->second = slot;
+    }
+}
+
+VM::Global *VM::find_global(uint slot) {
+    if (!globals[slot].is_defined) {
+        auto imported = imported_globals.find(slot);
+        if (imported == imported_globals.end()) {
+            return nullptr;
+        }
+        slot = imported->second;
+    }
+    return globals[slot].is_defined ? &globals[slot] : nullptr;
+}
+
+bool VM::is_builtin(std::string_view name) {
+    auto it = global_slots.find(std::string(name));
+    return it != global_slots.end() && it->second < builtin_num;
+}
+
+uint VM::get_module_index(const Module &module) {
+    auto it = module_indices.find(&module);
+    if (it != module_indices.end()) {
+        return it->second;
+    }
+    Compiler compiler{*this, &module};
+    modules.push_back({compiler.compile_program(module.stmts)});
+    module_indices[&module] = modules.size() - 1;
+    return modules.size() - 1;
+}
+
+std::string VM::module_global_name(const Module &module,
+                                   std::string_view name) {
+    return module.path + ":" + std::string(name);
+}
+
+ExprVal VM::interpret_single_expr(Expr &expression) {
+    Compiler compiler{*this};
+    auto script = compiler.compile_single_expr(expression);
+    if (ErrorManager::had_static_err) {
+        return NIL;
+    }
+    return execute(script);
+}
+
+void VM::interpret_program(const std::vector<Stmt *> &stmts) {
+    // Safe point: the scripts of the previous programs (lines, streamed
+    // declarations) are only released by a collection
+    Heap::collect_if_needed();
+    Compiler compiler{*this};
+    auto script = compiler.compile_program(stmts);
+    if (ErrorManager::had_static_err) {
+        return;
+    }
+    execute(script);
+}
+
+ExprVal VM::execute(std::shared_ptr<VmFunction> script) {
+    auto closure = Heap::alloc<VmClosure>(script);
+    push(closure);
+    call_closure(closure, 0);
+    return run();
+}
+
+void VM::reset_stack() {
+    stack_top = stack.data();
+    frame_count = 0;
+    open_upvalues = nullptr;
+}
+
+ExprVal VM::run() {
+    CallFrame *frame = &frames[frame_count - 1];
+    uint8_t *ip = frame->ip;
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, uint16_t((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT()                                                        \
+    (frame->closure->function->chunk.constants[READ_SHORT()])
+#define READ_NAME() (READ_CONSTANT().as<LoxString>())
+#define READ_CACHE()                                                           \
+    (frame->closure->function->chunk.property_caches[READ_SHORT()])
+// Reload the cached frame after a call or a return changed the frame stack
+#define LOAD_FRAME()                                                           \
+    frame = &frames[frame_count - 1];                                          \
+    ip = frame->ip;
+
+    try {
+        while (true) {
+            switch (static_cast<OpCode>(READ_BYTE())) {
+            case OpCode::CONSTANT:
+                push(READ_CONSTANT());
+                break;
+            case OpCode::NIL:
+                push(NIL);
+                break;
+            case OpCode::TRUE:
+                push(true);
+                break;
+            case OpCode::FALSE:
+                push(false);
+                break;
+            case OpCode::POP:
+                stack_top--;
+                break;
+            case OpCode::ECHO:
+                std::cout << cast_expr_val_to_string(pop()) << std::endl;
+                break;
+            case OpCode::GET_LOCAL:
+                push(frame->slots[READ_BYTE()]);
+                break;
+            case OpCode::SET_LOCAL:
+                frame->slots[READ_BYTE()] = pop();
+                break;
+            case OpCode::GET_GLOBAL: {
+                uint slot = READ_SHORT();
+                if (globals[slot].is_defined) {
+                    push(globals[slot].value);
+                    break;
+                }
+                Global *global = find_global(slot);
+                if (global == nullptr) {
+                    throw RuntimeException(
+                        nullptr, "Reference to non-exist identifier: " +
+                                     global_names[slot]);
+                }
+                push(global->value);
+                break;
+            }
+            case OpCode::DEFINE_GLOBAL: {
+                Global &global = globals[READ_SHORT()];
+                global.value = pop();
+                global.is_defined = true;
+                break;
+            }
+            case OpCode::SET_GLOBAL: {
+                uint slot = READ_SHORT();
+                Global *global = find_global(slot);
+                if (global == nullptr) {
+                    throw RuntimeException(
+                        nullptr, "Cannot update undefined identifier '" +
+                                     global_names[slot] + "'");
+                }
+                global->value = pop();
+                break;
+            }
+            case OpCode::GET_UPVALUE:
+                push(*frame->closure->upvalues[READ_BYTE()]->location);
+                break;
+            case OpCode::SET_UPVALUE:
+                *frame->closure->upvalues[READ_BYTE()]->location = pop();
+                break;
+            case OpCode::GET_PROPERTY: {
+                LoxString *name = READ_NAME();
+                PropertyCache &cache = READ_CACHE();
+                LoxInstance *instance = as_instance(peek(0));
+                if (!instance) {
+                    throw RuntimeException(
+                        nullptr, "Can only call property of a lox instance.");
+                }
+
+                int slot = instance->find_prop_slot(name, cache);
+                if (slot != -1) {
+                    peek(0) = instance->fields[slot];
+                    break;
+                }
+                peek(0) = bind_method(peek(0), *instance, name);
+                break;
+            }
+            case OpCode::SET_PROPERTY: {
+                LoxString *name = READ_NAME();
+                PropertyCache &cache = READ_CACHE();
+                LoxInstance *instance = as_instance(peek(1));
+                if (!instance) {
+                    throw RuntimeException(
+                        nullptr, "Can only call property of a lox instance.");
+                }
+                instance->set_prop(name, pop(), cache);
+                stack_top--;
+                break;
+            }
+            case OpCode::GET_SUPER: {
+                LoxString *name = READ_NAME();
+                auto superclass = pop().as<VmClass>();
+                auto method = superclass->vm_methods.find(name);
+                if (method == superclass->vm_methods.end()) {
+                    throw RuntimeException(nullptr,
+                                           "Superclass does not have method " +
+                                               name->str);
+                }
+                peek(0) = Heap::alloc<VmBoundMethod>(peek(0), method->second);
+                break;
+            }
+            case OpCode::EQUAL: {
+                ExprVal right = pop();
+                peek(0) = is_expr_vals_equal(peek(0), right);
+                break;
+            }
+            case OpCode::NOT_EQUAL: {
+                ExprVal right = pop();
+                peek(0) = !is_expr_vals_equal(peek(0), right);
+                break;
+            }
+
+// Comparison of 2 numbers or 2 strings
+#define COMPARISON_OP(op)                                                      \
+    {                                                                          \
+        ExprVal &left = peek(1);                                               \
+        ExprVal &right = peek(0);                                              \
+        bool result;                                                           \
+        if (left.is_number() && right.is_number()) {                           \
+            result = left.as_number() op right.as_number();                    \
+        } else if (left.is_string() && right.is_string()) {                    \
+            result = left.as_string() op right.as_string();                    \
+        } else {                                                               \
+            throw RuntimeException(nullptr,                                    \
+                                   "Expected compare 2 numbers or 2 strings"); \
+        }                                                                      \
+        stack_top--;                                                           \
+        peek(0) = result;                                                      \
+        break;                                                                 \
+    }
+            case OpCode::GREATER:
+                COMPARISON_OP(>)
+            case OpCode::GREATER_EQUAL:
+                COMPARISON_OP(>=)
+            case OpCode::LESS:
+                COMPARISON_OP(<)
+            case OpCode::LESS_EQUAL:
+                COMPARISON_OP(<=)
+#undef COMPARISON_OP
+
+            case OpCode::ADD: {
+                ExprVal &left = peek(1);
+                ExprVal &right = peek(0);
+                ExprVal result;
+                if (left.is_number() && right.is_number()) {
+                    result = left.as_number() + right.as_number();
+                } else {
+                    // Special case: + op can be used to concate 2 strings
+                    if (left.is_string() && right.is_string()) {
+                        result = Heap::make_string(left.as_string() +
+                                                   right.as_string());
+                    } else if (left.is_number() && right.is_string()) {
+                        result = Heap::make_string(
+                            double_to_string(left.as_number()) +
+                            right.as_string());
+                    } else if (left.is_string() && right.is_number()) {
+                        result = Heap::make_string(
+                            left.as_string() +
+                            double_to_string(right.as_number()));
+                    } else {
+                        throw RuntimeException(
+                            nullptr, "Operands must be number or string");
+                    }
+                }
+                stack_top--;
+                peek(0) = result;
+                break;
+            }
+
+// Arithmetic operation on 2 numbers
+#define NUMBER_OP(op)                                                          \
+    {                                                                          \
+        assert_expr_vals_number(nullptr, peek(1), peek(0));                    \
+        double right = pop().as_number();                                      \
+        peek(0) = peek(0).as_number() op right;                                \
+        break;                                                                 \
+    }
+            case OpCode::SUBTRACT:
+                NUMBER_OP(-)
+            case OpCode::MULTIPLY:
+                NUMBER_OP(*)
+#undef NUMBER_OP
+
+            case OpCode::DIVIDE: {
+                assert_expr_vals_number(nullptr, peek(1), peek(0));
+                double right = pop().as_number();
+                if (right == 0) {
+                    throw RuntimeException(nullptr, "Devide by 0");
+                }
+                peek(0) = peek(0).as_number() / right;
+                break;
+            }
+            case OpCode::MODULO: {
+                assert_expr_vals_int(nullptr, peek(1), peek(0));
+                int right = pop().as_number();
+                peek(0) = double(int(peek(0).as_number()) % right);
+                break;
+            }
+            case OpCode::AND: {
+                bool right = cast_expr_val_to_bool(pop());
+                peek(0) = cast_expr_val_to_bool(peek(0)) && right;
+                break;
+            }
+            case OpCode::OR: {
+                bool right = cast_expr_val_to_bool(pop());
+                peek(0) = cast_expr_val_to_bool(peek(0)) || right;
+                break;
+            }
+            case OpCode::NOT:
+                peek(0) = !cast_expr_val_to_bool(peek(0));
+                break;
+            case OpCode::NEGATE:
+                assert_expr_val_number(nullptr, peek(0));
+                peek(0) = -peek(0).as_number();
+                break;
+            case OpCode::JUMP: {
+                uint16_t offset = READ_SHORT();
+                ip += offset;
+                break;
+            }
+            case OpCode::JUMP_IF_FALSE: {
+                uint16_t offset = READ_SHORT();
+                if (!cast_expr_val_to_bool(peek(0))) {
+                    ip += offset;
+                }
+                break;
+            }
+            // Calls and loop back edges are the GC safe points: every live
+            // value is on the stack between 2 instructions.
+            case OpCode::LOOP: {
+                uint16_t offset = READ_SHORT();
+                ip -= offset;
+                Heap::collect_if_needed();
+                break;
+            }
+            case OpCode::CALL: {
+                Heap::collect_if_needed();
+                uint arg_num = READ_BYTE();
+                frame->ip = ip;
+                call_value(peek(arg_num), arg_num);
+                LOAD_FRAME();
+                break;
+            }
+            case OpCode::TAIL_CALL: {
+                Heap::collect_if_needed();
+                uint arg_num = READ_BYTE();
+                frame->ip = ip;
+                uint caller_frame_count = frame_count;
+                call_value(peek(arg_num), arg_num);
+                // Other callees have returned, the next RETURN returns their
+                // result
+                if (frame_count > caller_frame_count) {
+                    replace_caller_frame();
+                }
+                LOAD_FRAME();
+                break;
+            }
+            case OpCode::INVOKE: {
+                Heap::collect_if_needed();
+                LoxString *name = READ_NAME();
+                uint arg_num = READ_BYTE();
+                PropertyCache &cache = READ_CACHE();
+                frame->ip = ip;
+                invoke(name, arg_num, cache);
+                LOAD_FRAME();
+                break;
+            }
+            case OpCode::TAIL_INVOKE: {
+                Heap::collect_if_needed();
+                LoxString *name = READ_NAME();
+                uint arg_num = READ_BYTE();
+                PropertyCache &cache = READ_CACHE();
+                frame->ip = ip;
+                uint caller_frame_count = frame_count;
+                invoke(name, arg_num, cache);
+                if (frame_count > caller_frame_count) {
+                    replace_caller_frame();
+                }
+                LOAD_FRAME();
+                break;
+            }
+            case OpCode::CLOSURE: {
+                auto function =
+                    frame->closure->function->chunk.functions[READ_SHORT()];
+                auto closure = Heap::alloc<VmClosure>(function);
+                for (auto &upvalue : closure->upvalues) {
+                    uint8_t is_local = READ_BYTE();
+                    uint8_t index = READ_BYTE();
+                    if (is_local) {
+                        upvalue = capture_upvalue(frame->slots + index);
+                    } else {
+                        upvalue = frame->closure->upvalues[index];
+                    }
+                }
+                push(closure);
+                break;
+            }
+            case OpCode::CLOSE_UPVALUE:
+                close_upvalues(stack_top - 1);
+                stack_top--;
+                break;
+            case OpCode::RETURN: {
+                ExprVal result = pop();
+                close_upvalues(frame->slots);
+                if (frame->is_constructor) {
+                    result = frame->slots[0];
+                }
+
+                frame_count--;
+                if (frame_count == 0) {
+                    stack_top = stack.data();
+                    return result;
+                }
+
+                stack_top = frame->slots;
+                push(result);
+                LOAD_FRAME();
+                break;
+            }
+            case OpCode::CLASS:
+                push(Heap::alloc<VmClass>(READ_NAME()->str));
+                break;
+            case OpCode::INHERIT: {
+                auto superclass =
+                    peek(1).is_callable()
+                        ? dynamic_cast<VmClass *>(peek(1).as<LoxCallable>())
+                        : nullptr;
+                if (!superclass) {
+                    throw RuntimeException(
+                        nullptr, "Superclass must be a defined class.");
+                }
+                auto subclass = peek(0).as<VmClass>();
+                subclass->superclass = superclass;
+                subclass->vm_methods = superclass->vm_methods;
+                subclass->initializer = superclass->initializer;
+                stack_top--;
+                break;
+            }
+            case OpCode::IMPORT: {
+                CompiledModule &module = modules[READ_SHORT()];
+                if (module.is_run) {
+                    push(NIL);
+                    break;
+                }
+                module.is_run = true;
+                auto closure = Heap::alloc<VmClosure>(module.script);
+                push(closure);
+                frame->ip = ip;
+                call_closure(closure, 0);
+                LOAD_FRAME();
+                break;
+            }
+            case OpCode::METHOD: {
+                LoxString *name = READ_NAME();
+                auto method = pop().as<VmClosure>();
+                auto klass = peek(0).as<VmClass>();
+                klass->vm_methods[name] = method;
+                if (name->str == INIT_METHOD) {
+                    klass->initializer = method;
+                }
+                break;
+            }
+            }
+        }
+    } catch (RuntimeException &err) {
+        frame->ip = ip;
+        // Same as the AstInterpreter, an error raised inside a function call
+        // is reported at the outermost call site.
+        Chunk &chunk = frames[0].closure->function->chunk;
+        auto [line, lexeme] =
+            chunk.get_token(frames[0].ip - chunk.code.data() - 1);
+        ErrorManager::handle_runtime_err(err, line, lexeme);
+    }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_NAME
+#undef READ_CACHE
+#undef LOAD_FRAME
+
+    reset_stack();
+    return NIL;
+}
+
+void VM::call_value(const ExprVal &callee, uint arg_num) {
+    if (!callee.is_callable()) {
+        throw RuntimeException(nullptr,
+                               "Can only call functions and class's method.");
+    }
+    LoxCallable *callable = callee.as<LoxCallable>();
+
+    if (auto closure = dynamic_cast<VmClosure *>(callable); closure) {
+        call_closure(closure, arg_num);
+        return;
+    }
+
+    if (auto bound = dynamic_cast<VmBoundMethod *>(callable); bound) {
+        auto method = bound->method;
+        stack_top[-int(arg_num) - 1] = bound->receiver;
+        if (auto list_method = dynamic_cast<ListMethod *>(method);
+            list_method) {
+            call_list_method(*list_method,
+                             static_cast<ListInstance &>(
+                                 *as_instance(stack_top[-int(arg_num) - 1])),
+                             arg_num);
+            return;
+        }
+        call_closure(static_cast<VmClosure *>(method), arg_num);
+        return;
+    }
+
+    if (auto klass = dynamic_cast<VmClass *>(callable); klass) {
+        check_arg_num(*klass, arg_num);
+        auto instance = Heap::alloc<LoxInstance>(klass);
+        stack_top[-int(arg_num) - 1] = instance;
+
+        if (klass->initializer != nullptr) {
+            call_closure(klass->initializer, arg_num, true);
+        }
+        return;
+    }
+
+    if (auto list = dynamic_cast<List *>(callable); list) {
+        std::vector<ExprVal> args(stack_top - arg_num, stack_top);
+        ExprVal result = list->construct(args);
+        stack_top -= arg_num + 1;
+        push(result);
+        return;
+    }
+
+    call_native(*callable, arg_num);
+}
+
+void VM::call_closure(VmClosure *closure, uint arg_num,
+                      bool is_constructor) {
+    check_arg_num(*closure, arg_num);
+    // Keep some room on the stack for the locals and temporaries of the frame
+    if (frame_count == FRAMES_MAX ||
+        stack_top + 2 * MAX_ARGS_NUM > stack.data() + stack.size()) {
+        throw RuntimeException(nullptr, "Stack overflow.");
+    }
+
+    CallFrame &frame = frames[frame_count++];
+    frame.closure = closure;
+    frame.ip = closure->function->chunk.code.data();
+    frame.slots = stack_top - arg_num - 1;
+    frame.is_constructor = is_constructor;
+}
+
+void VM::replace_caller_frame() {
+    CallFrame &caller = frames[frame_count - 2];
+    CallFrame &callee = frames[frame_count - 1];
+    close_upvalues(caller.slots);
+    ExprVal *slots = caller.slots;
+    stack_top = std::copy(callee.slots, stack_top, slots);
+    caller = callee;
+    caller.slots = slots;
+    frame_count--;
+}
+
+void VM::call_native(LoxCallable &callable, uint arg_num) {
+    check_arg_num(callable, arg_num);
+    std::vector<ExprVal> args(stack_top - arg_num, stack_top);
+
+    ExprVal result;
+    if (auto native = dynamic_cast<NativeFunction *>(&callable); native) {
+        result = native->call(args);
+    } else {
+        throw RuntimeException(nullptr,
+                               "Can only call functions and class's method.");
+    }
+
+    stack_top -= arg_num + 1;
+    push(result);
+}
+
+void VM::call_list_method(ListMethod &method, ListInstance &list_instance,
+                          uint arg_num) {
+    check_arg_num(method, arg_num);
+    std::vector<ExprVal> args(stack_top - arg_num, stack_top);
+    ExprVal result = method.call_on(list_instance, args);
+    stack_top -= arg_num + 1;
+    push(result);
+}
+
+void VM::check_arg_num(LoxCallable &callable, uint arg_num) {
+    uint param_num = callable.get_param_num();
+    if (param_num != arg_num && param_num != UNLIMITED_ARGS_NUM) {
+        throw RuntimeException(
+            nullptr, "Expected " + std::to_string(param_num) +
+                         " args to be passed to the function, but got " +
+                         std::to_string(arg_num));
+    }
+}
+
+// Fused GET_PROPERTY + CALL for obj.method(args)
+void VM::invoke(LoxString *name, uint arg_num, PropertyCache &cache) {
+    ExprVal &receiver = peek(arg_num);
+    LoxInstance *instance = as_instance(receiver);
+    if (!instance) {
+        throw RuntimeException(nullptr,
+                               "Can only call property of a lox instance.");
+    }
+
+    // A field may hold a callable
+    int slot = instance->find_prop_slot(name, cache);
+    if (slot != -1) {
+        receiver = instance->fields[slot];
+        call_value(receiver, arg_num);
+        return;
+    }
+
+    if (auto klass = dynamic_cast<VmClass *>(instance->lox_class); klass) {
+        auto method = klass->vm_methods.find(name);
+        if (method != klass->vm_methods.end()) {
+            call_closure(method->second, arg_num);
+            return;
+        }
+    } else if (auto list_instance = dynamic_cast<ListInstance *>(instance);
+               list_instance) {
+        auto method = dynamic_cast<ListMethod *>(
+            instance->lox_class->get_method(name));
+        if (method) {
+            call_list_method(*method, *list_instance, arg_num);
+            return;
+        }
+    }
+
+    throw RuntimeException(nullptr,
+                           "Instance field " + name->str + " does not exists.");
+}
+
+ExprVal VM::bind_method(const ExprVal &receiver, LoxInstance &instance,
+                        LoxString *name) {
+    LoxCallable *method = nullptr;
+    if (auto klass = dynamic_cast<VmClass *>(instance.lox_class); klass) {
+        auto it = klass->vm_methods.find(name);
+        if (it != klass->vm_methods.end()) {
+            method = it->second;
+        }
+    } else {
+        method = instance.lox_class->get_method(name);
+    }
+
+    if (!method) {
+        throw RuntimeException(nullptr,
+                               "Instance field " + name->str +
+                                   " does not exists.");
+    }
+    return Heap::alloc<VmBoundMethod>(receiver, method);
+}
+
+std::shared_ptr<VmUpvalue> VM::capture_upvalue(ExprVal *local) {
+    std::shared_ptr<VmUpvalue> prev = nullptr;
+    std::shared_ptr<VmUpvalue> upvalue = open_upvalues;
+    while (upvalue != nullptr && upvalue->location > local) {
+        prev = upvalue;
+        upvalue = upvalue->next_open;
+    }
+
+    if (upvalue != nullptr && upvalue->location == local) {
+        return upvalue;
+    }
+
+    auto created = std::make_shared<VmUpvalue>(local);
+    created->next_open = upvalue;
+    if (prev == nullptr) {
+        open_upvalues = created;
+    } else {
+        prev->next_open = created;
+    }
+    return created;
+}
+
+void VM::close_upvalues(ExprVal *last) {
+    while (open_upvalues != nullptr && open_upvalues->location >= last) {
+        auto upvalue = open_upvalues;
+        upvalue->closed = *upvalue->location;
+        upvalue->location = &upvalue->closed;
+        open_upvalues = upvalue->next_open;
+        upvalue->next_open = nullptr;
+    }
+}
+
+LoxInstance *VM::as_instance(const ExprVal &value) {
+    if (!value.is_instance()) {
+        return nullptr;
+    }
+    return value.as<LoxInstance>();
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "clox/ast_interpreter/callable/list.hpp"
+#include "clox/parser/expr.hpp"
+#include "clox/parser/stmt.hpp"
+#include "clox/vm/chunk.hpp"
+#include "clox/vm/object.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+const uint FRAMES_MAX = 1024;
+const uint STACK_MAX = FRAMES_MAX * 64;
+
+// Stack based virtual machine executing the bytecode produced by Compiler. It
+// is an alternative execution engine to the AstInterpreter and must produce
+// the same program output.
+class VM : public IGcRoots {
+  private:
+    struct CallFrame {
+        VmClosure *closure;
+        uint8_t *ip;
+        // First stack slot of the frame: the callee/receiver, then the args
+        ExprVal *slots;
+        // Frame created by a class constructor, return the new instance
+        bool is_constructor;
+    };
+
+    struct Global {
+        ExprVal value = NIL;
+        // Top level variables are resolved to a slot at compile time, the
+        // slot is allocated before the variable definition is executed.
+        bool is_defined = false;
+    };
+
+    std::vector<ExprVal> stack;
+    ExprVal *stack_top;
+    std::vector<CallFrame> frames;
+    uint frame_count = 0;
+    std::shared_ptr<VmUpvalue> open_upvalues = nullptr;
+
+    std::vector<Global> globals = {};
+    std::vector<std::string> global_names = {};
+    std::unordered_map<std::string, uint> global_slots = {};
+    // The natives, defined in the first global slots
+    uint builtin_num = 0;
+    // Slots allocated to an imported name before the import bound it to the
+    // slot of the module variable. The code compiled before the import still
+    // uses them, they stay undefined and forward to the module variable.
+    std::unordered_map<uint, uint> imported_globals = {};
+
+    struct CompiledModule {
+        std::shared_ptr<VmFunction> script;
+        bool is_run = false;
+    };
+    std::vector<CompiledModule> modules = {};
+    std::unordered_map<const Module *, uint> module_indices = {};
+
+    void define_native(const std::string &name, LoxCallable *callable);
+
+    ExprVal run();
+    ExprVal execute(std::shared_ptr<VmFunction> script);
+    void reset_stack();
+
+    void push(const ExprVal &value) { *stack_top++ = value; }
+    ExprVal pop() { return std::move(*--stack_top); }
+    ExprVal &peek(int distance) { return stack_top[-1 - distance]; }
+
+    void call_value(const ExprVal &callee, uint arg_num);
+    void call_closure(VmClosure *closure, uint arg_num,
+                      bool is_constructor = false);
+    void call_native(LoxCallable &callable, uint arg_num);
+    void call_list_method(ListMethod &method, ListInstance &list_instance,
+                          uint arg_num);
+    void invoke(LoxString *name, uint arg_num, PropertyCache &cache);
+    // Run the frame just pushed by a tail call in place of the frame of the
+    // returning function
+    void replace_caller_frame();
+    ExprVal bind_method(const ExprVal &receiver, LoxInstance &instance,
+                        LoxString *name);
+    void check_arg_num(LoxCallable &callable, uint arg_num);
+
+    std::shared_ptr<VmUpvalue> capture_upvalue(ExprVal *local);
+    void close_upvalues(ExprVal *last);
+
+    LoxInstance *as_instance(const ExprVal &value);
+    // Return the global holding the value of the slot, nullptr when it is
+    // undefined
+    Global *find_global(uint slot);
+
+  public:
+    const bool is_interactive_mode;
+
+    VM(const bool is_interactive_mode);
+    ~VM();
+
+    ExprVal interpret_single_expr(Expr &expression);
+
+    void interpret_program(const std::vector<Stmt *> &stmts);
+
+    // Return the global table slot of a top level variable, allocate a new
+    // slot on the first reference.
+    uint get_global_slot(std::string_view name);
+    // Make name refer to the global slot of an imported module variable
+    void bind_global(const std::string &name, uint slot);
+    bool is_builtin(std::string_view name);
+
+    // Return the index of the module operand of OpCode::IMPORT, the module is
+    // compiled on its first import
+    uint get_module_index(const Module &module);
+    // Name of a top level variable of a module in the global table
+    static std::string module_global_name(const Module &module,
+                                          std::string_view name);
+
+    void mark_roots() override;
+};
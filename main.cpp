@@ -1,63 +1,191 @@
 #include "clox/ast_interpreter/ast_interpreter.hpp"
 #include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
 #include "clox/common/token.hpp"
+#include "clox/middleware/ast_cache.hpp"
+#include "clox/middleware/ast_optimizer.hpp"
 #include "clox/middleware/identifier_resolver.hpp"
+#include "clox/middleware/module_loader.hpp"
+#include "clox/middleware/streaming_runner.hpp"
+#include "clox/parser/parallel_parser.hpp"
 #include "clox/parser/parser.hpp"
 #include "clox/scanner/scanner.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include "clox/vm/vm.hpp"
 
-#include <fstream>
+#include <algorithm>
+#include <deque>
+#include <filesystem>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <vector>
 
 class CLox {
+  public:
+    enum class FrontEnd { SERIAL, STREAMING, PARALLEL };
+
   private:
-    // Process one line or a whole file
-    static void run(std::string source) {
-        std::unique_ptr<Scanner> scanner(new Scanner(source));
-        std::vector<std::shared_ptr<Token>> tokens = scanner->scan_tokens();
+    // Functions declared by a program keep pointing to its AST, the AST
+    // points to the tokens which view the source, so all of them live as
+    // long as the functions.
+    struct Program {
+        SourceBuffer source;
+        std::vector<Token> tokens;
+        // Tokens kept by the streaming mode, a deque never moves them
+        std::deque<Token> streamed_tokens;
+        AstArena arena;
+        // Tokens and AST of the chunks parsed by the parallel mode
+        ParallelParser parallel_parser;
+        // Strings pinned for the AST of a line, see Heap::ast_pins
+        std::vector<LoxObject *> pins;
+
+        ~Program() {
+            for (auto object : pins) {
+                Heap::unpin(object);
+            }
+        }
+    };
+
+    // Programs of the run files, they live until the interpreter exits
+    static std::vector<std::unique_ptr<Program>> programs;
+    // Lines of the interactive mode kept alive by the functions they declared
+    static std::vector<std::weak_ptr<Program>> kept_lines;
+    // The heap doesn't account the lines, it is collected when the kept lines
+    // exceed this bound to release the lines of unreachable functions.
+    static size_t max_kept_lines;
+    static constexpr size_t MIN_MAX_KEPT_LINES = 256;
+
+    static Program &new_program() {
+        programs.push_back(std::make_unique<Program>());
+        return *programs.back();
+    }
+
+    // Scan and parse one line or a whole file
+    static std::vector<Stmt *> parse(Program &program, FrontEnd front_end,
+                                     size_t thread_num) {
+        if (front_end == FrontEnd::PARALLEL) {
+            ThreadPool pool(thread_num);
+            return program.parallel_parser.parse_program(
+                program.source.view(), pool);
+        }
+        Scanner scanner{program.source.view()};
+        program.tokens = scanner.scan_tokens();
+        Parser parser = Parser(program.tokens, program.arena);
+        return parser.parse_program();
+    }
 
-        Parser parser = Parser(tokens);
-        std::vector<std::shared_ptr<Stmt>> stmts = parser.parse_program();
+    // Process one line or a whole file. With a cache path, the resolved
+    // program is loaded from the cache when it matches the source, otherwise
+    // it is written to the cache once resolved.
+    static void run(Program &program, FrontEnd front_end = FrontEnd::SERIAL,
+                    size_t thread_num = 0, const std::string &cache_path = "") {
+        std::vector<Stmt *> stmts;
+        if (!cache_path.empty() &&
+            AstCache::load(cache_path, program.source.view(), program.tokens,
+                           program.arena, stmts, *ast_interpreter)) {
+            optimize(stmts, program.arena);
+            execute(stmts);
+            return;
+        }
+
+        stmts = parse(program, front_end, thread_num);
         if (ErrorManager::had_static_err) {
             std::cout << "Parser error occurs" << std::endl;
             return;
         }
 
-        IdentifierResolver resolver = IdentifierResolver(ast_interpreter);
-        resolver.resolve_program(stmts);
+        uint base_global_num = AstCache::global_num(*ast_interpreter);
+        resolver->resolve_program(stmts);
         if (ErrorManager::had_static_err) {
             std::cout << "Resolver error occurs" << std::endl;
             return;
         }
+        if (!cache_path.empty()) {
+            AstCache::save(cache_path, program.source.view(), stmts,
+                           *ast_interpreter, base_global_num);
+        }
+        optimize(stmts, program.arena);
+        execute(stmts);
+    }
 
-        ast_interpreter->interpret_program(stmts);
+    // Process a whole file one top-level declaration at a time, see
+    // StreamingRunner
+    static void run_streaming(Program &program) {
+        StreamingRunner::run(program.source.view(), program.streamed_tokens,
+                             program.arena, *resolver,
+                             [&](std::vector<Stmt *> &stmts) {
+                                 optimize(stmts, program.arena);
+                                 return execute(stmts);
+                             });
+    }
+
+    // Run after the resolver, the cache keeps the unoptimized program. The
+    // folded literals are created in arena, next to the nodes they replace.
+    static void optimize(std::vector<Stmt *> &stmts, AstArena &arena) {
+        if (opt_level > 0) {
+            AstOptimizer optimizer(ast_interpreter, arena);
+            optimizer.optimize_program(stmts);
+        }
+    }
+
+    // Return false on runtime error
+    static bool execute(const std::vector<Stmt *> &stmts) {
+        if (vm != nullptr) {
+            vm->interpret_program(stmts);
+        } else {
+            ast_interpreter->interpret_program(stmts);
+        }
         if (ErrorManager::had_runtime_err) {
             std::cout << "Runtime error occurs" << std::endl;
-            return;
+            return false;
         }
+        return true;
     }
 
   public:
     static std::shared_ptr<AstInterpreter> ast_interpreter;
-    static void run_file(std::string path) {
+    // Set when the program is executed by the bytecode VM, the
+    // AstInterpreter is then only used by the resolver.
+    static std::shared_ptr<VM> vm;
+    // Shared by every program so that the globals of a line are resolved
+    // in the next ones
+    static std::unique_ptr<IdentifierResolver> resolver;
+    // 0 executes the program as parsed, 1 runs the AstOptimizer first
+    static int opt_level;
+    // thread_num is the size of the pool of the parallel front end, 0 uses
+    // one thread per core. Streamed files are never cached.
+    static void run_file(std::string path, FrontEnd front_end,
+                         size_t thread_num, bool use_cache) {
         ErrorManager::had_static_err = false;
-        std::ifstream file(path);
-        std::string content;
-
-        if (file.is_open()) {
-            // Read entire file into a string
-            content.assign((std::istreambuf_iterator<char>(file)),
-                           std::istreambuf_iterator<char>());
-
-            run(content);
-            file.close();
-        } else {
+        Program &program = new_program();
+        // The file is mapped and scanned in place, without copying it
+        if (!program.source.load_file(path)) {
             std::cerr << "Unable to open file" << std::endl;
+            return;
+        }
+        if (front_end == FrontEnd::STREAMING) {
+            run_streaming(program);
+        } else {
+            run(program, front_end, thread_num,
+                use_cache ? AstCache::path_of(path) : "");
         }
     }
 
+    static void release_unused_lines() {
+        if (kept_lines.size() < max_kept_lines) {
+            return;
+        }
+        Heap::collect();
+        auto is_released = [](const std::weak_ptr<Program> &line) {
+            return line.expired();
+        };
+        kept_lines.erase(std::remove_if(kept_lines.begin(), kept_lines.end(),
+                                        is_released),
+                         kept_lines.end());
+        max_kept_lines = std::max(2 * kept_lines.size(), MIN_MAX_KEPT_LINES);
+    }
+
     // Interactive mode
     static void run_prompt() {
         const std::string prompt_start = "==> ";
@@ -70,21 +198,115 @@ class CLox {
         while (std::getline(std::cin, line)) {
             ErrorManager::had_static_err = false;
             ErrorManager::had_runtime_err = false;
-            run(line);
+            auto program = std::make_shared<Program>();
+            program->source.load_text(line);
+            ast_interpreter->ast_owner = program;
+            Heap::ast_pins = &program->pins;
+            run(*program);
+            Heap::ast_pins = nullptr;
+            ast_interpreter->ast_owner = nullptr;
+            if (program.use_count() > 1) {
+                release_unused_lines();
+                kept_lines.push_back(program);
+            }
             std::cout << prompt_start;
         }
     }
 };
 
 std::shared_ptr<AstInterpreter> CLox::ast_interpreter;
+std::shared_ptr<VM> CLox::vm;
+int CLox::opt_level = 1;
+std::vector<std::unique_ptr<CLox::Program>> CLox::programs;
+std::vector<std::weak_ptr<CLox::Program>> CLox::kept_lines;
+size_t CLox::max_kept_lines = CLox::MIN_MAX_KEPT_LINES;
+std::unique_ptr<IdentifierResolver> CLox::resolver;
+
+void exit_with_usage() {
+    std::cout << "Usage: lox [--engine=ast|vm] [--gc-stats] "
+                 "[--gc-growth-factor=N] [--stream | --parallel[=N]] [--cache] "
+                 "[-O0 | -O1] [--opt-stats] [script]"
+              << std::endl;
+    exit(1);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc > 2) {
-        std::cout << "Usage: lox [script]" << std::endl;
-        exit(1);
-    } else if (argc == 2) {
-        CLox::ast_interpreter = std::make_shared<AstInterpreter>(false);
-        CLox::run_file(argv[1]);
+    std::string engine = "ast";
+    bool print_gc_stats = false;
+    bool print_opt_stats = false;
+    CLox::FrontEnd front_end = CLox::FrontEnd::SERIAL;
+    size_t thread_num = 0;
+    bool use_cache = false;
+    std::vector<std::string> scripts{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--engine=", 0) == 0) {
+            engine = arg.substr(std::string("--engine=").length());
+        } else if (arg == "--gc-stats") {
+            print_gc_stats = true;
+        } else if (arg == "-O0" || arg == "-O1") {
+            CLox::opt_level = arg[2] - '0';
+        } else if (arg == "--opt-stats") {
+            print_opt_stats = true;
+        } else if (arg == "--stream") {
+            front_end = CLox::FrontEnd::STREAMING;
+        } else if (arg == "--cache") {
+            use_cache = true;
+        } else if (arg == "--parallel") {
+            front_end = CLox::FrontEnd::PARALLEL;
+        } else if (arg.rfind("--parallel=", 0) == 0) {
+            front_end = CLox::FrontEnd::PARALLEL;
+            try {
+                thread_num = std::stoul(
+                    arg.substr(std::string("--parallel=").length()));
+            } catch (std::exception &) {
+                exit_with_usage();
+            }
+        } else if (arg.rfind("--gc-growth-factor=", 0) == 0) {
+            // Heap threshold after a collection = live bytes * growth factor
+            try {
+                Heap::growth_factor = std::stod(
+                    arg.substr(std::string("--gc-growth-factor=").length()));
+            } catch (std::exception &) {
+                exit_with_usage();
+            }
+            if (Heap::growth_factor < 1) {
+                exit_with_usage();
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            exit_with_usage();
+        } else {
+            scripts.push_back(arg);
+        }
+    }
+    if (scripts.size() > 1 || (engine != "ast" && engine != "vm")) {
+        exit_with_usage();
+    }
+
+    bool is_interactive_mode = scripts.empty();
+    CLox::ast_interpreter =
+        std::make_shared<AstInterpreter>(is_interactive_mode);
+    if (engine == "vm") {
+        CLox::vm = std::make_shared<VM>(is_interactive_mode);
+    }
+    // Imports are relative to the directory of the script
+    std::string base_dir =
+        is_interactive_mode
+            ? ""
+            : std::filesystem::path(scripts[0]).parent_path().string();
+    CLox::resolver =
+        std::make_unique<IdentifierResolver>(CLox::ast_interpreter, base_dir);
+    ModuleLoader::use_cache = use_cache;
+    ModuleLoader::use_optimizer = CLox::opt_level > 0;
+
+    if (!is_interactive_mode) {
+        CLox::run_file(scripts[0], front_end, thread_num, use_cache);
+        if (print_gc_stats) {
+            Heap::print_stats(std::cerr);
+        }
+        if (print_opt_stats) {
+            AstOptimizer::print_stats(std::cerr);
+        }
         if (ErrorManager::had_static_err) {
             exit(65);
         }
@@ -92,7 +314,12 @@ int main(int argc, char *argv[]) {
             exit(70);
         }
     } else {
-        CLox::ast_interpreter = std::make_shared<AstInterpreter>(true);
         CLox::run_prompt();
+        if (print_gc_stats) {
+            Heap::print_stats(std::cerr);
+        }
+        if (print_opt_stats) {
+            AstOptimizer::print_stats(std::cerr);
+        }
     }
 }
\ No newline at end of file
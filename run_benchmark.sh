@@ -0,0 +1,10 @@
+#!/bin/bash
+
+# Run each benchmark in the bench folder with the given engine flags, e.g.
+# ./run_benchmark.sh --engine=vm
+for file in bench/*.lox; do
+    echo "Running $file..."
+    if [[ -f "$file" ]]; then
+        build/main "$@" "$file"
+    fi
+done
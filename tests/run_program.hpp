@@ -0,0 +1,45 @@
+#pragma once
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Run the program with both engines and return their output, or the static
+// errors twice when it has any. Its imports are relative to the base dir.
+inline std::vector<std::string> runProgram(const std::string &source,
+                                           const std::string &base_dir = "") {
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+
+    AstArena arena;
+    Parser parser{tokens, arena};
+    auto stmts = parser.parse_program();
+
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    IdentifierResolver resolver{interpreter, base_dir};
+    testing::internal::CaptureStdout();
+    ErrorManager::had_static_err = false;
+    resolver.resolve_program(stmts);
+    std::string static_errors = testing::internal::GetCapturedStdout();
+    if (ErrorManager::had_static_err) {
+        ErrorManager::had_static_err = false;
+        return {static_errors, static_errors};
+    }
+
+    testing::internal::CaptureStdout();
+    interpreter->interpret_program(stmts);
+    std::string ast_output = testing::internal::GetCapturedStdout();
+
+    auto vm = std::make_shared<VM>(false);
+    testing::internal::CaptureStdout();
+    vm->interpret_program(stmts);
+    std::string vm_output = testing::internal::GetCapturedStdout();
+
+    return {ast_output, vm_output};
+}
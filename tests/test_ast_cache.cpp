@@ -0,0 +1,172 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/middleware/ast_cache.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <gtest/gtest.h>
+#include <memory>
+
+const std::string PROGRAM = R"(class Base {
+    fun greet() { return "hello " + this.name; }
+}
+class Named : Base {
+    fun init(name) { this.name = name; }
+    fun greet() { return super.greet() + "!"; }
+}
+fun count(n) {
+    var total = 0;
+    for var i = 0; i < n; i = i + 1; {
+        if i % 2 == 0 { continue; }
+        total = total + i;
+    }
+    return total;
+}
+var named = Named("lox");
+print(named.greet());
+print(count(10));
+)";
+
+// Return the output of the program run by a new interpreter from the cache,
+// or "" when it can't be loaded
+std::string runCached(const std::string &path, const std::string &source) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens;
+    AstArena arena;
+    std::vector<Stmt *> stmts;
+    if (!AstCache::load(path, source, tokens, arena, stmts, *interpreter)) {
+        return "";
+    }
+    testing::internal::CaptureStdout();
+    interpreter->interpret_program(stmts);
+    return testing::internal::GetCapturedStdout();
+}
+
+// Return the output of the program, loaded from the cache or, as on a cache
+// miss, resolved from its source
+std::string runOrResolve(const std::string &path, const std::string &source) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens;
+    AstArena arena;
+    std::vector<Stmt *> stmts;
+    if (!AstCache::load(path, source, tokens, arena, stmts, *interpreter)) {
+        tokens = Scanner(source).scan_tokens();
+        stmts = Parser(tokens, arena).parse_program();
+        IdentifierResolver{interpreter}.resolve_program(stmts);
+    }
+    testing::internal::CaptureStdout();
+    interpreter->interpret_program(stmts);
+    return testing::internal::GetCapturedStdout();
+}
+
+// Write the cache of PROGRAM, with its annotations changed by tamper
+void saveProgram(const std::string &path,
+                 const std::function<void(std::vector<Stmt *> &)> &tamper) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens = Scanner(PROGRAM).scan_tokens();
+    AstArena arena;
+    std::vector<Stmt *> stmts = Parser(tokens, arena).parse_program();
+    uint base_global_num = AstCache::global_num(*interpreter);
+    IdentifierResolver{interpreter}.resolve_program(stmts);
+    tamper(stmts);
+    ASSERT_TRUE(
+        AstCache::save(path, PROGRAM, stmts, *interpreter, base_global_num));
+}
+
+// Test: a cached program should run as the program resolved from its source,
+// and only be loaded for that source
+TEST(AstCacheTest, LoadsResolvedProgram) {
+    std::string path = testing::TempDir() + "ast_cache_test.lox.cache";
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens = Scanner(PROGRAM).scan_tokens();
+    AstArena arena;
+    std::vector<Stmt *> stmts = Parser(tokens, arena).parse_program();
+    uint base_global_num = AstCache::global_num(*interpreter);
+    IdentifierResolver{interpreter}.resolve_program(stmts);
+    ASSERT_TRUE(
+        AstCache::save(path, PROGRAM, stmts, *interpreter, base_global_num));
+
+    EXPECT_EQ(runCached(path, PROGRAM), "hello lox!\n25\n");
+    std::string changed = PROGRAM + "print(1);";
+    EXPECT_EQ(runCached(path, changed), "");
+
+    std::string data;
+    std::getline(std::ifstream(path), data, '\0');
+    for (size_t size : {size_t(0), size_t(30), data.size() / 2}) {
+        std::ofstream(path) << data.substr(0, size);
+        EXPECT_EQ(runCached(path, PROGRAM), "") << size;
+    }
+    std::remove(path.c_str());
+    EXPECT_EQ(runCached(path, PROGRAM), "");
+}
+
+// Test: a truncated or corrupted cache is missed, the program then runs as
+// resolved from its source
+TEST(AstCacheTest, MissesCorruptedCache) {
+    std::string path = testing::TempDir() + "ast_cache_corrupted.lox.cache";
+    saveProgram(path, [](std::vector<Stmt *> &) {});
+    std::string data;
+    std::getline(std::ifstream(path), data, '\0');
+    const std::string output = "hello lox!\n25\n";
+
+    for (size_t size = 0; size < data.size(); ++size) {
+        std::ofstream(path) << data.substr(0, size);
+        EXPECT_EQ(runOrResolve(path, PROGRAM), output) << size;
+    }
+    for (size_t i = 0; i < data.size(); ++i) {
+        for (char flip : {'\x01', '\x80', '\xff'}) {
+            std::string corrupted = data;
+            corrupted[i] ^= flip;
+            std::ofstream(path) << corrupted;
+            EXPECT_EQ(runOrResolve(path, PROGRAM), output) << i;
+        }
+    }
+    std::remove(path.c_str());
+}
+
+// Test: a cache whose depths and slots don't match the envs of the program
+// is rejected, even with a valid checksum
+TEST(AstCacheTest, RejectsSlotsOutOfTheirEnv) {
+    std::string path = testing::TempDir() + "ast_cache_slots.lox.cache";
+    auto count_body = [](std::vector<Stmt *> &stmts) {
+        return static_cast<FunctionDecl *>(stmts[2])->body;
+    };
+    // The identifier total of "return total;" in count
+    auto total = [&](std::vector<Stmt *> &stmts) {
+        auto return_stmt =
+            static_cast<ReturnStmt *>(count_body(stmts)->stmts.back());
+        return static_cast<IdentifierExpr *>(return_stmt->expr);
+    };
+    std::vector<std::function<void(std::vector<Stmt *> &)>> tamperings = {
+        [&](std::vector<Stmt *> &stmts) { total(stmts)->depth = 3; },
+        [&](std::vector<Stmt *> &stmts) { total(stmts)->depth = -7; },
+        [&](std::vector<Stmt *> &stmts) { total(stmts)->slot = 100; },
+        [&](std::vector<Stmt *> &stmts) {
+            total(stmts)->depth = UPVALUE_DEPTH;
+        },
+        [&](std::vector<Stmt *> &stmts) {
+            total(stmts)->depth = GLOBAL_DEPTH;
+            total(stmts)->slot = 1000;
+        },
+        [&](std::vector<Stmt *> &stmts) {
+            static_cast<VarDecl *>(count_body(stmts)->stmts[0])->slot = 100;
+        },
+        [&](std::vector<Stmt *> &stmts) {
+            count_body(stmts)->slot_num = 1 << 30;
+        },
+        [&](std::vector<Stmt *> &stmts) {
+            static_cast<FunctionDecl *>(stmts[2])->captures.push_back(
+                {false, 0, 0});
+        },
+    };
+    for (size_t i = 0; i < tamperings.size(); ++i) {
+        saveProgram(path, tamperings[i]);
+        EXPECT_EQ(runCached(path, PROGRAM), "") << i;
+    }
+    saveProgram(path, [](std::vector<Stmt *> &) {});
+    EXPECT_EQ(runCached(path, PROGRAM), "hello lox!\n25\n");
+    std::remove(path.c_str());
+}
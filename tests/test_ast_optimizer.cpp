@@ -0,0 +1,51 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/middleware/ast_optimizer.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+const std::string PROGRAM = R"(var a = (1 + 2) * 3 - -4;
+print(a + 1);
+print("ab" + "cd");
+if 1 > 2 { print("no"); } elif 2 > 1 { print("yes"); } else { print(0); }
+while false { print("never"); }
+for var i = 0; ; i = i + 1; {
+    if i == 2 { break; }
+    print(i);
+}
+print(1 / 0);
+)";
+
+// Test: the optimized program should print what the program prints, with
+// constants folded and dead branches removed
+TEST(AstOptimizerTest, FoldsConstantsAndPrunesBranches) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens = Scanner(PROGRAM).scan_tokens();
+    AstArena arena;
+    std::vector<Stmt *> stmts = Parser(tokens, arena).parse_program();
+    IdentifierResolver{interpreter}.resolve_program(stmts);
+
+    AstOptimizer::stats = {};
+    AstOptimizer(interpreter, arena).optimize_program(stmts);
+    EXPECT_EQ(AstOptimizer::stats.folded_exprs, 7);
+    EXPECT_EQ(AstOptimizer::stats.pruned_branches, 3);
+
+    // The dead while is removed, the if is replaced by its true block
+    ASSERT_EQ(stmts.size(), 6);
+    auto var_decl = dynamic_cast<VarDecl *>(stmts[0]);
+    auto literal = dynamic_cast<LiteralExpr *>(var_decl->initializer);
+    ASSERT_NE(literal, nullptr);
+    EXPECT_EQ(literal->value.as_number(), 13);
+    EXPECT_NE(dynamic_cast<BlockStmt *>(stmts[3]), nullptr);
+    // The divide by 0 is left to be reported at run time
+    auto print = dynamic_cast<ExprStmt *>(stmts[5]);
+    auto call = dynamic_cast<FuncCallExpr *>(print->expr);
+    EXPECT_NE(dynamic_cast<BinaryExpr *>(call->args[0]), nullptr);
+
+    testing::internal::CaptureStdout();
+    interpreter->interpret_program(stmts);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "14\nabcd\nyes\n0\n1\n[line 10] Error at '/': Devide by 0\n");
+}
@@ -0,0 +1,60 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include "tests/run_program.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+// Test: a block declaring nothing has no scope, the identifiers it references
+// are resolved from the enclosing scope
+TEST(BlockScopeTest, ResolvesBlocksWithoutDeclarationsInEnclosingScope) {
+    std::string source = "fun f(n) {"
+                         "  while n > 0 { n = n - 1; }"
+                         "  if n == 0 { var m = n; }"
+                         "}";
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+    AstArena arena;
+    auto stmts = Parser(tokens, arena).parse_program();
+    IdentifierResolver{std::make_shared<AstInterpreter>(false)}
+        .resolve_program(stmts);
+
+    auto func = static_cast<FunctionDecl *>(stmts[0]);
+    auto while_stmt = static_cast<WhileStmt *>(func->body->stmts[0]);
+    auto assign = static_cast<AssignStmt *>(while_stmt->body->stmts[0]);
+    EXPECT_EQ(while_stmt->body->slot_num, 0);
+    EXPECT_EQ(assign->var->depth, 0);
+
+    auto if_stmt = static_cast<IfStmt *>(func->body->stmts[1]);
+    auto if_block = static_cast<BlockStmt *>(if_stmt->if_blocks[0]);
+    auto var_decl = static_cast<VarDecl *>(if_block->stmts[0]);
+    EXPECT_EQ(if_block->slot_num, 1);
+    EXPECT_EQ(static_cast<IdentifierExpr *>(var_decl->initializer)->depth, 1);
+}
+
+// Test: blocks with and without scope nested in loops and closures
+TEST(BlockScopeTest, RunsBlocksWithoutDeclarations) {
+    auto outputs = runProgram("var sum = 0;"
+                              "for var i = 0; i < 10; i = i + 1; {"
+                              "  if i % 2 == 0 { continue; }"
+                              "  { { sum = sum + i; } }"
+                              "}"
+                              "fun adder(n) {"
+                              "  if n > 0 {"
+                              "    fun add(x) {"
+                              "      if x > 0 { return x + n; }"
+                              "      return n;"
+                              "    }"
+                              "    return add;"
+                              "  }"
+                              "}"
+                              "var x = 1;"
+                              "{ var x = 2; { print(x); } }"
+                              "print(x);"
+                              "print(sum);"
+                              "print(adder(2)(3));");
+    EXPECT_EQ(outputs[0], "2\n1\n25\n5\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
@@ -0,0 +1,123 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include "tests/run_program.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+// Test: a function captures only the variables of the enclosing functions it
+// references, through the functions between them
+TEST(ClosureCaptureTest, CapturesReferencedVariables) {
+    std::string source = "fun outer(a, b) {"
+                         "  var c = 1;"
+                         "  fun mid() {"
+                         "    fun inner() { return a + c; }"
+                         "    return inner;"
+                         "  }"
+                         "  return mid;"
+                         "}";
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+    AstArena arena;
+    auto stmts = Parser(tokens, arena).parse_program();
+    IdentifierResolver{std::make_shared<AstInterpreter>(false)}
+        .resolve_program(stmts);
+
+    auto outer = static_cast<FunctionDecl *>(stmts[0]);
+    auto c = static_cast<VarDecl *>(outer->body->stmts[0]);
+    auto mid = static_cast<FunctionDecl *>(outer->body->stmts[1]);
+    auto inner = static_cast<FunctionDecl *>(mid->body->stmts[0]);
+    EXPECT_TRUE(outer->params[0]->is_cell);
+    EXPECT_FALSE(outer->params[1]->is_cell);
+    EXPECT_TRUE(c->is_captured);
+
+    ASSERT_EQ(mid->captures.size(), 2);
+    EXPECT_TRUE(mid->captures[0].is_local);
+    EXPECT_EQ(mid->captures[0].slot, outer->params[0]->slot);
+    EXPECT_EQ(mid->captures[1].slot, c->slot);
+    ASSERT_EQ(inner->captures.size(), 2);
+    EXPECT_FALSE(inner->captures[0].is_local);
+    EXPECT_EQ(inner->captures[1].slot, 1);
+
+    auto ret = static_cast<ReturnStmt *>(inner->body->stmts[0]);
+    auto a = static_cast<IdentifierExpr *>(
+        static_cast<BinaryExpr *>(ret->expr)->left_operand);
+    EXPECT_EQ(a->depth, UPVALUE_DEPTH);
+    EXPECT_EQ(a->slot, 0);
+    EXPECT_TRUE(a->is_cell);
+}
+
+// Test: the closures capturing a variable share it with its scope
+TEST(ClosureCaptureTest, SharesCapturedVariables) {
+    auto outputs = runProgram("fun counter() {"
+                              "  var n = 0;"
+                              "  fun inc() { n = n + 1; return n; }"
+                              "  fun get() { return n; }"
+                              "  inc();"
+                              "  n = n + 10;"
+                              "  return List(inc, get);"
+                              "}"
+                              "var first = counter();"
+                              "var second = counter();"
+                              "first.at(0)();"
+                              "print(first.at(1)());"
+                              "print(second.at(1)());"
+                              "fun fact(n) {"
+                              "  fun rec(k) {"
+                              "    if k <= 1 { return 1; }"
+                              "    return k * rec(k - 1);"
+                              "  }"
+                              "  return rec(n);"
+                              "}"
+                              "print(fact(5));");
+    EXPECT_EQ(outputs[0], "12\n11\n120\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
+
+// Test: "this" and "super" are captured by the closures nested in a method
+TEST(ClosureCaptureTest, CapturesThisAndSuper) {
+    auto outputs = runProgram("class A { fun name() { return \"A\"; } }"
+                              "class B : A {"
+                              "  fun init() { this.tag = \"!\"; }"
+                              "  fun name() {"
+                              "    fun later() {"
+                              "      return super.name() + \"B\" + this.tag;"
+                              "    }"
+                              "    return later;"
+                              "  }"
+                              "}"
+                              "print(B().name()());");
+    EXPECT_EQ(outputs[0], "AB!\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
+
+// Test: a closure does not keep alive the variables it does not capture
+TEST(ClosureCaptureTest, ReleasesVariablesNotCaptured) {
+    std::string source = "fun make(n) {"
+                         "  var big = List();"
+                         "  for var i = 0; i < 1000; i = i + 1; {"
+                         "    big.push(str(i));"
+                         "  }"
+                         "  fun add(x) { return x + n; }"
+                         "  return add;"
+                         "}"
+                         "var add = make(1);";
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+    AstArena arena;
+    auto stmts = Parser(tokens, arena).parse_program();
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    IdentifierResolver{interpreter}.resolve_program(stmts);
+
+    Heap::collect();
+    size_t bytes_before = Heap::get_bytes_allocated();
+    interpreter->interpret_program(stmts);
+
+    // add is alive, big and its 1000 strings are freed
+    Heap::collect();
+    EXPECT_LT(Heap::get_bytes_allocated(), bytes_before + 4096);
+}
@@ -0,0 +1,57 @@
+#include "clox/ast_interpreter/helper.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/common/expr_val.hpp"
+#include "clox/common/heap.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+
+TEST(ExprValTest, FitsInOneWord) { EXPECT_EQ(sizeof(ExprVal), 8); }
+
+TEST(ExprValTest, KeepsTypeAndValue) {
+    ExprVal num = 3.5;
+    EXPECT_TRUE(num.is_number());
+    EXPECT_FALSE(num.is_object());
+    EXPECT_EQ(num.as_number(), 3.5);
+
+    ExprVal neg_zero = -0.0;
+    EXPECT_TRUE(neg_zero.is_number());
+    EXPECT_FALSE(neg_zero.is_object());
+
+    ExprVal nan = std::nan("");
+    EXPECT_TRUE(nan.is_number());
+
+    ExprVal boolean = false;
+    EXPECT_TRUE(boolean.is_bool());
+    EXPECT_FALSE(boolean.as_bool());
+    EXPECT_FALSE(boolean.is_nil());
+
+    EXPECT_TRUE(NIL.is_nil());
+    EXPECT_FALSE(NIL.is_bool());
+    EXPECT_FALSE(NIL.is_number());
+
+    LoxString *str_obj = Heap::make_string("moon");
+    ExprVal str = str_obj;
+    EXPECT_TRUE(str.is_object());
+    EXPECT_TRUE(str.is_string());
+    EXPECT_FALSE(str.is_instance());
+    EXPECT_EQ(str.as<LoxString>(), str_obj);
+    EXPECT_EQ(str.as_string(), "moon");
+}
+
+TEST(ExprValTest, ComparesByValue) {
+    EXPECT_EQ(ExprVal(0.0), ExprVal(-0.0));
+    EXPECT_NE(ExprVal(1.0), ExprVal(true));
+    EXPECT_NE(NIL, ExprVal(false));
+    EXPECT_EQ(ExprVal(Heap::make_string("a")), ExprVal(Heap::make_string("a")));
+    EXPECT_TRUE(is_expr_vals_equal(ExprVal(1.0), ExprVal(true)));
+    EXPECT_EQ(cast_expr_val_to_string(ExprVal(2.0)), "2");
+    EXPECT_EQ(cast_expr_val_to_string(NIL), "nil");
+}
+
+TEST(ExprValTest, InternsStrings) {
+    LoxString *a = Heap::make_string("sun");
+    LoxString *b = Heap::make_string(std::string("s") + "un");
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a->hash, std::hash<std::string_view>{}("sun"));
+    EXPECT_NE(Heap::make_string("sun"), Heap::make_string("Sun"));
+}
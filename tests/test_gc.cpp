@@ -0,0 +1,192 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+const std::string GARBAGE_PROGRAM = "class Node {"
+                                    "  fun init(value) {"
+                                    "    this.value = value;"
+                                    "    this.self = this;"
+                                    "  }"
+                                    "}"
+                                    "var kept = Node(\"kept\");"
+                                    "for var i = 0; i < 1000; i = i + 1; {"
+                                    "  var garbage = Node(i);"
+                                    "}";
+
+// The AST points to the tokens, which view the source
+std::vector<Stmt *>
+parseProgram(const std::string &source, std::vector<Token> &tokens,
+             AstArena &arena, std::shared_ptr<AstInterpreter> interpreter) {
+    Scanner scanner{source};
+    tokens = scanner.scan_tokens();
+
+    Parser parser{tokens, arena};
+    auto stmts = parser.parse_program();
+
+    IdentifierResolver resolver{interpreter};
+    resolver.resolve_program(stmts);
+    return stmts;
+}
+
+TEST(GcTest, FreesUnreachableObjectsInAstInterpreter) {
+    std::vector<Token> tokens;
+    AstArena arena;
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    auto stmts = parseProgram(GARBAGE_PROGRAM, tokens, arena, interpreter);
+    size_t freed_objects = Heap::stats.freed_objects;
+    interpreter->interpret_program(stmts);
+
+    size_t bytes_before = Heap::get_bytes_allocated();
+    Heap::collect();
+
+    // Every garbage Node points to itself, the cycles are still reclaimed
+    EXPECT_GE(Heap::stats.freed_objects, freed_objects + 1000);
+    EXPECT_LT(Heap::get_bytes_allocated(), bytes_before);
+
+    // The reachable Node and its fields survive the collection
+    std::string check_source = "kept.value;";
+    std::vector<Token> check_tokens;
+    auto check_stmts =
+        parseProgram(check_source, check_tokens, arena, interpreter);
+    auto &check_stmt = static_cast<ExprStmt &>(*check_stmts[0]);
+    auto kept = interpreter->interpret_single_expr(*check_stmt.expr);
+    ASSERT_TRUE(kept.is_string());
+    EXPECT_EQ(kept.as_string(), "kept");
+}
+
+TEST(GcTest, FreesUnreachableObjectsInVm) {
+    std::vector<Token> tokens;
+    AstArena arena;
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    auto stmts = parseProgram(GARBAGE_PROGRAM, tokens, arena, interpreter);
+    auto vm = std::make_shared<VM>(false);
+    size_t freed_objects = Heap::stats.freed_objects;
+    vm->interpret_program(stmts);
+
+    Heap::collect();
+
+    EXPECT_GE(Heap::stats.freed_objects, freed_objects + 1000);
+}
+
+// Source, tokens and AST of one line of the interactive mode
+struct Line {
+    std::string source;
+    std::vector<Token> tokens;
+    AstArena arena;
+    std::vector<LoxObject *> pins;
+
+    ~Line() {
+        for (auto object : pins) {
+            Heap::unpin(object);
+        }
+    }
+};
+
+// Run a line resolved by the resolver shared by every line, the line is only
+// kept alive by the functions it declares
+std::weak_ptr<Line> runLine(const std::string &source,
+                            IdentifierResolver &resolver,
+                            std::shared_ptr<AstInterpreter> interpreter) {
+    auto line = std::make_shared<Line>();
+    line->source = source;
+    Heap::ast_pins = &line->pins;
+    line->tokens = Scanner(line->source).scan_tokens();
+    ErrorManager::had_static_err = false;
+    auto stmts = Parser(line->tokens, line->arena).parse_program();
+    resolver.resolve_program(stmts);
+    interpreter->ast_owner = line;
+    interpreter->interpret_program(stmts);
+    interpreter->ast_owner = nullptr;
+    Heap::ast_pins = nullptr;
+    return line;
+}
+
+TEST(GcTest, ReleasesLinesOfCollectedFunctions) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    IdentifierResolver resolver{interpreter};
+    runLine("var f = nil;", resolver, interpreter);
+    auto kept = runLine("{ fun g() { return 1; } f = g; }", resolver,
+                        interpreter);
+    auto released = runLine("var x = f();", resolver, interpreter);
+    EXPECT_TRUE(released.expired());
+    Heap::collect();
+    EXPECT_FALSE(kept.expired());
+
+    runLine("f = nil;", resolver, interpreter);
+    Heap::collect();
+    EXPECT_TRUE(kept.expired());
+
+    // x is resolved after the line declaring it is released, a rejected
+    // line doesn't declare its globals
+    runLine("var y = 1; var y = 2;", resolver, interpreter);
+    testing::internal::CaptureStdout();
+    runLine("var y = x + 1; print(y);", resolver, interpreter);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "2\n");
+}
+
+// Test: the strings of a line are pinned as long as the line is kept
+TEST(GcTest, UnpinsStringsOfReleasedLines) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    IdentifierResolver resolver{interpreter};
+    runLine("var f = nil;", resolver, interpreter);
+    auto kept = runLine("{ fun g() { return \"kept line\"; } f = g; }",
+                        resolver, interpreter);
+    testing::internal::CaptureStdout();
+    runLine("print(\"released line\");", resolver, interpreter);
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(Heap::make_string("released line")->pin_count, 0u);
+    EXPECT_EQ(Heap::make_string("kept line")->pin_count, 1u);
+    Heap::collect();
+    testing::internal::CaptureStdout();
+    runLine("print(f());", resolver, interpreter);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "kept line\n");
+
+    runLine("f = nil;", resolver, interpreter);
+    Heap::collect();
+    EXPECT_TRUE(kept.expired());
+    EXPECT_EQ(Heap::make_string("kept line")->pin_count, 0u);
+}
+
+// Test: the envs of the calls and blocks are recycled by the next ones, a
+// closure only keeps the cells of the variables it captures
+TEST(GcTest, RecyclesEnvsOfCallsAndBlocks) {
+    const std::string program = R"(fun add(a, b) { var c = a + b; return c; }
+var sum = 0;
+for var i = 0; i < 100; i = i + 1; {
+  sum = add(add(add(add(add(sum, i), i), i), i), i);
+}
+fun make_counter() {
+  var i = 0;
+  fun counter() { i = i + 1; return i; }
+  return counter;
+}
+var first = make_counter();
+var second = make_counter();
+first();
+print(first());
+print(second());
+print(sum);
+)";
+    std::vector<Token> tokens;
+    AstArena arena;
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    auto stmts = parseProgram(program, tokens, arena, interpreter);
+    Heap::collect();
+    size_t freed_objects = Heap::stats.freed_objects;
+
+    testing::internal::CaptureStdout();
+    interpreter->interpret_program(stmts);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "2\n1\n24750\n");
+
+    // The 500 calls of add and the 100 runs of the loop body share a few
+    // envs, none of them is freed
+    Heap::collect();
+    EXPECT_LT(Heap::stats.freed_objects, freed_objects + 20);
+}
@@ -0,0 +1,94 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/constants.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include "tests/run_program.hpp"
+#include <gtest/gtest.h>
+#include <deque>
+#include <memory>
+
+// Test: globals are read from the global env whatever the depth of the
+// reference, including the ones declared after the function using them
+TEST(GlobalSlotsTest, ResolvesGlobalsToTheirSlot) {
+    std::string source = "fun f() { { return g; } }"
+                         "var g = 1;";
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+    AstArena arena;
+    auto stmts = Parser(tokens, arena).parse_program();
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    IdentifierResolver{interpreter}.resolve_program(stmts);
+
+    auto func = static_cast<FunctionDecl *>(stmts[0]);
+    auto block = static_cast<BlockStmt *>(func->body->stmts[0]);
+    auto return_stmt = static_cast<ReturnStmt *>(block->stmts[0]);
+    auto g = static_cast<IdentifierExpr *>(return_stmt->expr);
+    EXPECT_EQ(g->depth, GLOBAL_DEPTH);
+    EXPECT_EQ(g->slot, static_cast<VarDecl *>(stmts[1])->slot);
+}
+
+// Test: functions can call each other whatever their declaration order
+TEST(GlobalSlotsTest, BindsGlobalsDeclaredLater) {
+    auto outputs = runProgram("fun even(n) {"
+                              "  if n == 0 { return true; }"
+                              "  return odd(n - 1);"
+                              "}"
+                              "fun odd(n) {"
+                              "  if n == 0 { return false; }"
+                              "  return even(n - 1);"
+                              "}"
+                              "print(even(10));"
+                              "print(odd(7));");
+    EXPECT_EQ(outputs[0], "true\ntrue\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
+
+// Test: a global read or assigned before its declaration runs is undefined
+TEST(GlobalSlotsTest, ReportsGlobalsNotDefinedYet) {
+    auto outputs = runProgram("fun get() { return later; }"
+                              "print(get());"
+                              "var later = 1;");
+    EXPECT_NE(outputs[0].find("Reference to non-exist identifier: later"),
+              std::string::npos);
+    EXPECT_NE(outputs[1].find("Reference to non-exist identifier: later"),
+              std::string::npos);
+
+    outputs = runProgram("fun set() { later = 2; }"
+                         "set();"
+                         "var later = 1;");
+    EXPECT_NE(outputs[0].find("Cannot update undefined identifier 'later'"),
+              std::string::npos);
+    EXPECT_NE(outputs[1].find("Cannot update undefined identifier 'later'"),
+              std::string::npos);
+}
+
+// Test: in streaming mode, a function may call a function declared by a
+// later declaration, which is resolved and run after it
+TEST(GlobalSlotsTest, BindsGlobalsDeclaredByLaterPrograms) {
+    std::string source = "fun is_even(n) {"
+                         "  if n == 0 { return true; }"
+                         "  return is_odd(n - 1);"
+                         "}"
+                         "fun is_odd(n) {"
+                         "  if n == 0 { return false; }"
+                         "  return is_even(n - 1);"
+                         "}"
+                         "print(is_even(10));"
+                         "print(is_odd(7));";
+    Scanner scanner{source};
+    std::deque<Token> tokens;
+    AstArena arena;
+    Parser parser{scanner, tokens, arena};
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    IdentifierResolver resolver{interpreter};
+
+    testing::internal::CaptureStdout();
+    while (!parser.at_end()) {
+        std::vector<Stmt *> stmts = {parser.parse_next_declaration()};
+        resolver.resolve_program(stmts);
+        interpreter->interpret_program(stmts);
+    }
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "true\ntrue\n");
+}
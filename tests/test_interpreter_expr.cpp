@@ -15,7 +15,8 @@ void evaluateExpression(const std::string &source, const ExprVal &expected) {
     Scanner scanner{source};
     auto tokens = scanner.scan_tokens();
 
-    Parser parser{tokens};
+    AstArena arena;
+    Parser parser{tokens, arena};
     auto expression = parser.parse_single_expr();
 
     auto interpreter = std::make_shared<AstInterpreter>(false);
@@ -24,8 +25,24 @@ void evaluateExpression(const std::string &source, const ExprVal &expected) {
     ASSERT_EQ(actual, expected);
 }
 
+void evaluateExpression(const std::string &source,
+                        const std::string &expected) {
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+
+    AstArena arena;
+    Parser parser{tokens, arena};
+    auto expression = parser.parse_single_expr();
+
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    auto actual = interpreter->interpret_single_expr(*expression);
+
+    ASSERT_TRUE(actual.is_string());
+    ASSERT_EQ(actual.as_string(), expected);
+}
+
 TEST_F(AstInterpreterTest, EvaluatesLiteral) {
-    evaluateExpression("\"Cafe treebee\"", "Cafe treebee");
+    evaluateExpression("\"Cafe treebee\"", std::string("Cafe treebee"));
     evaluateExpression("522001", 522001.0);
     evaluateExpression("true", true);
 }
@@ -63,3 +80,31 @@ TEST_F(AstInterpreterTest, EvaluatesComparisonExpression) {
     evaluateExpression("\"abc\" < \"def\"", true);
     evaluateExpression("\"abc\" > \"def\"", false);
 }
+
+// Test: a binary expr site specializes on the operand types it sees first and
+// is deoptimized when it sees other types
+TEST_F(AstInterpreterTest, SpecializesBinaryExprSites) {
+    const std::string program = R"(fun add(a, b) { return a + b; }
+print(add(1, 2));
+print(add("a", "b"));
+)";
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens = Scanner(program).scan_tokens();
+    AstArena arena;
+    std::vector<Stmt *> stmts = Parser(tokens, arena).parse_program();
+    IdentifierResolver{interpreter}.resolve_program(stmts);
+
+    auto add = dynamic_cast<FunctionDecl *>(stmts[0]);
+    auto ret = dynamic_cast<ReturnStmt *>(add->body->stmts[0]);
+    auto binary_expr = dynamic_cast<BinaryExpr *>(ret->expr);
+    ASSERT_NE(binary_expr, nullptr);
+    EXPECT_EQ(binary_expr->specialization,
+              BinarySpecialization::UNINITIALIZED);
+
+    testing::internal::CaptureStdout();
+    interpreter->interpret_program({stmts[0], stmts[1]});
+    EXPECT_EQ(binary_expr->specialization, BinarySpecialization::NUMBERS);
+    interpreter->interpret_program({stmts[2]});
+    EXPECT_EQ(binary_expr->specialization, BinarySpecialization::GENERIC);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "3\nab\n");
+}
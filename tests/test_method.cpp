@@ -0,0 +1,50 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include "tests/run_program.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+const std::string BOX_CLASS = "class Box {"
+                              "  fun init(v) { this.v = v; }"
+                              "  fun get() { return this.v; }"
+                              "}";
+
+TEST(MethodTest, BindsReceiverPerCall) {
+    auto outputs = runProgram(BOX_CLASS + "var a = Box(1);"
+                                          "var b = Box(2);"
+                                          "var m = a.get;"
+                                          "print(b.get());"
+                                          "print(m());");
+    for (const auto &output : outputs) {
+        EXPECT_EQ(output, "2\n1\n");
+    }
+}
+
+TEST(MethodTest, BindsReceiverInClosuresAndSuper) {
+    auto outputs = runProgram(BOX_CLASS + "class Sub : Box {"
+                                          "  fun get() {"
+                                          "    fun inner() {"
+                                          "      return super.get() + 1;"
+                                          "    }"
+                                          "    return inner;"
+                                          "  }"
+                                          "}"
+                                          "var inner = Sub(3).get();"
+                                          "Sub(5).get();"
+                                          "print(inner());");
+    for (const auto &output : outputs) {
+        EXPECT_EQ(output, "4\n");
+    }
+}
+
+TEST(MethodTest, CallsCallableProp) {
+    auto outputs = runProgram(BOX_CLASS + "var a = Box(1);"
+                                          "a.f = Box(7).get;"
+                                          "print(a.f());");
+    for (const auto &output : outputs) {
+        EXPECT_EQ(output, "7\n");
+    }
+}
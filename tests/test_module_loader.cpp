@@ -0,0 +1,101 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/middleware/module_loader.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "tests/run_program.hpp"
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+
+const std::string COUNTER_MODULE = R"(var count = 0;
+fun next() {
+    count = count + 1;
+    return count;
+}
+print("counter loaded");
+)";
+
+const std::string PROGRAM = R"(import "counter.lox";
+next();
+print(next());
+print(count);
+)";
+
+// Write the module in the test dir, the imports of the programs are relative
+// to it
+void writeModule(const std::string &name, const std::string &source) {
+    std::ofstream(testing::TempDir() + name) << source;
+}
+
+// Test: the module runs once per interpreter in its own env, its exports are
+// references to its globals
+TEST(ModuleLoaderTest, ImportsModuleExports) {
+    writeModule("counter.lox", COUNTER_MODULE);
+    for (const std::string &output : runProgram(PROGRAM, testing::TempDir())) {
+        EXPECT_EQ(output, "counter loaded\n2\n2\n");
+    }
+    for (const std::string &output : runProgram("import \"counter.lox\";\n"
+                                                "count = 100;\n"
+                                                "print(next());\n"
+                                                "print(count);\n",
+                                                testing::TempDir())) {
+        EXPECT_EQ(output, "counter loaded\n101\n101\n");
+    }
+}
+
+// Test: importing a module again in the same scope is a no-op
+TEST(ModuleLoaderTest, IgnoresRepeatedImport) {
+    writeModule("counter.lox", COUNTER_MODULE);
+    for (const std::string &output : runProgram("import \"counter.lox\";\n"
+                                                "next();\n"
+                                                "import \"counter.lox\";\n"
+                                                "print(count);\n",
+                                                testing::TempDir())) {
+        EXPECT_EQ(output, "counter loaded\n1\n");
+    }
+}
+
+// Test: a module only sees the builtins and its own declarations
+TEST(ModuleLoaderTest, IsolatesModuleGlobals) {
+    writeModule("reader.lox", "fun read_secret() { return secret; }\n");
+    for (const std::string &output : runProgram("var secret = 1;\n"
+                                                "import \"reader.lox\";\n"
+                                                "print(read_secret());\n",
+                                                testing::TempDir())) {
+        EXPECT_NE(output.find("Reference to non-exist identifier: secret"),
+                  std::string::npos)
+            << output;
+    }
+}
+
+// Test: the closures created by a module function called from the program
+// read the module globals
+TEST(ModuleLoaderTest, ClosuresReadModuleGlobals) {
+    writeModule("adder.lox", "var base = 10;\n"
+                             "fun make_adder(k) {\n"
+                             "    fun add() { return k + base; }\n"
+                             "    return add;\n"
+                             "}\n");
+    for (const std::string &output : runProgram("import \"adder.lox\";\n"
+                                                "print(make_adder(1)());\n",
+                                                testing::TempDir())) {
+        EXPECT_EQ(output, "11\n");
+    }
+}
+
+// Test: a module is parsed and resolved once per process
+TEST(ModuleLoaderTest, LoadsModuleOnce) {
+    writeModule("once.lox", "var value = 1;\n");
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    std::vector<Token> tokens =
+        Scanner("\"once.lox\" \"./once.lox\" \"missing.lox\"").scan_tokens();
+    const Module &module =
+        ModuleLoader::load(tokens[0], testing::TempDir(), interpreter);
+    EXPECT_EQ(&ModuleLoader::load(tokens[1], testing::TempDir(), interpreter),
+              &module);
+    ASSERT_EQ(module.exports.size(), 1);
+    EXPECT_EQ(module.exports[0].name, "value");
+    EXPECT_THROW(
+        ModuleLoader::load(tokens[2], testing::TempDir(), interpreter),
+        StaticException);
+}
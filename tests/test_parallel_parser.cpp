@@ -0,0 +1,83 @@
+#include "clox/common/error_manager.hpp"
+#include "clox/parser/parallel_parser.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include <gtest/gtest.h>
+
+const std::string SOURCE = R"(var a = 1;
+fun f() {
+    var s = "
+fun not_a_boundary() {}";
+}
+// fun in a comment
+/* class
+   in a block comment */
+class A {
+    fun m() { return 1; }
+}
+print(a);
+fun g() {}
+)";
+
+// Test: the source should only be split before top-level declarations, each
+// chunk knowing its first line
+TEST(ParallelParserTest, SplitsAtTopLevelDeclarations) {
+    std::vector<SourceChunk> chunks = split_source(SOURCE, SOURCE.size());
+    ASSERT_EQ(chunks.size(), 4);
+    EXPECT_EQ(chunks[0].text, "var a = 1;\n");
+    EXPECT_EQ(chunks[1].first_line, 2);
+    EXPECT_EQ(chunks[1].text.substr(0, 7), "fun f()");
+    EXPECT_EQ(chunks[2].first_line, 9);
+    EXPECT_EQ(chunks[2].text.substr(0, 7), "class A");
+    EXPECT_EQ(chunks[3].first_line, 13);
+    EXPECT_EQ(chunks[3].text, "fun g() {}\n");
+
+    std::string joined;
+    for (const SourceChunk &chunk : chunks) {
+        joined += chunk.text;
+    }
+    EXPECT_EQ(joined, SOURCE);
+    EXPECT_EQ(split_source(SOURCE, 1).size(), 1);
+}
+
+std::string programOf(size_t function_num) {
+    std::string program;
+    for (size_t i = 0; i < function_num; ++i) {
+        program += "fun f" + std::to_string(i) + "(a) {\n    return a;\n}\n";
+    }
+    return program;
+}
+
+// Test: the statements of the chunks should be stitched back in order, the
+// tokens keeping their line in the file
+TEST(ParallelParserTest, ParsesInOrder) {
+    std::string program = programOf(20000);
+    ThreadPool pool(4);
+    ParallelParser parser;
+    std::vector<Stmt *> stmts = parser.parse_program(program, pool);
+
+    ASSERT_EQ(stmts.size(), 20000);
+    for (size_t i = 0; i < stmts.size(); ++i) {
+        auto function = dynamic_cast<FunctionDecl *>(stmts[i]);
+        ASSERT_NE(function, nullptr);
+        EXPECT_EQ(function->name->lexeme, "f" + std::to_string(i));
+        EXPECT_EQ(function->name->line, 3 * i + 1);
+    }
+}
+
+// Test: errors should be reported once, as by the serial scanner and parser
+TEST(ParallelParserTest, ReportsErrorsInOrder) {
+    std::string program =
+        programOf(10000) + "var = 1;\n" + programOf(10000) + "@\n";
+
+    ThreadPool pool(4);
+    ParallelParser parser;
+    ErrorManager::had_static_err = false;
+    testing::internal::CaptureStdout();
+    parser.parse_program(program, pool);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "[line 60002] Error: Unexpected character.\n"
+              "[line 30001] Error at '=': Expected a variable name\n");
+    EXPECT_TRUE(ErrorManager::had_static_err);
+    ErrorManager::had_static_err = false;
+}
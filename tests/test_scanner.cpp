@@ -1,108 +1,211 @@
 #include "clox/common/token.hpp"
 #include "clox/scanner/scanner.hpp"
+#include <cstdlib>
 #include <gtest/gtest.h>
+#include <limits>
+#include <string>
 
 // Test: scan_tokens should correctly parse an arithmetic expression
 TEST(ScannerTest, ArithmeticExpression) {
     Scanner scanner("3 + 4 * 2");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     EXPECT_EQ(tokens.size(), 5);
-    EXPECT_EQ(tokens[0]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[1]->type, TokenType::PLUS);
-    EXPECT_EQ(tokens[2]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[3]->type, TokenType::STAR);
-    EXPECT_EQ(tokens[4]->type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[0].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[1].type, TokenType::PLUS);
+    EXPECT_EQ(tokens[2].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[3].type, TokenType::STAR);
+    EXPECT_EQ(tokens[4].type, TokenType::NUMBER);
 }
 
 // Test: scan_tokens should correctly parse a logic expression
 TEST(ScannerTest, LogicExpression) {
     Scanner scanner("(3 + 4) > 2 and (4 * 2) < 10 or !(true and false)");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     EXPECT_EQ(tokens.size(), 22);
-    EXPECT_EQ(tokens[0]->type, TokenType::LEFT_PAREN);
-    EXPECT_EQ(tokens[1]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[2]->type, TokenType::PLUS);
-    EXPECT_EQ(tokens[3]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[4]->type, TokenType::RIGHT_PAREN);
-    EXPECT_EQ(tokens[5]->type, TokenType::GREATER);
-    EXPECT_EQ(tokens[6]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[7]->type, TokenType::AND);
-    EXPECT_EQ(tokens[8]->type, TokenType::LEFT_PAREN);
-    EXPECT_EQ(tokens[9]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[10]->type, TokenType::STAR);
-    EXPECT_EQ(tokens[11]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[12]->type, TokenType::RIGHT_PAREN);
-    EXPECT_EQ(tokens[13]->type, TokenType::LESS);
-    EXPECT_EQ(tokens[14]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[15]->type, TokenType::OR);
-    EXPECT_EQ(tokens[16]->type, TokenType::BANG);
-    EXPECT_EQ(tokens[17]->type, TokenType::LEFT_PAREN);
-    EXPECT_EQ(tokens[18]->type, TokenType::TRUE);
-    EXPECT_EQ(tokens[19]->type, TokenType::AND);
-    EXPECT_EQ(tokens[20]->type, TokenType::FALSE);
-    EXPECT_EQ(tokens[21]->type, TokenType::RIGHT_PAREN);
+    EXPECT_EQ(tokens[0].type, TokenType::LEFT_PAREN);
+    EXPECT_EQ(tokens[1].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[2].type, TokenType::PLUS);
+    EXPECT_EQ(tokens[3].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[4].type, TokenType::RIGHT_PAREN);
+    EXPECT_EQ(tokens[5].type, TokenType::GREATER);
+    EXPECT_EQ(tokens[6].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[7].type, TokenType::AND);
+    EXPECT_EQ(tokens[8].type, TokenType::LEFT_PAREN);
+    EXPECT_EQ(tokens[9].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[10].type, TokenType::STAR);
+    EXPECT_EQ(tokens[11].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[12].type, TokenType::RIGHT_PAREN);
+    EXPECT_EQ(tokens[13].type, TokenType::LESS);
+    EXPECT_EQ(tokens[14].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[15].type, TokenType::OR);
+    EXPECT_EQ(tokens[16].type, TokenType::BANG);
+    EXPECT_EQ(tokens[17].type, TokenType::LEFT_PAREN);
+    EXPECT_EQ(tokens[18].type, TokenType::TRUE);
+    EXPECT_EQ(tokens[19].type, TokenType::AND);
+    EXPECT_EQ(tokens[20].type, TokenType::FALSE);
+    EXPECT_EQ(tokens[21].type, TokenType::RIGHT_PAREN);
 }
 
 // Test: scan_tokens should ignore comments
 TEST(ScannerTest, SingleLineComment) {
     Scanner scanner("// this is a comment\n3 + 4");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     EXPECT_EQ(tokens.size(), 3);
-    EXPECT_EQ(tokens[0]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[1]->type, TokenType::PLUS);
-    EXPECT_EQ(tokens[2]->type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[0].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[1].type, TokenType::PLUS);
+    EXPECT_EQ(tokens[2].type, TokenType::NUMBER);
 }
 
 // Test: parse_str should correctly parse a string
 TEST(ScannerTest, ParseString) {
     Scanner scanner("\"hello world\"");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     EXPECT_EQ(tokens.size(), 1);
-    EXPECT_EQ(tokens[0]->type, TokenType::STRING);
+    EXPECT_EQ(tokens[0].type, TokenType::STRING);
 }
 
 // Test: scan_tokens should return an empty vector for an empty source string
 TEST(ScannerTest, EmptySource) {
     Scanner scanner("");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     EXPECT_TRUE(tokens.empty());
 }
 
 // Test: scan_tokens should correctly identify a single token
 TEST(ScannerTest, SingleToken) {
     Scanner scanner("identifier");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     ASSERT_EQ(tokens.size(), 1);
-    EXPECT_EQ(tokens[0]->type, TokenType::IDENTIFIER);
-    EXPECT_EQ(tokens[0]->lexeme, "identifier");
+    EXPECT_EQ(tokens[0].type, TokenType::IDENTIFIER);
+    EXPECT_EQ(tokens[0].lexeme, "identifier");
 }
 
 // Test: scan_tokens should correctly handle multiple tokens
 TEST(ScannerTest, MultipleTokens) {
     Scanner scanner("var x = 42;");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     ASSERT_EQ(tokens.size(), 5);
-    EXPECT_EQ(tokens[0]->type, TokenType::VAR);
-    EXPECT_EQ(tokens[1]->type, TokenType::IDENTIFIER);
-    EXPECT_EQ(tokens[2]->type, TokenType::EQUAL);
-    EXPECT_EQ(tokens[3]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[4]->type, TokenType::SEMICOLON);
+    EXPECT_EQ(tokens[0].type, TokenType::VAR);
+    EXPECT_EQ(tokens[1].type, TokenType::IDENTIFIER);
+    EXPECT_EQ(tokens[2].type, TokenType::EQUAL);
+    EXPECT_EQ(tokens[3].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[4].type, TokenType::SEMICOLON);
 }
 
 // Test: scan_tokens should handle whitespace correctly
 TEST(ScannerTest, Whitespace) {
     Scanner scanner(" \t\nvar\n\t x = 42; \t");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     ASSERT_EQ(tokens.size(), 5);
-    EXPECT_EQ(tokens[0]->type, TokenType::VAR);
-    EXPECT_EQ(tokens[1]->type, TokenType::IDENTIFIER);
-    EXPECT_EQ(tokens[2]->type, TokenType::EQUAL);
-    EXPECT_EQ(tokens[3]->type, TokenType::NUMBER);
-    EXPECT_EQ(tokens[4]->type, TokenType::SEMICOLON);
+    EXPECT_EQ(tokens[0].type, TokenType::VAR);
+    EXPECT_EQ(tokens[1].type, TokenType::IDENTIFIER);
+    EXPECT_EQ(tokens[2].type, TokenType::EQUAL);
+    EXPECT_EQ(tokens[3].type, TokenType::NUMBER);
+    EXPECT_EQ(tokens[4].type, TokenType::SEMICOLON);
 }
 
 TEST(ScannerTest, OnlyWhitespace) {
     Scanner scanner(" \t\n ");
-    std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
+    std::vector<Token> tokens = scanner.scan_tokens();
     EXPECT_TRUE(tokens.empty());
 }
+
+// Test: lexemes should view the source instead of copying it
+TEST(ScannerTest, LexemesViewSource) {
+    std::string source = "var answer = \"yes\";";
+    Scanner scanner(source);
+    std::vector<Token> tokens = scanner.scan_tokens();
+    ASSERT_EQ(tokens.size(), 5);
+    EXPECT_EQ(tokens[1].lexeme, "answer");
+    EXPECT_EQ(tokens[1].lexeme.data(), source.data() + 4);
+    EXPECT_EQ(tokens[3].lexeme.data(), source.data() + 13);
+    EXPECT_EQ(tokens[3].literal.as_string(), "yes");
+}
+
+// Test: runs longer than a vector should keep lexemes and lines right
+TEST(ScannerTest, LongRuns) {
+    std::string name(70, 'a');
+    name += "_Z9";
+    std::string source = "var " + name + " = \"" + std::string(40, 's') +
+                         "\n\nend\";" + std::string(50, ' ') + "\n\t\r\n" +
+                         "/*" + std::string(45, '*') + "\n*/" + name + ";";
+    Scanner scanner(source);
+    std::vector<Token> tokens = scanner.scan_tokens();
+    ASSERT_EQ(tokens.size(), 7);
+    EXPECT_EQ(tokens[1].lexeme, name);
+    EXPECT_EQ(tokens[3].type, TokenType::STRING);
+    EXPECT_EQ(tokens[3].literal.as_string(),
+              std::string(40, 's') + "\n\nend");
+    EXPECT_EQ(tokens[3].line, 3);
+    EXPECT_EQ(tokens[5].lexeme, name);
+    EXPECT_EQ(tokens[5].line, 6);
+}
+
+// Test: unterminated comments and strings should stop at the end of source
+TEST(ScannerTest, UnterminatedAtEnd) {
+    std::string comment = "1 /*" + std::string(40, ' ') + "*";
+    Scanner comment_scanner(comment);
+    EXPECT_EQ(comment_scanner.scan_tokens().size(), 1);
+
+    testing::internal::CaptureStdout();
+    std::string str = "\"" + std::string(40, 'x');
+    Scanner str_scanner(str);
+    EXPECT_TRUE(str_scanner.scan_tokens().empty());
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "[line 1] Error: Unterminated string\n");
+}
+
+// Test: every keyword should be found by the perfect hash, near misses are
+// identifiers
+TEST(ScannerTest, Keywords) {
+    for (const Keyword &keyword : KEYWORDS) {
+        EXPECT_EQ(find_keyword(keyword.name), keyword.type);
+    }
+    for (std::string_view word : {"classes", "iff", "an", "o", "thiss", "Var",
+                                  "whilE", "continu", "f", "nill", "_"}) {
+        EXPECT_EQ(find_keyword(word), TokenType::IDENTIFIER) << word;
+    }
+}
+
+// Test: numbers should be parsed from the source buffer
+TEST(ScannerTest, Numbers) {
+    Scanner scanner("3.25 42 7. 0.5");
+    std::vector<Token> tokens = scanner.scan_tokens();
+    ASSERT_EQ(tokens.size(), 4);
+    EXPECT_EQ(tokens[0].literal, 3.25);
+    EXPECT_EQ(tokens[1].literal, 42.0);
+    EXPECT_EQ(tokens[2].literal, 7.0);
+    EXPECT_EQ(tokens[2].lexeme, "7.");
+    EXPECT_EQ(tokens[3].literal, 0.5);
+}
+
+// Test: a number literal out of the double range is rounded to inf or 0
+TEST(ScannerTest, NumbersOutOfRange) {
+    std::string huge = "1" + std::string(400, '0');
+    std::string tiny = "0." + std::string(400, '0') + "1";
+    std::string denormal = "0." + std::string(310, '0') + "1";
+    std::string source = huge + " " + tiny + " " + denormal;
+    Scanner scanner(source);
+    std::vector<Token> tokens = scanner.scan_tokens();
+    ASSERT_EQ(tokens.size(), 3);
+    EXPECT_EQ(tokens[0].literal, std::numeric_limits<double>::infinity());
+    EXPECT_EQ(tokens[0].lexeme, huge);
+    EXPECT_EQ(tokens[1].literal, 0.0);
+    EXPECT_EQ(tokens[2].literal, std::strtod(denormal.c_str(), nullptr));
+}
+
+// Test: scan_next_token should return the tokens of scan_tokens one by one
+TEST(ScannerTest, ScansLazily) {
+    std::string source = "var x = 1; // comment\nprint(x);";
+    std::vector<Token> tokens = Scanner(source).scan_tokens();
+
+    Scanner scanner(source);
+    Token token;
+    for (const Token &expected : tokens) {
+        ASSERT_TRUE(scanner.scan_next_token(token));
+        EXPECT_EQ(token.type, expected.type);
+        EXPECT_EQ(token.lexeme.data(), expected.lexeme.data());
+        EXPECT_EQ(token.line, expected.line);
+    }
+    EXPECT_FALSE(scanner.scan_next_token(token));
+}
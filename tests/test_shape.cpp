@@ -0,0 +1,46 @@
+#include "clox/ast_interpreter/callable/class.hpp"
+#include "clox/common/heap.hpp"
+#include "clox/common/shape.hpp"
+#include <gtest/gtest.h>
+
+TEST(ShapeTest, SharesShapeForSamePropOrder) {
+    LoxString *x = Heap::make_string("x");
+    LoxString *y = Heap::make_string("y");
+
+    Shape *xy = Shape::root()->add_prop(x)->add_prop(y);
+    EXPECT_EQ(xy, Shape::root()->add_prop(x)->add_prop(y));
+    EXPECT_NE(xy, Shape::root()->add_prop(y)->add_prop(x));
+    EXPECT_EQ(xy->get_prop_num(), 2);
+    EXPECT_EQ(xy->find_slot(x), 0);
+    EXPECT_EQ(xy->find_slot(y), 1);
+    EXPECT_EQ(Shape::root()->find_slot(x), -1);
+}
+
+TEST(ShapeTest, CachesPropSlotPerShape) {
+    LoxString *x = Heap::make_string("x");
+    LoxString *y = Heap::make_string("y");
+    LoxClass lox_class;
+    LoxInstance a{&lox_class};
+    LoxInstance b{&lox_class};
+
+    PropertyCache set_x, set_y, get_y;
+    a.set_prop(x, 1.0, set_x);
+    a.set_prop(y, 2.0, set_y);
+    b.set_prop(x, 3.0, set_x);
+    b.set_prop(y, 4.0, set_y);
+    // b follows the transitions cached for a
+    EXPECT_EQ(set_x.entry_num, 1);
+    EXPECT_EQ(set_y.entry_num, 1);
+
+    EXPECT_EQ(a.find_prop_slot(y, get_y), 1);
+    EXPECT_EQ(b.find_prop_slot(y, get_y), 1);
+    EXPECT_EQ(get_y.entry_num, 1);
+
+    // Overwrite an existing prop without changing the shape
+    b.set_prop(x, 5.0, set_x);
+    EXPECT_EQ(set_x.entry_num, 2);
+
+    LoxInstance empty{&lox_class};
+    EXPECT_EQ(empty.find_prop_slot(y, get_y), -1);
+    EXPECT_EQ(get_y.entry_num, 2);
+}
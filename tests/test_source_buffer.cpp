@@ -0,0 +1,52 @@
+#include "clox/scanner/scanner.hpp"
+#include "clox/scanner/source_buffer.hpp"
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+const std::string SOURCE = "var answer = 42;\nprint(answer);\n";
+
+// Test: a regular file should be mapped and scanned in place
+TEST(SourceBufferTest, MapsRegularFile) {
+    std::string path = testing::TempDir() + "source_buffer_test.lox";
+    std::ofstream(path) << SOURCE;
+
+    SourceBuffer source;
+    ASSERT_TRUE(source.load_file(path));
+    EXPECT_TRUE(source.is_mapped());
+    EXPECT_EQ(source.view(), SOURCE);
+
+    Scanner scanner{source.view()};
+    std::vector<Token> tokens = scanner.scan_tokens();
+    ASSERT_EQ(tokens.size(), 10);
+    EXPECT_EQ(tokens[1].lexeme.data(), source.view().data() + 4);
+    std::remove(path.c_str());
+}
+
+// Test: a pipe cannot be mapped, it should be read until EOF
+TEST(SourceBufferTest, ReadsPipe) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_EQ(write(fds[1], SOURCE.data(), SOURCE.size()),
+              ssize_t(SOURCE.size()));
+    close(fds[1]);
+
+    SourceBuffer source;
+    ASSERT_TRUE(source.load_file("/dev/fd/" + std::to_string(fds[0])));
+    EXPECT_FALSE(source.is_mapped());
+    EXPECT_EQ(source.view(), SOURCE);
+    close(fds[0]);
+}
+
+TEST(SourceBufferTest, LoadsEmptyAndMissingFile) {
+    std::string path = testing::TempDir() + "source_buffer_empty.lox";
+    std::ofstream{path};
+
+    SourceBuffer source;
+    ASSERT_TRUE(source.load_file(path));
+    EXPECT_TRUE(source.view().empty());
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(source.load_file(path));
+}
@@ -0,0 +1,110 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/common/error_manager.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/middleware/streaming_runner.hpp"
+#include "clox/parser/ast_arena.hpp"
+#include "clox/vm/vm.hpp"
+#include <deque>
+#include <gtest/gtest.h>
+#include <memory>
+
+// Return the output of the source streamed to a new interpreter (or VM), and
+// the tokens it kept
+std::string runStreaming(const std::string &source, bool use_vm,
+                         std::deque<Token> &tokens) {
+    auto interpreter = std::make_shared<AstInterpreter>(false);
+    auto vm = std::make_shared<VM>(false);
+    IdentifierResolver resolver{interpreter};
+    AstArena arena;
+    auto execute = [&](std::vector<Stmt *> &stmts) {
+        if (use_vm) {
+            vm->interpret_program(stmts);
+        } else {
+            interpreter->interpret_program(stmts);
+        }
+        return !ErrorManager::had_runtime_err;
+    };
+
+    ErrorManager::had_runtime_err = false;
+    testing::internal::CaptureStdout();
+    StreamingRunner::run(source, tokens, arena, resolver, execute);
+    return testing::internal::GetCapturedStdout();
+}
+
+// Test: only the declarations declaring a function keep their tokens, the
+// others are released once they ran
+TEST(StreamingRunnerTest, KeepsFunctionDeclarations) {
+    std::string source = "var a = 1;\n"
+                         "while a < 3 { a = a + 1; }\n"
+                         "fun f() { return a + 1; }\n"
+                         "if a == 3 { print(f()); }\n"
+                         "{ fun g() { return 2; } print(g()); }\n"
+                         "print(f());\n";
+    for (bool use_vm : {false, true}) {
+        std::deque<Token> tokens;
+        EXPECT_EQ(runStreaming(source, use_vm, tokens), "4\n2\n4\n")
+            << use_vm;
+        std::string kept;
+        for (const Token &token : tokens) {
+            kept += std::string(token.lexeme) + " ";
+        }
+        EXPECT_EQ(kept, "fun f ( ) { return a + 1 ; } "
+                        "{ fun g ( ) { return 2 ; } print ( g ( ) ) ; } ")
+            << use_vm;
+    }
+}
+
+// Test: a static error is reported after the declarations before it ran, the
+// next ones are only checked
+TEST(StreamingRunnerTest, ReportsErrorsAfterEarlierDeclarationsRan) {
+    for (bool use_vm : {false, true}) {
+        std::deque<Token> tokens;
+        EXPECT_EQ(runStreaming("print(1);\n"
+                               "var = 2;\n"
+                               "print(3);\n",
+                               use_vm, tokens),
+                  "1\n"
+                  "[line 2] Error at '=': Expected a variable name\n"
+                  "Parser error occurs\n")
+            << use_vm;
+        EXPECT_TRUE(ErrorManager::had_static_err);
+
+        std::string output = runStreaming("print(1);\n"
+                                          "{ var b = 1; var b = 2; }\n"
+                                          "print(3);\n",
+                                          use_vm, tokens);
+        std::string error = "[line 2] Error at 'b': Variable with name b "
+                            "already declared in this scope.\n"
+                            "Resolver error occurs\n";
+        EXPECT_EQ(output.substr(0, 2), "1\n") << output;
+        ASSERT_GE(output.size(), error.size()) << output;
+        EXPECT_EQ(output.substr(output.size() - error.size()), error);
+        EXPECT_TRUE(ErrorManager::had_static_err);
+        EXPECT_TRUE(tokens.empty());
+        ErrorManager::had_static_err = false;
+    }
+}
+
+struct Counted {
+    int *destructed;
+    ~Counted() { ++*destructed; }
+};
+
+// Test: releasing the arena to a mark destructs and frees the nodes made
+// after it only, the next nodes reuse their memory
+TEST(StreamingRunnerTest, ReleasesArenaToMark) {
+    int destructed = 0;
+    AstArena arena;
+    Counted *kept = arena.make<Counted>(Counted{&destructed});
+    destructed = 0;
+    AstArena::Mark mark = arena.mark();
+    Counted *released = arena.make<Counted>(Counted{&destructed});
+    for (int i = 0; i < 10000; ++i) {
+        arena.make<Counted>(Counted{&destructed});
+    }
+    destructed = 0;
+    arena.release(mark);
+    EXPECT_EQ(destructed, 10001);
+    EXPECT_EQ(arena.make<Counted>(Counted{&destructed}), released);
+    EXPECT_EQ(kept->destructed, &destructed);
+}
@@ -0,0 +1,81 @@
+#include "clox/ast_interpreter/ast_interpreter.hpp"
+#include "clox/middleware/identifier_resolver.hpp"
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include "tests/run_program.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+// Test: only the call returned as is by a function is a tail call
+TEST(TailCallTest, MarksCallsInTailPosition) {
+    std::string source = "fun f(n) { return f(n); }"
+                         "fun g(n) { return f(n) + 1; }";
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+    AstArena arena;
+    auto stmts = Parser(tokens, arena).parse_program();
+    IdentifierResolver{std::make_shared<AstInterpreter>(false)}
+        .resolve_program(stmts);
+
+    auto return_of = [&](size_t i) {
+        auto func = static_cast<FunctionDecl *>(stmts[i]);
+        return static_cast<ReturnStmt *>(func->body->stmts[0]);
+    };
+    EXPECT_TRUE(return_of(0)->is_tail_call);
+    EXPECT_FALSE(return_of(1)->is_tail_call);
+}
+
+// Test: a chain of tail calls runs in a constant stack
+TEST(TailCallTest, RunsDeepTailRecursion) {
+    auto outputs = runProgram("fun count(n, acc) {"
+                              "  if n == 0 { return acc; }"
+                              "  return count(n - 1, acc + 1);"
+                              "}"
+                              "class Loop {"
+                              "  fun run(n) {"
+                              "    if n == 0 { return \"done\"; }"
+                              "    return this.run(n - 1);"
+                              "  }"
+                              "}"
+                              "print(count(1000000, 0));"
+                              "print(Loop().run(1000000));");
+    EXPECT_EQ(outputs[0], "1000000\ndone\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
+
+// Test: the tail calls of natives, classes and closures return their result
+TEST(TailCallTest, ReturnsResultOfAnyCallee) {
+    auto outputs = runProgram("class Box { fun init(v) { this.v = v; } }"
+                              "fun box(v) { return Box(v); }"
+                              "fun to_str(v) { return str(v); }"
+                              "fun adder(x) {"
+                              "  fun add(y) { return x + y; }"
+                              "  return add;"
+                              "}"
+                              "fun apply(f, v) { return f(v); }"
+                              "print(box(1).v);"
+                              "print(to_str(2) + \"!\");"
+                              "print(apply(adder(3), 4));");
+    EXPECT_EQ(outputs[0], "1\n2!\n7\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
+
+// Test: a call returned by init does not replace the constructor's result
+TEST(TailCallTest, KeepsInstanceReturnedByInit) {
+    auto outputs = runProgram("fun helper() { return 3; }"
+                              "class A {"
+                              "  fun init() {"
+                              "    this.x = 1;"
+                              "    return this.other();"
+                              "  }"
+                              "  fun other() { return 7; }"
+                              "  fun get() { return this.x; }"
+                              "}"
+                              "class B { fun init() { return helper(); } }"
+                              "print(A());"
+                              "print(A().get());"
+                              "print(B());");
+    EXPECT_EQ(outputs[0], "<Instance A>\n1\n<Instance B>\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}
@@ -0,0 +1,95 @@
+#include "clox/parser/parser.hpp"
+#include "clox/scanner/scanner.hpp"
+#include "clox/vm/vm.hpp"
+#include "tests/run_program.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+
+void evaluateVmExpression(const std::string &source, const ExprVal &expected) {
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+
+    AstArena arena;
+    Parser parser{tokens, arena};
+    auto expression = parser.parse_single_expr();
+
+    auto vm = std::make_shared<VM>(false);
+    auto actual = vm->interpret_single_expr(*expression);
+
+    ASSERT_EQ(actual, expected);
+}
+
+void evaluateVmExpression(const std::string &source,
+                          const std::string &expected) {
+    Scanner scanner{source};
+    auto tokens = scanner.scan_tokens();
+
+    AstArena arena;
+    Parser parser{tokens, arena};
+    auto expression = parser.parse_single_expr();
+
+    auto vm = std::make_shared<VM>(false);
+    auto actual = vm->interpret_single_expr(*expression);
+
+    ASSERT_TRUE(actual.is_string());
+    ASSERT_EQ(actual.as_string(), expected);
+}
+
+TEST(VmTest, EvaluatesLiteral) {
+    evaluateVmExpression("\"Cafe treebee\"", std::string("Cafe treebee"));
+    evaluateVmExpression("522001", 522001.0);
+    evaluateVmExpression("true", true);
+    evaluateVmExpression("nil", NIL);
+}
+
+TEST(VmTest, EvaluatesUnaryExpression) {
+    evaluateVmExpression("-5 * 3", -15.0);
+    evaluateVmExpression("!true", false);
+    evaluateVmExpression("-(-3)", 3.0);
+}
+
+TEST(VmTest, EvaluatesBinaryExpression) {
+    evaluateVmExpression("(1 + 2) % 3", 0.0);
+    evaluateVmExpression("5 + (3 * 2) - 4 / 2", 9.0);
+    evaluateVmExpression("true and false", false);
+    evaluateVmExpression("nil or 1", true);
+    evaluateVmExpression("\"Hello, \" + \"world!\"",
+                         std::string("Hello, world!"));
+    evaluateVmExpression("\"n\" + 1", std::string("n1"));
+    evaluateVmExpression("1 == true", true);
+}
+
+TEST(VmTest, EvaluatesComparisonExpression) {
+    evaluateVmExpression("5 < 10", true);
+    evaluateVmExpression("5 >= 5", true);
+    evaluateVmExpression("5 != 6", true);
+    evaluateVmExpression("\"abc\" > \"def\"", false);
+}
+
+TEST(VmTest, EvaluatesNativeCall) {
+    evaluateVmExpression("str(12) + str(true)", std::string("12true"));
+    evaluateVmExpression("int(3.9)", 3.0);
+    evaluateVmExpression("List(1, 2, 3).size()", 3.0);
+}
+
+// Test: runtime errors are reported at the same token as the AstInterpreter
+TEST(VmTest, ReportsRuntimeErrorsAtToken) {
+    auto outputs = runProgram("print(num(\"aa2.9\"));");
+    EXPECT_EQ(outputs[0],
+              "[line 1] Error at 'num': Cannot cast string to double\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+
+    outputs = runProgram("var x = 1;\n"
+                         "x = 1 - \"a\";");
+    EXPECT_EQ(outputs[0],
+              "[line 2] Error at '-': Right operand must be a number\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+
+    // An error inside a call is reported at the outermost call
+    outputs = runProgram("fun f(a) {\n"
+                         "  return a / 0;\n"
+                         "}\n"
+                         "print(f(1));");
+    EXPECT_EQ(outputs[0], "[line 4] Error at 'f': Devide by 0\n");
+    EXPECT_EQ(outputs[1], outputs[0]);
+}